@@ -1,22 +1,131 @@
 from launch import LaunchDescription
-from launch_ros.actions import Node
+from launch.actions import DeclareLaunchArgument
+from launch.conditions import IfCondition, LaunchConfigurationEquals, UnlessCondition
+from launch.substitutions import LaunchConfiguration
+from launch_ros.actions import ComposableNodeContainer, LoadComposableNodes, Node
+from launch_ros.descriptions import ComposableNode
+
+# Namespace and device of every camera. image_processing works through all of their frames on one
+# thread and one pair of stage workers; the first camera's detections go to image_data, the others'
+# to <namespace>/image_data. A second camera would be e.g. ('pickup_camera', '/dev/video2').
+CAMERAS = [
+    ('camera', '/dev/video0')
+]
 
 def generate_launch_description():
+    # Teleop joins the container by default, so the stop button reaches cmd_vel without DDS.
+    teleop_in_container = LaunchConfiguration('teleop_in_container')
+    # The ball map needs odometry, so it is only started where there is some, e.g. in simulation.
+    ball_map = LaunchConfiguration('ball_map')
+
+    # The whole chain from camera to motors shares one process, so frames, detections and velocity
+    # commands are handed over through intra-process comms instead of being serialized and copied.
+    # Only the binary motor driver joins it; arduino_controller.py gets cmd_vel over DDS.
+    # The multi-threaded container lets navigation's callback groups run alongside the camera.
+    vision_container = ComposableNodeContainer(
+        name='vision_container',
+        namespace='',
+        package='rclcpp_components',
+        executable='component_container_mt',
+        composable_node_descriptions=[
+            ComposableNode(
+                package='vision',
+                plugin='vision::CameraDriver',
+                name='camera_driver',
+                namespace=camera,
+                parameters=[{'device': device}],
+                extra_arguments=[{'use_intra_process_comms': True}]
+            ) for camera, device in CAMERAS
+        ] + [
+            ComposableNode(
+                package='vision',
+                plugin='vision::ImageProcessing',
+                name='image_processing',
+                # The ball map needs every candidate, not only those near the tracked ball.
+                parameters=[{'cameras': [camera for camera, _ in CAMERAS], 'all_ball_candidates': ball_map}],
+                extra_arguments=[{'use_intra_process_comms': True}]
+            ),
+            ComposableNode(
+                package='motion',
+                plugin='motion::Navigation',
+                name='navigation',
+                extra_arguments=[{'use_intra_process_comms': True}]
+            )
+        ],
+        output='screen'
+    )
+
+    teleop = LoadComposableNodes(
+        target_container='vision_container',
+        condition=IfCondition(teleop_in_container),
+        composable_node_descriptions=[
+            ComposableNode(
+                package='manual_control',
+                plugin='manual_control::JoyLinux',
+                name='joy_node',
+                extra_arguments=[{'use_intra_process_comms': True}]
+            ),
+            ComposableNode(
+                package='manual_control',
+                plugin='manual_control::ManualControl',
+                name='manual_control',
+                extra_arguments=[{'use_intra_process_comms': True}]
+            )
+        ]
+    )
+
+    # Which protocol the Arduino sketch speaks: "text" for the sketch the board ships with, driven by
+    # arduino_controller.py, or "binary" for the framed CRC protocol of include/motion/motor_protocol.hpp,
+    # driven by motor_driver in the container. Only one of them may hold the serial port.
+    binary_motor_driver = LoadComposableNodes(
+        target_container='vision_container',
+        condition=LaunchConfigurationEquals('motor_driver', 'binary'),
+        composable_node_descriptions=[
+            ComposableNode(
+                package='motion',
+                plugin='motion::MotorDriver',
+                name='motor_driver',
+                extra_arguments=[{'use_intra_process_comms': True}]
+            )
+        ]
+    )
+    text_motor_driver = Node(
+        package='motion',
+        executable='arduino_controller.py',
+        condition=LaunchConfigurationEquals('motor_driver', 'text'),
+        output='screen'
+    )
+
+    mapping = LoadComposableNodes(
+        target_container='vision_container',
+        condition=IfCondition(ball_map),
+        composable_node_descriptions=[
+            ComposableNode(
+                package='motion',
+                plugin='motion::BallMapping',
+                name='ball_map',
+                extra_arguments=[{'use_intra_process_comms': True}]
+            )
+        ]
+    )
+
     return LaunchDescription([
-        Node(
-            package='vision',
-            executable='image_processing'
-        ),
+        DeclareLaunchArgument('teleop_in_container', default_value='true'),
+        DeclareLaunchArgument('ball_map', default_value='false'),
+        DeclareLaunchArgument('motor_driver', default_value='text', choices=['text', 'binary']),
+        vision_container,
+        binary_motor_driver,
+        text_motor_driver,
+        teleop,
+        mapping,
         Node(
             package='manual_control',
-            executable='joy_linux_node'
+            executable='joy_linux_node',
+            condition=UnlessCondition(teleop_in_container)
         ),
         Node(
             package='manual_control',
-            executable='manual_control'
-        ),
-        Node(
-            package='motion',
-            executable='navigation'
+            executable='manual_control',
+            condition=UnlessCondition(teleop_in_container)
         )
     ])
@@ -0,0 +1,120 @@
+#ifndef INSTRUMENTATION__LATENCY_HISTOGRAM_HPP_
+#define INSTRUMENTATION__LATENCY_HISTOGRAM_HPP_
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace instrumentation
+{
+
+// Snapshot of a LatencyHistogram, taken and cleared once per reporting period.
+struct LatencySummary
+{
+    uint64_t count;
+    // Microseconds.
+    double p50, p99, max;
+};
+
+// Log-linear histogram of durations in microseconds: exact below 16 us, then 8 buckets per
+// power of two, so percentiles are within 12.5% up to ~16 s. Recording is a couple of relaxed
+// atomic increments, so any thread can record without locking or allocating.
+class LatencyHistogram
+{
+    private:
+        static constexpr int LINEAR_BUCKETS = 16;
+        static constexpr int SUB_BUCKET_BITS = 3;
+        static constexpr int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+        static constexpr int OCTAVES = 20;
+        static constexpr int BUCKETS = LINEAR_BUCKETS + OCTAVES * SUB_BUCKETS;
+
+        std::array<std::atomic<uint32_t>, BUCKETS> counts;
+        std::atomic<uint64_t> max_us;
+
+        static int bucket(uint64_t us)
+        {
+            if (us < LINEAR_BUCKETS)
+                return static_cast<int>(us);
+
+            int octave = 63 - __builtin_clzll(us);
+            int shift = octave - SUB_BUCKET_BITS;
+            int index = LINEAR_BUCKETS + (octave - 4) * SUB_BUCKETS + static_cast<int>((us >> shift) & (SUB_BUCKETS - 1));
+            return index < BUCKETS ? index : BUCKETS - 1;
+        }
+
+        // Middle of the bucket, in microseconds.
+        static double bucket_value(int index)
+        {
+            if (index < LINEAR_BUCKETS)
+                return index;
+
+            int octave = (index - LINEAR_BUCKETS) / SUB_BUCKETS + 4;
+            int sub_bucket = (index - LINEAR_BUCKETS) % SUB_BUCKETS;
+            int shift = octave - SUB_BUCKET_BITS;
+            return (static_cast<double>(SUB_BUCKETS + sub_bucket) + 0.5) * static_cast<double>(uint64_t(1) << shift);
+        }
+
+    public:
+        LatencyHistogram() : max_us(0)
+        {
+            for (auto &count : counts)
+                count.store(0, std::memory_order_relaxed);
+        }
+
+        void record(std::chrono::nanoseconds duration)
+        {
+            int64_t us = std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+            uint64_t value = us > 0 ? static_cast<uint64_t>(us) : 0;
+            counts[bucket(value)].fetch_add(1, std::memory_order_relaxed);
+
+            uint64_t previous = max_us.load(std::memory_order_relaxed);
+            while (value > previous && !max_us.compare_exchange_weak(previous, value, std::memory_order_relaxed))
+            {
+            }
+        }
+
+        // Summarises everything recorded since the last call and starts over. Should be called
+        // from one thread; samples recorded meanwhile land in either period.
+        LatencySummary take()
+        {
+            std::array<uint32_t, BUCKETS> taken;
+            uint64_t total = 0;
+            for (int i = 0; i < BUCKETS; i++)
+            {
+                taken[i] = counts[i].exchange(0, std::memory_order_relaxed);
+                total += taken[i];
+            }
+
+            LatencySummary summary{total, 0.0, 0.0, static_cast<double>(max_us.exchange(0, std::memory_order_relaxed))};
+            if (total == 0)
+                return summary;
+
+            uint64_t p50_rank = (total + 1) / 2, p99_rank = (total * 99 + 99) / 100;
+            uint64_t seen = 0;
+            bool have_p50 = false;
+            for (int i = 0; i < BUCKETS; i++)
+            {
+                seen += taken[i];
+                if (!have_p50 && seen >= p50_rank)
+                {
+                    summary.p50 = bucket_value(i);
+                    have_p50 = true;
+                }
+                if (seen >= p99_rank)
+                {
+                    summary.p99 = bucket_value(i);
+                    break;
+                }
+            }
+
+            // Bucket middles can overshoot the largest sample.
+            summary.p50 = summary.p50 < summary.max ? summary.p50 : summary.max;
+            summary.p99 = summary.p99 < summary.max ? summary.p99 : summary.max;
+            return summary;
+        }
+};
+
+}  // namespace instrumentation
+
+#endif  // INSTRUMENTATION__LATENCY_HISTOGRAM_HPP_
@@ -0,0 +1,115 @@
+#ifndef INSTRUMENTATION__LATENCY_REPORTER_HPP_
+#define INSTRUMENTATION__LATENCY_REPORTER_HPP_
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "diagnostic_msgs/msg/diagnostic_array.hpp"
+#include "instrumentation/latency_histogram.hpp"
+#include "rclcpp/rclcpp.hpp"
+
+namespace instrumentation
+{
+
+// One histogram per named stage of a node. Every period the p50, p99, max and sample count of
+// each stage since the last report are published as a DiagnosticStatus on /diagnostics, e.g.
+//
+//     ros2 topic echo /diagnostics
+//
+// Stages are recorded by index, in the order their names were given.
+class LatencyReporter
+{
+    private:
+        rclcpp::Node *node;
+        std::vector<std::string> stage_names;
+        std::unique_ptr<LatencyHistogram[]> histograms;
+        rclcpp::Publisher<diagnostic_msgs::msg::DiagnosticArray>::SharedPtr publisher;
+        rclcpp::TimerBase::SharedPtr timer;
+
+        static diagnostic_msgs::msg::KeyValue key_value(const std::string &key, double value)
+        {
+            char text[32];
+            std::snprintf(text, sizeof(text), "%.3f", value);
+
+            diagnostic_msgs::msg::KeyValue entry;
+            entry.key = key;
+            entry.value = text;
+            return entry;
+        }
+
+        void report()
+        {
+            diagnostic_msgs::msg::DiagnosticStatus status;
+            status.level = diagnostic_msgs::msg::DiagnosticStatus::OK;
+            status.name = std::string(node->get_fully_qualified_name()) + ": latency";
+            status.message = "Per-stage latency since the last report";
+
+            for (std::size_t i = 0; i < stage_names.size(); i++)
+            {
+                LatencySummary summary = histograms[i].take();
+                const std::string &stage = stage_names[i];
+                status.values.push_back(key_value(stage + " p50 (ms)", summary.p50 / 1000.0));
+                status.values.push_back(key_value(stage + " p99 (ms)", summary.p99 / 1000.0));
+                status.values.push_back(key_value(stage + " max (ms)", summary.max / 1000.0));
+                status.values.push_back(key_value(stage + " count", static_cast<double>(summary.count)));
+            }
+
+            diagnostic_msgs::msg::DiagnosticArray message;
+            message.header.stamp = node->now();
+            message.status.push_back(std::move(status));
+            publisher->publish(message);
+        }
+
+    public:
+        LatencyReporter(
+            rclcpp::Node *node,
+            std::vector<std::string> stages,
+            std::chrono::milliseconds period = std::chrono::milliseconds(1000))
+        : node(node), stage_names(std::move(stages)), histograms(new LatencyHistogram[stage_names.size()])
+        {
+            publisher = node->create_publisher<diagnostic_msgs::msg::DiagnosticArray>("/diagnostics", 10);
+            timer = node->create_wall_timer(period, [this]() { report(); });
+        }
+
+        // Safe to call from any thread.
+        void record(std::size_t stage, std::chrono::nanoseconds duration)
+        {
+            histograms[stage].record(duration);
+        }
+
+        void record(std::size_t stage, std::chrono::steady_clock::time_point start)
+        {
+            record(stage, std::chrono::steady_clock::now() - start);
+        }
+};
+
+// Records the time from construction to destruction into one stage.
+class StageTimer
+{
+    private:
+        LatencyReporter &reporter;
+        std::size_t stage;
+        std::chrono::steady_clock::time_point start;
+
+    public:
+        StageTimer(LatencyReporter &reporter, std::size_t stage)
+        : reporter(reporter), stage(stage), start(std::chrono::steady_clock::now())
+        {
+        }
+
+        ~StageTimer()
+        {
+            reporter.record(stage, start);
+        }
+
+        StageTimer(const StageTimer &) = delete;
+        StageTimer &operator=(const StageTimer &) = delete;
+};
+
+}  // namespace instrumentation
+
+#endif  // INSTRUMENTATION__LATENCY_REPORTER_HPP_
@@ -0,0 +1,237 @@
+#ifndef INSTRUMENTATION__NODE_HEALTH_HPP_
+#define INSTRUMENTATION__NODE_HEALTH_HPP_
+
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "diagnostic_updater/diagnostic_updater.hpp"
+#include "instrumentation/latency_histogram.hpp"
+#include "rclcpp/rclcpp.hpp"
+
+namespace instrumentation
+{
+
+// Counters of one callback, or of any other piece of work a node does per message. Recording is
+// a couple of relaxed atomic read-modify-writes, so any number of threads can record into the same
+// stats without locking, e.g. a node's receive and frame threads both counting drops of one callback.
+// Uncontended they cost next to nothing on the hot path; NodeHealth reads and resets them once per
+// report.
+class CallbackStats
+{
+    private:
+        LatencyHistogram durations;
+        std::atomic<uint64_t> dropped, max_queue_depth;
+
+    public:
+        CallbackStats() : dropped(0), max_queue_depth(0)
+        {
+        }
+
+        // One call that took duration.
+        void record(std::chrono::nanoseconds duration)
+        {
+            durations.record(duration);
+        }
+
+        void record(std::chrono::steady_clock::time_point start)
+        {
+            record(std::chrono::steady_clock::now() - start);
+        }
+
+        // Messages lost before this callback got to them: replaced, skipped as stale or superseded.
+        void record_dropped(uint64_t count = 1)
+        {
+            dropped.fetch_add(count, std::memory_order_relaxed);
+        }
+
+        // How many messages were waiting. The largest since the last report is shown.
+        void record_queue_depth(uint64_t depth)
+        {
+            uint64_t previous = max_queue_depth.load(std::memory_order_relaxed);
+            while (depth > previous && !max_queue_depth.compare_exchange_weak(previous, depth, std::memory_order_relaxed))
+            {
+            }
+        }
+
+        uint64_t take_dropped() { return dropped.exchange(0, std::memory_order_relaxed); }
+        uint64_t take_max_queue_depth() { return max_queue_depth.exchange(0, std::memory_order_relaxed); }
+        LatencySummary take_durations() { return durations.take(); }
+};
+
+// Records the time from construction to destruction as one call of a callback.
+class CallbackTimer
+{
+    private:
+        CallbackStats &stats;
+        std::chrono::steady_clock::time_point start;
+
+    public:
+        explicit CallbackTimer(CallbackStats &stats)
+        : stats(stats), start(std::chrono::steady_clock::now())
+        {
+        }
+
+        ~CallbackTimer()
+        {
+            stats.record(start);
+        }
+
+        CallbackTimer(const CallbackTimer &) = delete;
+        CallbackTimer &operator=(const CallbackTimer &) = delete;
+};
+
+// Health of a node, published through diagnostic_updater on /diagnostics as "<node>: health"
+// every period, e.g.
+//
+//     ros2 topic echo /diagnostics
+//
+// For each named callback it reports the rate it ran at, the p50, p99 and max of how long it
+// took, the messages it dropped and the deepest its queue was since the last report; the CPU
+// each registered thread and the whole process used; and WARN while messages are being dropped.
+// Callbacks are recorded by index, in the order their names were given. A node has at most one,
+// since the updater declares the node's diagnostic_updater.period parameter; more tasks can be
+// added to updater().
+class NodeHealth
+{
+    private:
+        struct Thread
+        {
+            std::string name;
+            pid_t tid;
+            int64_t cpu_ns;
+        };
+
+        std::vector<std::string> callback_names;
+        std::unique_ptr<CallbackStats[]> callbacks;
+        std::mutex threads_mutex;
+        std::vector<Thread> threads;
+        int64_t process_cpu_ns;
+        std::chrono::steady_clock::time_point last_report;
+        diagnostic_updater::Updater status_updater;
+
+        // CPU time of a thread of this process, from /proc since a thread's CPU clock cannot be read
+        // from another thread once it may have exited. -1 once it has.
+        static int64_t thread_cpu_ns(pid_t tid)
+        {
+            char path[64];
+            std::snprintf(path, sizeof(path), "/proc/self/task/%d/stat", static_cast<int>(tid));
+            std::FILE *file = std::fopen(path, "r");
+            if (file == nullptr)
+                return -1;
+
+            char text[1024];
+            std::size_t length = std::fread(text, 1, sizeof(text) - 1, file);
+            std::fclose(file);
+            text[length] = '\0';
+
+            // utime and stime are the 12th and 13th fields after the command, which may hold spaces.
+            const char *fields = std::strrchr(text, ')');
+            unsigned long long user_ticks, system_ticks;
+            if (fields == nullptr ||
+                std::sscanf(fields + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu", &user_ticks, &system_ticks) != 2)
+                return -1;
+
+            return static_cast<int64_t>((user_ticks + system_ticks) * (1000000000.0 / sysconf(_SC_CLK_TCK)));
+        }
+
+        static int64_t process_cpu_now_ns()
+        {
+            timespec cpu;
+            clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu);
+            return static_cast<int64_t>(cpu.tv_sec) * 1000000000LL + cpu.tv_nsec;
+        }
+
+        void report(diagnostic_updater::DiagnosticStatusWrapper &status)
+        {
+            auto now = std::chrono::steady_clock::now();
+            double seconds = std::chrono::duration<double>(now - last_report).count();
+            last_report = now;
+            if (seconds <= 0.0)
+                seconds = 1.0;
+
+            uint64_t total_dropped = 0;
+            for (std::size_t i = 0; i < callback_names.size(); i++)
+            {
+                CallbackStats &stats = callbacks[i];
+                const std::string &callback = callback_names[i];
+                LatencySummary durations = stats.take_durations();
+                uint64_t dropped = stats.take_dropped();
+                total_dropped += dropped;
+
+                status.addf(callback + " rate (Hz)", "%.3f", durations.count / seconds);
+                status.addf(callback + " p50 (ms)", "%.3f", durations.p50 / 1000.0);
+                status.addf(callback + " p99 (ms)", "%.3f", durations.p99 / 1000.0);
+                status.addf(callback + " max (ms)", "%.3f", durations.max / 1000.0);
+                status.addf(callback + " dropped", "%llu", static_cast<unsigned long long>(dropped));
+                status.addf(callback + " max queue depth", "%llu", static_cast<unsigned long long>(stats.take_max_queue_depth()));
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(threads_mutex);
+                for (auto thread = threads.begin(); thread != threads.end();)
+                {
+                    int64_t cpu_ns = thread_cpu_ns(thread->tid);
+                    if (cpu_ns < 0)
+                    {
+                        thread = threads.erase(thread);
+                        continue;
+                    }
+
+                    status.addf(thread->name + " thread CPU (%)", "%.1f", 100.0 * (cpu_ns - thread->cpu_ns) / (seconds * 1e9));
+                    thread->cpu_ns = cpu_ns;
+                    ++thread;
+                }
+            }
+
+            int64_t process_cpu = process_cpu_now_ns();
+            status.addf("process CPU (%)", "%.1f", 100.0 * (process_cpu - process_cpu_ns) / (seconds * 1e9));
+            process_cpu_ns = process_cpu;
+
+            if (total_dropped > 0)
+                status.summaryf(diagnostic_msgs::msg::DiagnosticStatus::WARN, "%llu message(s) dropped", static_cast<unsigned long long>(total_dropped));
+            else
+                status.summary(diagnostic_msgs::msg::DiagnosticStatus::OK, "OK");
+        }
+
+    public:
+        NodeHealth(rclcpp::Node *node, std::vector<std::string> callbacks, double period_s = 1.0)
+        : callback_names(std::move(callbacks)), callbacks(new CallbackStats[callback_names.size()]),
+          process_cpu_ns(process_cpu_now_ns()), last_report(std::chrono::steady_clock::now()),
+          status_updater(node, period_s)
+        {
+            status_updater.setHardwareID("none");
+            status_updater.add("health", this, &NodeHealth::report);
+        }
+
+        NodeHealth(const NodeHealth &) = delete;
+        NodeHealth &operator=(const NodeHealth &) = delete;
+
+        CallbackStats &callback(std::size_t index) { return callbacks[index]; }
+
+        // Reports the CPU use of the calling thread under name, until it exits. Safe to call from
+        // any thread, e.g. first thing in a thread the node starts.
+        void add_current_thread(const std::string &name)
+        {
+            pid_t tid = static_cast<pid_t>(syscall(SYS_gettid));
+            std::lock_guard<std::mutex> lock(threads_mutex);
+            threads.push_back(Thread{name, tid, thread_cpu_ns(tid)});
+        }
+
+        diagnostic_updater::Updater &updater() { return status_updater; }
+};
+
+}  // namespace instrumentation
+
+#endif  // INSTRUMENTATION__NODE_HEALTH_HPP_
@@ -35,93 +35,179 @@
 #include <linux/input.h>
 #include <linux/joystick.h>
 #include <math.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/ioctl.h>
 #include <sys/stat.h>
+#include <sys/timerfd.h>
 #include <unistd.h>
 
-// #include <diagnostic_updater/diagnostic_updater.hpp>
+#include <instrumentation/node_health.hpp>
 #include <rclcpp/rclcpp.hpp>
+#include <rclcpp_components/register_node_macro.hpp>
 #include <sensor_msgs/msg/joy.hpp>
 #include <sensor_msgs/msg/joy_feedback_array.hpp>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <chrono>
 #include <functional>
-#include <future>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
+
+namespace manual_control
+{
+
+namespace
+{
+
+const char INPUT_DIR[] = "/dev/input";  // no trailing / here
+
+const int BITS_PER_WORD = 8 * sizeof(unsigned long);
+
+bool test_bit(const std::vector<unsigned long> & bits, int bit)
+{
+  return (bits[bit / BITS_PER_WORD] >> (bit % BITS_PER_WORD)) & 1UL;
+}
+
+/// \brief Reads the evdev bitmask of event type (0 for the supported types) up to max.
+std::vector<unsigned long> get_event_bits(int fd, int type, int max)
+{
+  std::vector<unsigned long> bits(max / BITS_PER_WORD + 1, 0);
+  if (ioctl(fd, EVIOCGBIT(type, bits.size() * sizeof(unsigned long)), bits.data()) < 0) {
+    std::fill(bits.begin(), bits.end(), 0);
+  }
+  return bits;
+}
+
+}  // namespace
 
 /// \brief Opens, reads from and publishes joystick events
-class Joystick
+///
+/// A component, so that it can share a process with manual_control and navigation and the stop
+/// button reaches cmd_vel without going through DDS. Each Joy is stamped with the time of the
+/// input it carries, the kernel's timestamp on evdev, so the delay to cmd_vel can be measured.
+///
+/// The device is read on its own thread, which sleeps in epoll until the device, a timer, new
+/// force feedback or a change in /dev/input needs it, so an event is published as soon as it is
+/// read rather than on the next turn of a polling loop. By default the evdev interface is read:
+/// it delivers each update of the controller as one report, so a report is published whole and
+/// coalesce_interval only limits the rate at which axis-only reports are published. Button
+/// changes, such as the stop button, are never held back. Reading event devices needs permissions
+/// joystick devices do not, see the evdev parameter.
+class JoyLinux : public rclcpp::Node
 {
 private:
-  bool open_;
+  std::atomic<bool> open_;  // also read by the diagnostics
   bool sticky_buttons_;
   bool default_trig_val_;
+  bool use_evdev_;
   std::string joy_dev_;
   std::string joy_dev_name_;
   std::string joy_dev_ff_;
+  std::string open_error_;  // why open_device() last failed
   double deadzone_;
   double autorepeat_rate_;    // in Hz.  0 for no repeat.
   double coalesce_interval_;  // Defaults to 100 Hz rate limit.
-  int event_count_;
-  int pub_count_;
+  std::atomic<int> event_count_;
+  std::atomic<int> pub_count_;
   rclcpp::Publisher<sensor_msgs::msg::Joy>::SharedPtr pub_;
-  rclcpp::Node::SharedPtr node_;
+  rclcpp::Subscription<sensor_msgs::msg::JoyFeedbackArray>::SharedPtr feedback_sub_;
   double lastDiagTime_;
 
   int ff_fd_;
   struct ff_effect joy_effect_;
   bool update_feedback_;
+  std::mutex feedback_mutex_;
+
+  // Everything below belongs to the reader thread.
+  std::thread reader_;
+  std::atomic<bool> running_;
+  int joy_fd_;
+  int epoll_fd_;
+  int wake_fd_;
+  int timer_fd_;
+  int inotify_fd_;
+
+  double scale_;
+  double unscaled_deadzone_;
+  std::chrono::nanoseconds coalesce_period_;
+  std::chrono::nanoseconds autorepeat_period_;
+  std::chrono::steady_clock::time_point last_publish_;
+  bool publication_pending_;
+  int64_t input_ns_;  // when the oldest input not yet published arrived, 0 if there is none
+
+  sensor_msgs::msg::Joy joy_msg_;
+  std::vector<int> pressed_;  // raw button states, which differ from joy_msg_ with sticky buttons
+
+  // evdev key and axis codes to button and axis numbers, -1 for codes the device lacks.
+  std::vector<int> button_map_;
+  std::vector<int> axis_map_;
+  std::vector<struct input_absinfo> axis_info_;  // by axis number
+  bool buttons_changed_;
+  bool axes_changed_;
+  bool syn_dropped_;
+
+  // What the node's health is recorded under, see instrumentation/node_health.hpp.
+  enum HealthCallback
+  {
+    PUBLISH_CALLBACK = 0,
+    FEEDBACK_CALLBACK
+  };
+  std::unique_ptr<instrumentation::NodeHealth> health_;
 
-  // std::shared_ptr<diagnostic_updater::Updater> diagnostic_;
-
-  // /\brief Publishes diagnostics and status
-  // void diagnostics(diagnostic_updater::DiagnosticStatusWrapper & stat)
-  // {
-  //   double now = node_->now().seconds();
-  //   double interval = now - lastDiagTime_;
-  //   if (open_) {
-  //     stat.summary(0, "OK");
-  //   } else {
-  //     stat.summary(2, "Joystick not open.");
-  //   }
-
-  //   stat.add("topic", pub_->get_topic_name());
-  //   stat.add("device", joy_dev_);
-  //   stat.add("device name", joy_dev_name_);
-  //   stat.add("dead zone", deadzone_);
-  //   stat.add("autorepeat rate (Hz)", autorepeat_rate_);
-  //   stat.add("coalesce interval (s)", coalesce_interval_);
-  //   stat.add("recent joystick event rate (Hz)", event_count_ / interval);
-  //   stat.add("recent publication rate (Hz)", pub_count_ / interval);
-  //   stat.add("subscribers", pub_->get_subscription_count());
-  //   stat.add("default trig val", default_trig_val_);
-  //   stat.add("sticky buttons", sticky_buttons_);
-  //   event_count_ = 0;
-  //   pub_count_ = 0;
-  //   lastDiagTime_ = now;
-  // }
+  /// \brief Publishes diagnostics and status
+  void diagnostics(diagnostic_updater::DiagnosticStatusWrapper & stat)
+  {
+    double now = this->now().seconds();
+    double interval = now - lastDiagTime_;
+    if (open_) {
+      stat.summary(0, "OK");
+    } else {
+      stat.summary(2, "Joystick not open.");
+    }
+
+    stat.add("topic", pub_->get_topic_name());
+    stat.add("device", joy_dev_);
+    stat.add("device name", joy_dev_name_);
+    stat.add("dead zone", deadzone_);
+    stat.add("autorepeat rate (Hz)", autorepeat_rate_);
+    stat.add("coalesce interval (s)", coalesce_interval_);
+    stat.add("recent joystick event rate (Hz)", event_count_.exchange(0) / interval);
+    stat.add("recent publication rate (Hz)", pub_count_.exchange(0) / interval);
+    stat.add("subscribers", pub_->get_subscription_count());
+    stat.add("default trig val", default_trig_val_);
+    stat.add("sticky buttons", sticky_buttons_);
+    lastDiagTime_ = now;
+  }
 
   /*! \brief Returns the device path of the first joystick that matches joy_name.
    *         If no match is found, an empty string is returned.
    */
   std::string get_dev_by_joy_name(const std::string & joy_name, rclcpp::Logger logger)
   {
-    const char path[] = "/dev/input";  // no trailing / here
     struct dirent * entry;
     struct stat stat_buf;
 
-    DIR * dev_dir = opendir(path);
+    DIR * dev_dir = opendir(INPUT_DIR);
     if (dev_dir == nullptr) {
-      RCLCPP_ERROR(logger, "Couldn't open %s. Error %i: %s.", path, errno, strerror(errno));
+      RCLCPP_ERROR(logger, "Couldn't open %s. Error %i: %s.", INPUT_DIR, errno, strerror(errno));
       return "";
     }
 
+    // Joysticks are js*, their evdev nodes event*.
+    const char * prefix = use_evdev_ ? "event" : "js";
     while ((entry = readdir(dev_dir)) != nullptr) {
       // filter entries
-      if (strncmp(entry->d_name, "js", 2) != 0) {  // skip device if it's not a joystick
+      if (strncmp(entry->d_name, prefix, strlen(prefix)) != 0) {  // skip device if it's not a joystick
         continue;
       }
-      std::string current_path = std::string(path) + "/" + entry->d_name;
+      std::string current_path = std::string(INPUT_DIR) + "/" + entry->d_name;
       if (stat(current_path.c_str(), &stat_buf) == -1) {
         continue;
       }
@@ -130,19 +216,24 @@ private:
       }
 
       // get joystick name
-      int joy_fd = open(current_path.c_str(), O_RDONLY);
+      int joy_fd = open(current_path.c_str(), O_RDONLY | O_CLOEXEC);
       if (joy_fd == -1) {
         continue;
       }
 
       char current_joy_name[128];
-      if (ioctl(joy_fd, JSIOCGNAME(sizeof(current_joy_name)), current_joy_name) < 0) {
+      int length = use_evdev_ ?
+        ioctl(joy_fd, EVIOCGNAME(sizeof(current_joy_name)), current_joy_name) :
+        ioctl(joy_fd, JSIOCGNAME(sizeof(current_joy_name)), current_joy_name);
+      if (length < 0) {
         strncpy(current_joy_name, "Unknown", sizeof(current_joy_name));
       }
+      current_joy_name[sizeof(current_joy_name) - 1] = '\0';
 
       close(joy_fd);
 
-      RCLCPP_INFO(logger, "Found joystick: %s (%s).", current_joy_name, current_path.c_str());
+      // Called on every change in /dev/input while the joystick is away, so kept out of the log.
+      RCLCPP_DEBUG(logger, "Found joystick: %s (%s).", current_joy_name, current_path.c_str());
 
       if (strcmp(current_joy_name, joy_name.c_str()) == 0) {
         closedir(dev_dir);
@@ -154,13 +245,608 @@ private:
     return "";
   }
 
-public:
-  Joystick()
-  : ff_fd_(-1)
-  {}
+  /*! \brief Returns the evdev node of the same device as the joystick device js_path, e.g.
+   *         /dev/input/event5 for /dev/input/js0, or an empty string if there is none.
+   */
+  std::string get_event_dev_of(const std::string & js_path)
+  {
+    std::string name = js_path.substr(js_path.find_last_of('/') + 1);
+    std::string device_dir = "/sys/class/input/" + name + "/device";
+
+    DIR * dir = opendir(device_dir.c_str());
+    if (dir == nullptr) {
+      return "";
+    }
+
+    std::string event_path;
+    struct dirent * entry;
+    while ((entry = readdir(dir)) != nullptr) {
+      if (strncmp(entry->d_name, "event", 5) == 0) {
+        event_path = std::string(INPUT_DIR) + "/" + entry->d_name;
+        break;
+      }
+    }
+
+    closedir(dir);
+    return event_path;
+  }
+
+  /// \brief Path of the device to open now; devices are renumbered when they are plugged in again.
+  std::string device_path()
+  {
+    if (!joy_dev_name_.empty()) {
+      std::string joy_dev_path = get_dev_by_joy_name(joy_dev_name_, get_logger());
+      if (!joy_dev_path.empty()) {
+        return joy_dev_path;
+      }
+    }
+
+    if (use_evdev_ && joy_dev_.find("/event") == std::string::npos) {
+      std::string event_path = get_event_dev_of(joy_dev_);
+      if (event_path.empty()) {
+        open_error_ = "no event device belongs to " + joy_dev_;
+      }
+      return event_path;
+    }
+    return joy_dev_;
+  }
+
+  /// \brief Says why path could not be opened, from errno.
+  std::string describe_open_error(const std::string & path) const
+  {
+    int error_number = errno;
+    std::string error = path + ": error " + std::to_string(error_number) + ", " + strerror(error_number);
+    if (error_number == EACCES && use_evdev_) {
+      // Joystick nodes are usually readable by everyone, event nodes only by root and input.
+      error +=
+        " (add the user to the input group, install "
+        "share/manual_control/udev/99-joystick-evdev.rules or set evdev to false)";
+    }
+    return error;
+  }
+
+  bool open_device()
+  {
+    std::string path = device_path();
+    if (path.empty()) {
+      return false;
+    }
+
+    joy_msg_ = sensor_msgs::msg::Joy();
+    joy_msg_.header.frame_id = "joy";
+    pressed_.clear();
+
+    if (use_evdev_) {
+      joy_fd_ = open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+      if (joy_fd_ == -1) {
+        open_error_ = describe_open_error(path);
+        return false;
+      }
+      if (!map_evdev_controls()) {
+        open_error_ = path + " has no buttons or axes";
+        close(joy_fd_);
+        joy_fd_ = -1;
+        return false;
+      }
+      // The evdev node carries force feedback itself.
+      open_feedback(path);
+    } else {
+      joy_fd_ = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+      if (joy_fd_ != -1) {
+        // There seems to be a bug in the driver or something where the
+        // initial events that are to define the initial state of the
+        // joystick are not the values of the joystick when it was opened
+        // but rather the values of the joystick when it was last closed.
+        // Opening then closing and opening again is a hack to get more
+        // accurate initial state data.
+        close(joy_fd_);
+        joy_fd_ = open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+      }
+      if (joy_fd_ == -1) {
+        open_error_ = describe_open_error(path);
+        return false;
+      }
+      if (!joy_dev_ff_.empty()) {
+        open_feedback(joy_dev_ff_);
+      }
+    }
+
+    struct epoll_event event {};
+    event.events = EPOLLIN;
+    event.data.fd = joy_fd_;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, joy_fd_, &event);
+
+    RCLCPP_INFO(get_logger(), "Opened joystick: %s. deadzone_: %f.", path.c_str(), deadzone_);
+    open_ = true;
+
+    if (use_evdev_) {
+      // evdev reports no initial state, so it is read and published in one go.
+      resync_evdev(true);
+      publish();
+    }
+    return true;
+  }
+
+  void close_device()
+  {
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, joy_fd_, nullptr);
+    close(joy_fd_);
+    joy_fd_ = -1;
+
+    std::lock_guard<std::mutex> lock(feedback_mutex_);
+    if (ff_fd_ != -1) {
+      close(ff_fd_);
+      ff_fd_ = -1;
+    }
+
+    arm_timer(std::chrono::nanoseconds(0));
+    publication_pending_ = false;
+    input_ns_ = 0;
+    open_ = false;
+  }
+
+  void open_feedback(const std::string & path)
+  {
+    std::lock_guard<std::mutex> lock(feedback_mutex_);
+    ff_fd_ = open(path.c_str(), O_RDWR | O_CLOEXEC);
+    if (ff_fd_ == -1) {
+      return;
+    }
+
+    /* Set the gain of the device*/
+    int gain = 100;           /* between 0 and 100 */
+    struct input_event ie;      /* structure used to communicate with the driver */
 
+    ie.type = EV_FF;
+    ie.code = FF_GAIN;
+    ie.value = 0xFFFFUL * gain / 100;
+
+    if (write(ff_fd_, &ie, sizeof(ie)) == -1) {
+      RCLCPP_WARN(
+        get_logger(), "Couldn't open joystick force feedback: %s", strerror(errno));
+    }
+
+    joy_effect_.id = -1;
+    joy_effect_.direction = 0;  // down
+    joy_effect_.type = FF_RUMBLE;
+    joy_effect_.u.rumble.strong_magnitude = 0;
+    joy_effect_.u.rumble.weak_magnitude = 0;
+    joy_effect_.replay.length = 1000;
+    joy_effect_.replay.delay = 0;
+
+    // upload the effect
+    // FIXME: check the return value here
+    ioctl(ff_fd_, EVIOCSFF, &joy_effect_);
+  }
+
+  /// \brief Uploads and plays the effect set_feedback() last set.
+  void play_feedback()
+  {
+    std::lock_guard<std::mutex> lock(feedback_mutex_);
+    if (ff_fd_ == -1 || !update_feedback_) {
+      return;
+    }
+
+    // FIXME: check the return value here.
+    ioctl(ff_fd_, EVIOCSFF, &joy_effect_);
+    update_feedback_ = false;
+
+    struct input_event start;
+    start.type = EV_FF;
+    start.code = joy_effect_.id;
+    start.value = 3;
+    if (write(ff_fd_, (const void *) &start, sizeof(start)) == -1) {
+      RCLCPP_WARN(get_logger(), "Couldn't play joystick force feedback: %s", strerror(errno));
+    }
+  }
+
+  /*! \brief Numbers the buttons and axes of the evdev device as the joystick driver numbers them,
+   *         so that both interfaces publish the same layout. Returns false if it has neither.
+   */
+  bool map_evdev_controls()
+  {
+    std::vector<unsigned long> keys = get_event_bits(joy_fd_, EV_KEY, KEY_MAX);
+    std::vector<unsigned long> abs = get_event_bits(joy_fd_, EV_ABS, ABS_MAX);
+
+    // Joystick buttons come first, then the remaining BTN_MISC range.
+    button_map_.assign(KEY_MAX + 1, -1);
+    int buttons = 0;
+    for (int code = BTN_JOYSTICK; code <= KEY_MAX; code++) {
+      if (test_bit(keys, code)) {
+        button_map_[code] = buttons++;
+      }
+    }
+    for (int code = BTN_MISC; code < BTN_JOYSTICK; code++) {
+      if (test_bit(keys, code)) {
+        button_map_[code] = buttons++;
+      }
+    }
+
+    axis_map_.assign(ABS_MAX + 1, -1);
+    axis_info_.clear();
+    for (int code = 0; code <= ABS_MAX; code++) {
+      if (test_bit(abs, code)) {
+        axis_map_[code] = axis_info_.size();
+        axis_info_.push_back(input_absinfo());
+      }
+    }
+
+    joy_msg_.buttons.assign(buttons, 0);
+    joy_msg_.axes.assign(axis_info_.size(), 0.0);
+    pressed_.assign(buttons, 0);
+    buttons_changed_ = false;
+    axes_changed_ = false;
+    syn_dropped_ = false;
+    return buttons > 0 || !axis_info_.empty();
+  }
+
+  /*! \brief Reads the whole state of the evdev device, as on opening it or after the kernel
+   *         dropped events. Axes are left at rest on opening unless default_trig_val is set, as
+   *         the joystick interface does. Returns whether a button changed.
+   */
+  bool resync_evdev(bool opening)
+  {
+    std::vector<unsigned long> keys((KEY_MAX / BITS_PER_WORD) + 1, 0);
+    ioctl(joy_fd_, EVIOCGKEY(keys.size() * sizeof(unsigned long)), keys.data());
+
+    bool buttons_changed = false;
+    for (int code = 0; code <= KEY_MAX; code++) {
+      if (button_map_[code] != -1) {
+        buttons_changed |= set_button(button_map_[code], test_bit(keys, code));
+      }
+    }
+
+    for (int code = 0; code <= ABS_MAX; code++) {
+      int axis = axis_map_[code];
+      if (axis == -1 || ioctl(joy_fd_, EVIOCGABS(code), &axis_info_[axis]) < 0) {
+        continue;
+      }
+      if (!opening || default_trig_val_) {
+        set_axis(axis, normalise_axis(axis, axis_info_[axis].value));
+      }
+    }
+
+    return buttons_changed;
+  }
+
+  /// \brief Scales an evdev axis value to the joystick interface's [-32767, 32767].
+  double normalise_axis(int axis, int value)
+  {
+    const struct input_absinfo & info = axis_info_[axis];
+    double half_range = (static_cast<double>(info.maximum) - info.minimum) / 2;
+    if (half_range <= 0) {
+      return 0;
+    }
+
+    double centre = (static_cast<double>(info.maximum) + info.minimum) / 2;
+    return std::max(-32767., std::min(32767., (value - centre) * 32767. / half_range));
+  }
+
+  /// \brief Records a button press or release; returns whether the button changed.
+  bool set_button(size_t number, int value)
+  {
+    if (number >= pressed_.size()) {
+      pressed_.resize(number + 1, 0);
+      joy_msg_.buttons.resize(number + 1, 0);
+    }
+
+    value = value ? 1 : 0;
+    if (pressed_[number] == value) {
+      return false;
+    }
+    pressed_[number] = value;
+
+    if (sticky_buttons_) {
+      if (value == 1) {
+        joy_msg_.buttons[number] = 1 - joy_msg_.buttons[number];
+      }
+    } else {
+      joy_msg_.buttons[number] = value;
+    }
+    return true;
+  }
+
+  /// \brief Records an axis position in [-32767, 32767], applying the dead zone.
+  bool set_axis(size_t number, double val)
+  {
+    if (number >= joy_msg_.axes.size()) {
+      joy_msg_.axes.resize(number + 1, 0.0);
+    }
+
+    // Allows deadzone to be "smooth"
+    if (val > unscaled_deadzone_) {
+      val -= unscaled_deadzone_;
+    } else if (val < -unscaled_deadzone_) {
+      val += unscaled_deadzone_;
+    } else {
+      val = 0;
+    }
+
+    float axis = val * scale_;
+    if (joy_msg_.axes[number] == axis) {
+      return false;
+    }
+    joy_msg_.axes[number] = axis;
+    return true;
+  }
+
+  /// \brief Reads what is waiting on the evdev device; returns false if it is gone.
+  bool read_evdev()
+  {
+    std::array<struct input_event, 64> events;
+    while (true) {
+      ssize_t length = read(joy_fd_, events.data(), sizeof(events));
+      if (length == -1 && errno == EINTR) {
+        continue;
+      }
+      if (length == -1 && errno == EAGAIN) {
+        return true;
+      }
+      if (length <= 0) {
+        return false;
+      }
+
+      size_t count = length / sizeof(struct input_event);
+      for (size_t i = 0; i < count; i++) {
+        const struct input_event & event = events[i];
+        event_count_++;
+
+        // After the kernel dropped events everything up to the next report is stale.
+        if (syn_dropped_) {
+          if (event.type == EV_SYN && event.code == SYN_REPORT) {
+            syn_dropped_ = false;
+            note_input(now().nanoseconds());
+            buttons_changed_ |= resync_evdev(false);
+            axes_changed_ = true;
+            end_report();
+          }
+          continue;
+        }
+
+        switch (event.type) {
+          case EV_KEY:
+            // 2 is the keyboard autorepeat of a held key, which is not a change.
+            if (event.code <= KEY_MAX && button_map_[event.code] != -1 && event.value != 2) {
+              buttons_changed_ |= set_button(button_map_[event.code], event.value);
+            }
+            break;
+          case EV_ABS:
+            if (event.code <= ABS_MAX && axis_map_[event.code] != -1) {
+              int axis = axis_map_[event.code];
+              axes_changed_ |= set_axis(axis, normalise_axis(axis, event.value));
+            }
+            break;
+          case EV_SYN:
+            if (event.code == SYN_REPORT) {
+              // evdev stamps with CLOCK_REALTIME, the clock of ROS time.
+              note_input(
+                static_cast<int64_t>(event.input_event_sec) * 1000000000 +
+                static_cast<int64_t>(event.input_event_usec) * 1000);
+              end_report();
+            } else if (event.code == SYN_DROPPED) {
+              syn_dropped_ = true;
+            }
+            break;
+          default:
+            break;
+        }
+      }
+    }
+  }
+
+  /// \brief A button change is published at once; axis motion is rate limited.
+  void end_report()
+  {
+    if (buttons_changed_) {
+      publish();
+    } else if (axes_changed_) {
+      request_publish();
+    }
+    buttons_changed_ = false;
+    axes_changed_ = false;
+  }
+
+  /// \brief Reads what is waiting on the joystick device; returns false if it is gone.
+  bool read_joystick()
+  {
+    std::array<js_event, 64> events;
+    bool publish_now = false;
+    while (true) {
+      ssize_t length = read(joy_fd_, events.data(), sizeof(events));
+      if (length == -1 && errno == EINTR) {
+        continue;
+      }
+      if (length == -1 && errno == EAGAIN) {
+        break;
+      }
+      if (length <= 0) {
+        return false;  // Joystick is probably closed. Definitely occurs.
+      }
+
+      // The joystick interface's timestamps are in milliseconds from an arbitrary point.
+      note_input(now().nanoseconds());
+      size_t count = length / sizeof(js_event);
+      for (size_t i = 0; i < count; i++) {
+        const js_event & event = events[i];
+        event_count_++;
+        switch (event.type) {
+          case JS_EVENT_BUTTON:
+          case JS_EVENT_BUTTON | JS_EVENT_INIT:
+            if (set_button(event.number, event.value)) {
+              // For initial events, wait a bit before sending to try to catch
+              // all the initial events.
+              if (!(event.type & JS_EVENT_INIT)) {
+                publish_now = true;
+              } else {
+                request_publish();
+              }
+            }
+            break;
+          case JS_EVENT_AXIS:
+          case JS_EVENT_AXIS | JS_EVENT_INIT:
+            if (event.number >= joy_msg_.axes.size()) {
+              joy_msg_.axes.resize(event.number + 1, 0.0);
+            }
+            if (default_trig_val_ || !(event.type & JS_EVENT_INIT)) {
+              set_axis(event.number, event.value);
+            }
+            // Will wait a bit before sending to try to combine events.
+            request_publish();
+            break;
+          default:
+            RCLCPP_WARN(
+              get_logger(), "joy_linux_node: Unknown event type. "
+              "Please file a ticket. time=%u, value=%d, type=%Xh, number=%d",
+              event.time, event.value, event.type, event.number);
+            break;
+        }
+      }
+    }
+
+    if (publish_now) {
+      publish();
+    }
+    return true;
+  }
+
+  /// \brief Remembers when input arrived, if it is the oldest not yet published.
+  void note_input(int64_t stamp_ns)
+  {
+    if (input_ns_ == 0) {
+      input_ns_ = stamp_ns;
+    }
+  }
+
+  void publish()
+  {
+    instrumentation::CallbackTimer health_timer(health_->callback(PUBLISH_CALLBACK));
+    // Stamped with when its input arrived; an autorepeat carries none, so it is stamped now.
+    joy_msg_.header.stamp = input_ns_ != 0 ? rclcpp::Time(input_ns_) : now();
+    input_ns_ = 0;
+    pub_->publish(joy_msg_);
+    pub_count_++;
+
+    last_publish_ = std::chrono::steady_clock::now();
+    publication_pending_ = false;
+    // If nothing is going on, start a timer to do autorepeat.
+    arm_timer(autorepeat_period_);
+  }
+
+  /*! \brief Publishes soon. A joystick interface update arrives an event at a time, so it is
+   *         held back for coalesce_interval to combine events. An evdev report is already
+   *         whole and is only held back if the last publication was less than that ago.
+   */
+  void request_publish()
+  {
+    if (publication_pending_) {
+      return;
+    }
+
+    std::chrono::nanoseconds delay = coalesce_period_;
+    if (use_evdev_) {
+      auto since = std::chrono::steady_clock::now() - last_publish_;
+      if (since >= coalesce_period_) {
+        publish();
+        return;
+      }
+      delay = coalesce_period_ - since;
+    }
+
+    publication_pending_ = true;
+    arm_timer(delay);
+  }
+
+  /// \brief Arms the one-shot timer to expire after delay; 0 disarms it.
+  void arm_timer(std::chrono::nanoseconds delay)
+  {
+    struct itimerspec spec {};
+    spec.it_value.tv_sec = delay.count() / 1000000000;
+    spec.it_value.tv_nsec = delay.count() % 1000000000;
+    timerfd_settime(timer_fd_, 0, &spec, nullptr);
+  }
+
+  void drain(int fd)
+  {
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    while (read(fd, buffer, sizeof(buffer)) > 0) {
+    }
+  }
+
+  void wake()
+  {
+    uint64_t one = 1;
+    ssize_t written = write(wake_fd_, &one, sizeof(one));
+    (void)written;
+  }
+
+  void watch(int fd)
+  {
+    struct epoll_event event {};
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event);
+  }
+
+  /// \brief Opens the device when it appears and publishes its events until shutdown.
+  void read_loop()
+  {
+    health_->add_current_thread("reader");
+    std::array<struct epoll_event, 8> events;
+    // Each reason is only logged once, until the device has been opened again.
+    std::string logged_error;
+    while (running_) {
+      if (joy_fd_ == -1) {
+        if (open_device()) {
+          logged_error.clear();
+        } else if (open_error_ != logged_error) {
+          RCLCPP_ERROR(
+            get_logger(), "Couldn't open joystick %s. Will retry %s.", open_error_.c_str(),
+            inotify_fd_ != -1 ? "when an input device appears" : "every second");
+          logged_error = open_error_;
+        }
+      }
+
+      // Without inotify the only way to notice the joystick coming back is to look again.
+      int timeout = joy_fd_ == -1 && inotify_fd_ == -1 ? 1000 : -1;
+      int count = epoll_wait(epoll_fd_, events.data(), events.size(), timeout);
+      for (int i = 0; i < count; i++) {
+        int fd = events[i].data.fd;
+        if (fd == joy_fd_) {
+          bool alive = !(events[i].events & (EPOLLERR | EPOLLHUP));
+          alive = alive && (use_evdev_ ? read_evdev() : read_joystick());
+          if (!alive) {
+            close_device();
+            if (running_) {
+              RCLCPP_ERROR(
+                get_logger(), "Connection to joystick device lost unexpectedly. Will reopen.");
+            }
+          }
+        } else if (fd == timer_fd_) {
+          drain(timer_fd_);
+          // Either the coalesce interval or the autorepeat interval is up.
+          if (joy_fd_ != -1) {
+            publish();
+          }
+        } else if (fd == wake_fd_) {
+          drain(wake_fd_);
+          play_feedback();
+        } else if (fd == inotify_fd_) {
+          // Only looked at while the joystick is away, at the top of the loop.
+          drain(inotify_fd_);
+        }
+      }
+    }
+
+    if (joy_fd_ != -1) {
+      close_device();
+    }
+  }
+
+public:
   void set_feedback(const std::shared_ptr<sensor_msgs::msg::JoyFeedbackArray> msg)
   {
+    instrumentation::CallbackTimer health_timer(health_->callback(FEEDBACK_CALLBACK));
+    std::lock_guard<std::mutex> lock(feedback_mutex_);
     if (ff_fd_ == -1) {
       return;  // we arent ready yet
     }
@@ -186,61 +872,62 @@ public:
         update_feedback_ = true;
       }
     }
+
+    // The reader thread owns the device.
+    if (update_feedback_) {
+      wake();
+    }
   }
 
-  /// \brief Opens joystick port, reads from port and publishes while node_ is active
-  int main(int argc, char ** argv)
+  /// \brief Opens joystick port, reads from port and publishes until destroyed
+  explicit JoyLinux(const rclcpp::NodeOptions & options = rclcpp::NodeOptions())
+  : Node("joy_node", options), ff_fd_(-1), update_feedback_(false), running_(true), joy_fd_(-1),
+    epoll_fd_(-1), wake_fd_(-1), timer_fd_(-1), inotify_fd_(-1), publication_pending_(false),
+    input_ns_(0)
   {
-    (void)argc;
-    (void)argv;
-
-    node_ = std::make_shared<rclcpp::Node>("joy_node");
-
-    // diagnostic_ = std::make_shared<diagnostic_updater::Updater>(node_);
-    // diagnostic_->add("Joystick Driver Status", this, &Joystick::diagnostics);
-    // diagnostic_->setHardwareID("none");
+    health_ = std::make_unique<instrumentation::NodeHealth>(
+      this, std::vector<std::string>{"publish", "set_feedback"});
+    health_->updater().add("Joystick Driver Status", this, &JoyLinux::diagnostics);
 
     // Parameters
-    pub_ = node_->create_publisher<sensor_msgs::msg::Joy>("joy", 10);
-    rclcpp::Subscription<sensor_msgs::msg::JoyFeedbackArray>::SharedPtr sub_ =
-      node_->create_subscription<sensor_msgs::msg::JoyFeedbackArray>(
+    pub_ = create_publisher<sensor_msgs::msg::Joy>("joy", 10);
+    feedback_sub_ = create_subscription<sensor_msgs::msg::JoyFeedbackArray>(
       "joy/set_feedback",
       rclcpp::QoS(10),
-      std::bind(&Joystick::set_feedback, this, std::placeholders::_1));
-
-    joy_dev_ = node_->declare_parameter("dev", std::string("/dev/input/js0"));
-    joy_dev_name_ = node_->declare_parameter("dev_name", std::string(""));
-    joy_dev_ff_ = node_->declare_parameter("dev_ff", "/dev/input/event0");
-    deadzone_ = node_->declare_parameter("deadzone", 0.05);
-    autorepeat_rate_ = node_->declare_parameter("autorepeat_rate", 20.0);
-    coalesce_interval_ = node_->declare_parameter("coalesce_interval", 0.001);
-    default_trig_val_ = node_->declare_parameter("default_trig_val", false);
-    sticky_buttons_ = node_->declare_parameter("sticky_buttons", false);
+      std::bind(&JoyLinux::set_feedback, this, std::placeholders::_1));
+
+    joy_dev_ = declare_parameter("dev", std::string("/dev/input/js0"));
+    joy_dev_name_ = declare_parameter("dev_name", std::string(""));
+    // Only used with the joystick interface; the evdev node carries force feedback itself.
+    joy_dev_ff_ = declare_parameter("dev_ff", "/dev/input/event0");
+    // Reads the device dev belongs to through evdev; false reads dev through the joystick interface.
+    // Event devices are only readable by root and the input group unless
+    // share/manual_control/udev/99-joystick-evdev.rules is installed in /etc/udev/rules.d.
+    use_evdev_ = declare_parameter("evdev", true);
+    deadzone_ = declare_parameter("deadzone", 0.05);
+    autorepeat_rate_ = declare_parameter("autorepeat_rate", 20.0);
+    coalesce_interval_ = declare_parameter("coalesce_interval", 0.001);
+    default_trig_val_ = declare_parameter("default_trig_val", false);
+    sticky_buttons_ = declare_parameter("sticky_buttons", false);
 
     // Checks on parameters
-    if (!joy_dev_name_.empty()) {
-      std::string joy_dev_path = get_dev_by_joy_name(joy_dev_name_, node_->get_logger());
-      if (joy_dev_path.empty()) {
-        RCLCPP_ERROR(
-          node_->get_logger(), "Couldn't find a joystick with name %s. "
-          "Falling back to default device.",
-          joy_dev_name_.c_str());
-      } else {
-        RCLCPP_INFO(node_->get_logger(), "Using %s as joystick device.", joy_dev_path.c_str());
-        joy_dev_ = joy_dev_path;
-      }
+    if (!joy_dev_name_.empty() && get_dev_by_joy_name(joy_dev_name_, get_logger()).empty()) {
+      RCLCPP_ERROR(
+        get_logger(), "Couldn't find a joystick with name %s. "
+        "Falling back to default device.",
+        joy_dev_name_.c_str());
     }
 
     if (autorepeat_rate_ > 1 / coalesce_interval_) {
       RCLCPP_WARN(
-        node_->get_logger(), "joy_linux_node: autorepeat_rate (%f Hz) > "
+        get_logger(), "joy_linux_node: autorepeat_rate (%f Hz) > "
         "1/coalesce_interval (%f Hz) does not make sense. Timing behavior is not well defined.",
         autorepeat_rate_, 1 / coalesce_interval_);
     }
 
     if (deadzone_ >= 1) {
       RCLCPP_WARN(
-        node_->get_logger(), "joy_linux_node: deadzone greater than 1 was requested. "
+        get_logger(), "joy_linux_node: deadzone greater than 1 was requested. "
         "The semantics of deadzone have changed. It is now related to the range [-1:1] instead "
         "of [-32767:32767]. For now I am dividing your deadzone by 32767, but this behavior is "
         "deprecated so you need to update your launch file.");
@@ -249,306 +936,82 @@ public:
 
     if (deadzone_ > 0.9) {
       RCLCPP_WARN(
-        node_->get_logger(), "joy_node: deadzone (%f) greater than 0.9, setting it to 0.9",
+        get_logger(), "joy_node: deadzone (%f) greater than 0.9, setting it to 0.9",
         deadzone_);
       deadzone_ = 0.9;
     }
 
     if (deadzone_ < 0) {
       RCLCPP_WARN(
-        node_->get_logger(), "joy_node: deadzone_ (%f) less than 0, setting to 0.", deadzone_);
+        get_logger(), "joy_node: deadzone_ (%f) less than 0, setting to 0.", deadzone_);
       deadzone_ = 0;
     }
 
     if (autorepeat_rate_ < 0) {
       RCLCPP_WARN(
-        node_->get_logger(), "joy_node: autorepeat_rate (%f) less than 0, setting to 0.",
+        get_logger(), "joy_node: autorepeat_rate (%f) less than 0, setting to 0.",
         autorepeat_rate_);
       autorepeat_rate_ = 0;
     }
 
     if (coalesce_interval_ < 0) {
       RCLCPP_WARN(
-        node_->get_logger(), "joy_node: coalesce_interval (%f) less than 0, setting to 0.",
+        get_logger(), "joy_node: coalesce_interval (%f) less than 0, setting to 0.",
         coalesce_interval_);
       coalesce_interval_ = 0;
     }
 
     // Parameter conversions
-    double autorepeat_interval = 1 / autorepeat_rate_;
-    double scale = -1. / (1. - deadzone_) / 32767.;
-    double unscaled_deadzone = 32767. * deadzone_;
-
-    js_event event;
-    struct timeval tv;
-    fd_set set;
-    int joy_fd;
+    scale_ = -1. / (1. - deadzone_) / 32767.;
+    unscaled_deadzone_ = 32767. * deadzone_;
+    coalesce_period_ = std::chrono::nanoseconds(static_cast<int64_t>(coalesce_interval_ * 1e9));
+    autorepeat_period_ = std::chrono::nanoseconds(
+      autorepeat_rate_ > 0 ? static_cast<int64_t>(1e9 / autorepeat_rate_) : 0);
 
     event_count_ = 0;
     pub_count_ = 0;
-    lastDiagTime_ = node_->now().seconds();
-
-    // Big while loop opens, publishes
-    while (rclcpp::ok()) {
-      open_ = false;
-      // diagnostic_->force_update();
-      bool first_fault = true;
-      while (true) {
-        // In the first iteration of this loop, first_fault is true so we just
-        // want to check for rclcpp work and not block.  If it turns out that
-        // we cannot open the joystick device immediately, then in subsequent
-        // iterations we block for up to a second in rclcpp before attempting
-        // to open the joystick device again.  The dummy promise and future
-        // are used to accomplish this 1 second wait.
-        std::promise<void> dummy_promise;
-        std::shared_future<void> dummy_future(dummy_promise.get_future());
-        std::chrono::duration<int64_t, std::milli> timeout;
-        if (first_fault) {
-          timeout = std::chrono::milliseconds(0);
-        } else {
-          timeout = std::chrono::milliseconds(1000);
-        }
-        rclcpp::spin_until_future_complete(node_, dummy_future, timeout);
-        if (!rclcpp::ok()) {
-          goto cleanup;
-        }
-        joy_fd = open(joy_dev_.c_str(), O_RDONLY);
-        if (joy_fd != -1) {
-          // There seems to be a bug in the driver or something where the
-          // initial events that are to define the initial state of the
-          // joystick are not the values of the joystick when it was opened
-          // but rather the values of the joystick when it was last closed.
-          // Opening then closing and opening again is a hack to get more
-          // accurate initial state data.
-          close(joy_fd);
-          joy_fd = open(joy_dev_.c_str(), O_RDONLY);
-        }
-        if (joy_fd != -1) {
-          break;
-        }
-        if (first_fault) {
-          RCLCPP_ERROR(
-            node_->get_logger(), "Couldn't open joystick %s. Will retry every second.",
-            joy_dev_.c_str());
-          first_fault = false;
-        }
-      }
-
-      if (!joy_dev_ff_.empty()) {
-        ff_fd_ = open(joy_dev_ff_.c_str(), O_RDWR);
-
-        /* Set the gain of the device*/
-        int gain = 100;           /* between 0 and 100 */
-        struct input_event ie;      /* structure used to communicate with the driver */
-
-        ie.type = EV_FF;
-        ie.code = FF_GAIN;
-        ie.value = 0xFFFFUL * gain / 100;
-
-        if (write(ff_fd_, &ie, sizeof(ie)) == -1) {
-          RCLCPP_WARN(
-            node_->get_logger(), "Couldn't open joystick force feedback: %s", strerror(errno));
-        }
-
-        joy_effect_.id = -1;
-        joy_effect_.direction = 0;  // down
-        joy_effect_.type = FF_RUMBLE;
-        joy_effect_.u.rumble.strong_magnitude = 0;
-        joy_effect_.u.rumble.weak_magnitude = 0;
-        joy_effect_.replay.length = 1000;
-        joy_effect_.replay.delay = 0;
-
-        // upload the effect
-        // FIXME: check the return value here
-        ioctl(ff_fd_, EVIOCSFF, &joy_effect_);
-      }
-
-      RCLCPP_INFO(
-        node_->get_logger(), "Opened joystick: %s. deadzone_: %f.", joy_dev_.c_str(), deadzone_);
-      open_ = true;
-      // diagnostic_->force_update();
-
-      bool tv_set = false;
-      bool publication_pending = false;
-      tv.tv_sec = 1;
-      tv.tv_usec = 0;
-
-      // Here because we want to reset it on device close.
-      auto joy_msg = std::make_shared<sensor_msgs::msg::Joy>();
-      double val;  // Temporary variable to hold event values
-      joy_msg->header.frame_id = "joy";
-
-      while (rclcpp::ok()) {
-        rclcpp::spin_some(node_);
-
-        bool publish_now = false;
-        bool publish_soon = false;
-        FD_ZERO(&set);
-        FD_SET(joy_fd, &set);
-
-        int select_out = select(joy_fd + 1, &set, nullptr, nullptr, &tv);
-        if (select_out == -1) {
-          tv.tv_sec = 0;
-          tv.tv_usec = 0;
-          continue;
-        }
-
-        // play the rumble effect (can probably do this at lower rate later)
-        if (ff_fd_ != -1) {
-          struct input_event start;
-          start.type = EV_FF;
-          start.code = joy_effect_.id;
-          start.value = 3;
-          if (write(ff_fd_, (const void *) &start, sizeof(start)) == -1) {
-            break;  // fd closed
-          }
-
-          // upload the effect
-          if (update_feedback_ == true) {
-            // FIXME: check the return value here.
-            ioctl(ff_fd_, EVIOCSFF, &joy_effect_);
-            update_feedback_ = false;
-          }
-        }
-
-        if (FD_ISSET(joy_fd, &set)) {
-          if (read(joy_fd, &event, sizeof(js_event)) == -1 && errno != EAGAIN) {
-            break;  // Joystick is probably closed. Definitely occurs.
-          }
-
-          joy_msg->header.stamp = node_->now();
-          event_count_++;
-          switch (event.type) {
-            case JS_EVENT_BUTTON:
-            case JS_EVENT_BUTTON | JS_EVENT_INIT:
-              if (event.number >= joy_msg->buttons.size()) {
-                size_t old_size = joy_msg->buttons.size();
-                joy_msg->buttons.resize(event.number + 1);
-                for (size_t i = old_size; i < joy_msg->buttons.size(); i++) {
-                  joy_msg->buttons[i] = 0.0;
-                }
-              }
-              if (sticky_buttons_) {
-                if (event.value == 1) {
-                  joy_msg->buttons[event.number] = 1 - joy_msg->buttons[event.number];
-                }
-              } else {
-                joy_msg->buttons[event.number] = (event.value ? 1 : 0);
-              }
-              // For initial events, wait a bit before sending to try to catch
-              // all the initial events.
-              if (!(event.type & JS_EVENT_INIT)) {
-                publish_now = true;
-              } else {
-                publish_soon = true;
-              }
-              break;
-            case JS_EVENT_AXIS:
-            case JS_EVENT_AXIS | JS_EVENT_INIT:
-              val = event.value;
-              if (event.number >= joy_msg->axes.size()) {
-                size_t old_size = joy_msg->axes.size();
-                joy_msg->axes.resize(event.number + 1);
-                for (size_t i = old_size; i < joy_msg->axes.size(); i++) {
-                  joy_msg->axes[i] = 0.0;
-                }
-              }
-              if (default_trig_val_) {
-                // Allows deadzone to be "smooth"
-                if (val > unscaled_deadzone) {
-                  val -= unscaled_deadzone;
-                } else if (val < -unscaled_deadzone) {
-                  val += unscaled_deadzone;
-                } else {
-                  val = 0;
-                }
-                joy_msg->axes[event.number] = val * scale;
-                // Will wait a bit before sending to try to combine events.
-                publish_soon = true;
-                break;
-              } else {
-                if (!(event.type & JS_EVENT_INIT)) {
-                  val = event.value;
-                  if (val > unscaled_deadzone) {
-                    val -= unscaled_deadzone;
-                  } else if (val < -unscaled_deadzone) {
-                    val += unscaled_deadzone;
-                  } else {
-                    val = 0;
-                  }
-                  joy_msg->axes[event.number] = val * scale;
-                }
-
-                publish_soon = true;
-                break;
-              }
-            default:
-              RCLCPP_WARN(
-                node_->get_logger(), "joy_linux_node: Unknown event type. "
-                "Please file a ticket. time=%u, value=%d, type=%Xh, number=%d",
-                event.time, event.value, event.type, event.number);
-              break;
-          }
-        } else if (tv_set) {  // Assume that the timer has expired.
-          joy_msg->header.stamp = node_->now();
-          publish_now = true;
-        }
-
-        if (publish_now) {
-          // Assume that all the JS_EVENT_INIT messages have arrived already.
-          // This should be the case as the kernel sends them along as soon as
-          // the device opens.
-          joy_msg->header.stamp = node_->now();
-          pub_->publish(*joy_msg);
-
-          publish_now = false;
-          tv_set = false;
-          publication_pending = false;
-          publish_soon = false;
-          pub_count_++;
-        }
-
-        // If an axis event occurred, start a timer to combine with other
-        // events.
-        if (!publication_pending && publish_soon) {
-          tv.tv_sec = trunc(coalesce_interval_);
-          tv.tv_usec = (coalesce_interval_ - tv.tv_sec) * 1e6;
-          publication_pending = true;
-          tv_set = true;
-        }
+    lastDiagTime_ = now().seconds();
+    open_ = false;
+
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    watch(wake_fd_);
+    watch(timer_fd_);
+
+    // Devices show up as a new node in /dev/input, then become readable once udev has set
+    // their permissions.
+    inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd_ != -1 && inotify_add_watch(inotify_fd_, INPUT_DIR, IN_CREATE | IN_ATTRIB) == -1) {
+      close(inotify_fd_);
+      inotify_fd_ = -1;
+    }
+    if (inotify_fd_ != -1) {
+      watch(inotify_fd_);
+    } else {
+      RCLCPP_WARN(get_logger(), "Couldn't watch %s: %s", INPUT_DIR, strerror(errno));
+    }
 
-        // If nothing is going on, start a timer to do autorepeat.
-        if (!tv_set && autorepeat_rate_ > 0) {
-          tv.tv_sec = trunc(autorepeat_interval);
-          tv.tv_usec = (autorepeat_interval - tv.tv_sec) * 1e6;
-          tv_set = true;
-        }
+    reader_ = std::thread(&JoyLinux::read_loop, this);
+  }
 
-        if (!tv_set) {
-          tv.tv_sec = 1;
-          tv.tv_usec = 0;
-        }
-      }  // End of joystick open loop.
+  ~JoyLinux() override
+  {
+    running_ = false;
+    wake();
+    reader_.join();
 
-      close(ff_fd_);
-      close(joy_fd);
-      rclcpp::spin_some(node_);
-      if (rclcpp::ok()) {
-        RCLCPP_ERROR(
-          node_->get_logger(), "Connection to joystick device lost unexpectedly. Will reopen.");
-      }
+    if (inotify_fd_ != -1) {
+      close(inotify_fd_);
     }
+    close(timer_fd_);
+    close(wake_fd_);
+    close(epoll_fd_);
 
-cleanup:
-    RCLCPP_INFO(node_->get_logger(), "joy_node shut down.");
-
-    return 0;
+    RCLCPP_INFO(get_logger(), "joy_node shut down.");
   }
 };
 
-int main(int argc, char ** argv)
-{
-  rclcpp::init(argc, argv);
-  Joystick j;
-  return j.main(argc, argv);
-}
+}  // namespace manual_control
+
+RCLCPP_COMPONENTS_REGISTER_NODE(manual_control::JoyLinux)
@@ -1,43 +1,83 @@
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <string>
+
 #include "custom_interfaces/msg/manual_control.hpp"
 #include "custom_interfaces/msg/threshold_adjustment.hpp"
+#include "instrumentation/node_health.hpp"
 #include "rclcpp/rclcpp.hpp"
+#include "rclcpp_components/register_node_macro.hpp"
 #include "sensor_msgs/msg/joy.hpp"
 #include "std_msgs/msg/int8.hpp"
 #include "std_msgs/msg/float32.hpp"
 
+namespace manual_control
+{
+
 #define OFF false
 #define ON  true
 
+// Logical controls and the order of the tables below.
+enum class Button
+{
+    X,
+    CIRCLE,
+    TRIANGLE,
+    SQUARE,
+    L1,
+    R1,
+    L2,
+    R2,
+    OPTION,
+    SHARE,
+    PS,
+    L3,
+    R3,
+    COUNT
+};
+
+enum class Axis
+{
+    L3_LR,
+    L3_UD,
+    L2,
+    R3_LR,
+    R3_UD,
+    R2,
+    DPAD_LR,
+    DPAD_UD,
+    COUNT
+};
+
+#define BUTTON_COUNT static_cast<std::size_t>(Button::COUNT)
+#define AXIS_COUNT   static_cast<std::size_t>(Axis::COUNT)
+
+// Index of each control in sensor_msgs/Joy.
+struct ControllerProfile
+{
+    int buttons[BUTTON_COUNT];
+    int axes[AXIS_COUNT];
+};
+
 // ================================
 // MAPPINGS ARE WITH PS4 CONTROLLER
 // ================================
-const std::map<std::string, int> BUTTON_MAPPINGS = {
-    { "X", 0 },
-    { "CIRCLE", 1 },
-    { "O", 1 },
-    { "TRIANGLE", 2 },
-    { "SQUARE", 3 },
-    { "L1", 4 },
-    { "R1", 5 },
-    { "L2", 6 },
-    { "R2", 7 },
-    { "OPTION", 8 },
-    { "SHARE", 9 },
-    { "PS", 10 },
-    { "L3", 11 },
-    { "R3", 12 }
+constexpr ControllerProfile PS4_PROFILE = {
+    { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12 },
+    { 0, 1, 2, 3, 4, 5, 6, 7 }
 };
 
-const std::map<std::string, int> AXES_MAPPINGS = {
-    { "L3-L/R", 0 },
-    { "L3-U/D", 1 },
-    { "L2", 2 },
-    { "R3-L/R", 3 },
-    { "R3-U/D", 4 },
-    { "R2", 5 },
-    { "DPAD-L/R", 6 },
-    { "DPAD-U/D", 7 }
+// Parameter names, buttons.<name> and axes.<name>, through which another pad is mapped.
+constexpr const char *BUTTON_NAMES[] = {
+    "x", "circle", "triangle", "square", "l1", "r1", "l2", "r2", "option", "share", "ps", "l3", "r3"
 };
+constexpr const char *AXIS_NAMES[] = {
+    "l3_lr", "l3_ud", "l2", "r3_lr", "r3_ud", "r2", "dpad_lr", "dpad_ud"
+};
+
+static_assert(sizeof(BUTTON_NAMES) / sizeof(BUTTON_NAMES[0]) == BUTTON_COUNT, "a button is missing a name");
+static_assert(sizeof(AXIS_NAMES) / sizeof(AXIS_NAMES[0]) == AXIS_COUNT, "an axis is missing a name");
 
 class ManualControl : public rclcpp::Node
 {
@@ -46,15 +86,39 @@ class ManualControl : public rclcpp::Node
         rclcpp::Publisher<custom_interfaces::msg::ThresholdAdjustment>::SharedPtr vision_adjustment_publisher;
         rclcpp::Publisher<std_msgs::msg::Float32>::SharedPtr ball_release_publisher;
         rclcpp::Subscription<sensor_msgs::msg::Joy>::SharedPtr joy_subscriber;
+        rclcpp::TimerBase::SharedPtr state_timer;
+        ControllerProfile profile;
+        // What the node's health is recorded under, see instrumentation/node_health.hpp.
+        enum HealthCallback {
+            JOY_CALLBACK = 0
+        };
+        std::unique_ptr<instrumentation::NodeHealth> health;
+
+        // What was last published, so that only changes are.
+        custom_interfaces::msg::ManualControl last_control;
+        float last_ball_release;
+        bool published;
 
     public:
-        ManualControl() : Node("manual_control")
+        explicit ManualControl(const rclcpp::NodeOptions &options = rclcpp::NodeOptions())
+        : Node("manual_control", options), profile(PS4_PROFILE), last_ball_release(0.0f), published(false)
         {
+            // The PS4 layout unless a parameter file maps another pad.
+            for (std::size_t i = 0; i < BUTTON_COUNT; i++)
+                profile.buttons[i] = declare_parameter(std::string("buttons.") + BUTTON_NAMES[i], PS4_PROFILE.buttons[i]);
+            for (std::size_t i = 0; i < AXIS_COUNT; i++)
+                profile.axes[i] = declare_parameter(std::string("axes.") + AXIS_NAMES[i], PS4_PROFILE.axes[i]);
+
+            health = std::make_unique<instrumentation::NodeHealth>(this, std::vector<std::string>{"joy"});
             joy_subscriber = create_subscription<sensor_msgs::msg::Joy>(
                 "joy",
                 10,
                 std::bind(&ManualControl::joy_publisher, this, std::placeholders::_1)
             );
+            // Control and the ball release are states published when they change, with a queue deep
+            // enough that a quick stop press and release both arrive. They stay volatile, which
+            // intra-process comms require, so the current state is also republished every
+            // state_period_ms for subscribers that join later.
             control_publisher = create_publisher<custom_interfaces::msg::ManualControl>(
                 "navigation_control",
                 10
@@ -63,54 +127,117 @@ class ManualControl : public rclcpp::Node
                 "vision_threshold_adjustment",
                 10
             );
-            ball_release_publisher = create_publisher<std_msgs::msg::Float32>("ball_release", 10);
+            ball_release_publisher = create_publisher<std_msgs::msg::Float32>(
+                "ball_release",
+                10
+            );
+            state_timer = create_wall_timer(
+                std::chrono::milliseconds(declare_parameter("state_period_ms", 500)),
+                std::bind(&ManualControl::republish_state, this)
+            );
 
             RCLCPP_INFO(get_logger(), "%s node has started", get_name());
         }
 
     private:
         void joy_publisher(const sensor_msgs::msg::Joy::SharedPtr input)
-        {   
-            publish_control(input);
-            publish_ball_release(input->axes);
-            publish_vision_adjust(input);
+        {
+            instrumentation::CallbackTimer health_timer(health->callback(JOY_CALLBACK));
+            publish_control(*input);
+            publish_ball_release(*input);
+            publish_vision_adjust(*input);
+            published = true;
+        }
+
+        void republish_state()
+        {
+            if (!published)
+                return;
+
+            // Unstamped, since it carries no new input for navigation's teleop latency.
+            auto control = std::make_unique<custom_interfaces::msg::ManualControl>(last_control);
+            control->header.stamp = builtin_interfaces::msg::Time();
+            control_publisher->publish(std::move(control));
+
+            auto release = std_msgs::msg::Float32();
+            release.data = last_ball_release;
+            ball_release_publisher->publish(release);
+        }
+
+        // A control the pad does not have reads as released.
+        int button(const sensor_msgs::msg::Joy &input, Button control)
+        {
+            std::size_t index = profile.buttons[static_cast<std::size_t>(control)];
+            if (index < input.buttons.size())
+                return input.buttons[index];
+
+            RCLCPP_WARN_ONCE(get_logger(), "Joy has no button %zu, check the controller mapping", index);
+            return OFF;
         }
-        
-        void publish_ball_release(const std::vector<float> &axes)
+
+        // A control the pad does not have reads as at rest.
+        float axis(const sensor_msgs::msg::Joy &input, Axis control)
+        {
+            std::size_t index = profile.axes[static_cast<std::size_t>(control)];
+            if (index < input.axes.size())
+                return input.axes[index];
+
+            RCLCPP_WARN_ONCE(get_logger(), "Joy has no axis %zu, check the controller mapping", index);
+            return 0.0f;
+        }
+
+        void publish_ball_release(const sensor_msgs::msg::Joy &input)
         {
+            float release = axis(input, Axis::R3_UD);
+            if (published && release == last_ball_release)
+                return;
+
             auto message = std_msgs::msg::Float32();
-            message.data = axes.at(AXES_MAPPINGS.at("R3-U/D"));
+            message.data = release;
             ball_release_publisher->publish(message);
+            last_ball_release = release;
         }
 
-        void publish_control(const sensor_msgs::msg::Joy::SharedPtr input)
+        void publish_control(const sensor_msgs::msg::Joy &input)
         {
             auto message = custom_interfaces::msg::ManualControl();
 
+            // The time of the input, so navigation can tell how long it took to reach cmd_vel.
+            message.header = input.header;
             message.stop = read_stop(input);
             message.linear_percentage = calculate_linear_percentage(input);
             message.angular_percentage = calculate_angular_percentage(input);
 
-            control_publisher->publish(message);
+            // Navigation holds on to the last command, so a repeat of it carries nothing.
+            if (published && message.stop == last_control.stop
+                && message.linear_percentage == last_control.linear_percentage
+                && message.angular_percentage == last_control.angular_percentage)
+                return;
+
+            last_control = message;
+            control_publisher->publish(std::make_unique<custom_interfaces::msg::ManualControl>(message));
         }
 
-        void publish_vision_adjust(const sensor_msgs::msg::Joy::SharedPtr input)
+        // Adjustments are steps, so one is sent for every Joy message while the d-pad is held and
+        // none while it is not.
+        void publish_vision_adjust(const sensor_msgs::msg::Joy &input)
         {
             auto message = custom_interfaces::msg::ThresholdAdjustment();
-            
-            int adjustment = input->axes.at(AXES_MAPPINGS.at("DPAD-U/D"));
-            if (input->buttons.at(BUTTON_MAPPINGS.at("L1")) == ON)
+
+            int adjustment = axis(input, Axis::DPAD_UD);
+            if (button(input, Button::L1) == ON)
                 message.lower_adjustment = adjustment;
-            if (input->buttons.at(BUTTON_MAPPINGS.at("R1")) == ON)
+            if (button(input, Button::R1) == ON)
                 message.red_adjustment = adjustment;
-            
-            vision_adjustment_publisher->publish(message);
+
+            if (message.lower_adjustment != 0 || message.red_adjustment != 0)
+                vision_adjustment_publisher->publish(message);
         }
 
-        double calculate_linear_percentage(const sensor_msgs::msg::Joy::SharedPtr input)
+        double calculate_linear_percentage(const sensor_msgs::msg::Joy &input)
         {
-            bool forward = input->buttons.at(BUTTON_MAPPINGS.at("R2"));
-            bool backward = input->buttons.at(BUTTON_MAPPINGS.at("L2"));
+            bool forward = button(input, Button::R2);
+            bool backward = button(input, Button::L2);
 
             double linear;
 
@@ -124,24 +251,24 @@ class ManualControl : public rclcpp::Node
             // Forward button only being pressed.
             else if (forward == ON)
             {
-                linear = 1 - input->axes.at(AXES_MAPPINGS.at("R2"));
+                linear = 1 - axis(input, Axis::R2);
             }
             // Backward button only being pressed.
             else
             {
-                linear = -1 + input->axes.at(AXES_MAPPINGS.at("L2"));
+                linear = -1 + axis(input, Axis::L2);
             }
 
             // Get percentage. Range of possible values is from [-1, 1]
             return linear / 2;
         }
 
-        double calculate_angular_percentage(const sensor_msgs::msg::Joy::SharedPtr input)
+        double calculate_angular_percentage(const sensor_msgs::msg::Joy &input)
         {
-            double angular = input->axes.at(AXES_MAPPINGS.at("DPAD-L/R"));
+            double angular = axis(input, Axis::DPAD_LR);
 
             // If the user is holding dpad and L3, add results together.
-            angular += input->axes.at(AXES_MAPPINGS.at("L3-L/R"));
+            angular += axis(input, Axis::L3_LR);
 
             // Get percentage.
             // Range of possible values from d-pad is [-1, 1]
@@ -151,17 +278,12 @@ class ManualControl : public rclcpp::Node
             return angular * M_PI / 2;
         }
 
-        bool read_stop(const sensor_msgs::msg::Joy::SharedPtr input)
+        bool read_stop(const sensor_msgs::msg::Joy &input)
         {
-            return input->buttons.at(BUTTON_MAPPINGS.at("CIRCLE")) == ON;
+            return button(input, Button::CIRCLE) == ON;
         }
 };
 
+}  // namespace manual_control
 
-int main(int argc, char **argv)
-{
-    rclcpp::init(argc, argv);
-    rclcpp::spin(std::make_shared<ManualControl>());
-    rclcpp::shutdown();
-    return 0;
-}
+RCLCPP_COMPONENTS_REGISTER_NODE(manual_control::ManualControl)
@@ -0,0 +1,99 @@
+#ifndef MOTION__BALL_MAP_HPP_
+#define MOTION__BALL_MAP_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace motion
+{
+
+struct BallMapConfig
+{
+    // Side of a grid cell in metres. About the spacing of balls on the range works best.
+    double cell_size = 0.5;
+    // An observation this close to a known ball is taken to be that ball.
+    double merge_radius = 0.25;
+    // Observations before a ball is reported by nearest() and for_each_confirmed(). Balls
+    // added with add() are confirmed at once.
+    uint32_t min_observations = 3;
+};
+
+struct MappedBall
+{
+    uint32_t id;
+    double x, y;
+    uint32_t observations;
+    int64_t last_seen_ns;
+};
+
+// Golf balls in world coordinates, kept in a hash of grid cells so inserting, merging and removing
+// a ball only touches the cells around it, and nearest() only the rings of cells out to the
+// nearest ball rather than every ball on the range. Not thread safe.
+class BallMap
+{
+    private:
+        struct Slot
+        {
+            MappedBall ball;
+            bool used;
+        };
+
+        BallMapConfig config;
+        // Balls by slot, with freed slots reused, and the slots in each occupied cell.
+        std::vector<Slot> slots;
+        std::vector<uint32_t> free_slots;
+        std::unordered_map<int64_t, std::vector<uint32_t>> cells;
+        // Cells any ball was ever in since the last clear(); bounds the ring search.
+        int32_t min_cell_x, max_cell_x, min_cell_y, max_cell_y;
+        std::size_t balls, confirmed;
+        uint32_t next_id;
+
+        int32_t cell_of(double coordinate) const;
+        static int64_t cell_key(int32_t cell_x, int32_t cell_y);
+        void link(uint32_t slot, int32_t cell_x, int32_t cell_y);
+        void unlink(uint32_t slot, int32_t cell_x, int32_t cell_y);
+        uint32_t insert(double x, double y, int64_t stamp_ns, uint32_t observations);
+        void erase(uint32_t slot);
+        // Slot of the nearest ball within radius of (x, y), or -1.
+        int64_t find_within(double x, double y, double radius) const;
+        void move(uint32_t slot, double x, double y);
+
+    public:
+        explicit BallMap(const BallMapConfig &config = BallMapConfig());
+
+        void clear();
+        const BallMapConfig &get_config() const { return config; }
+
+        // Merges a sighting into the known ball within merge_radius, moving it towards the
+        // sighting, or adds a new ball. Returns the ball's id.
+        uint32_t observe(double x, double y, int64_t stamp_ns);
+        // Adds a ball known from elsewhere, e.g. where the simulation spawned it, as confirmed.
+        uint32_t add(double x, double y, int64_t stamp_ns);
+        // Removes the balls within radius of (x, y), e.g. from under the robot once it has
+        // driven over them, and returns how many.
+        std::size_t remove_within(double x, double y, double radius);
+        // Removes the balls last seen before oldest_ns and returns how many.
+        std::size_t expire(int64_t oldest_ns);
+
+        // The nearest confirmed ball to (x, y). False if there is none.
+        bool nearest(double x, double y, MappedBall &ball) const;
+
+        std::size_t size() const { return balls; }
+        std::size_t confirmed_size() const { return confirmed; }
+
+        template <typename F>
+        void for_each_confirmed(F f) const
+        {
+            for (const auto &slot : slots)
+            {
+                if (slot.used && slot.ball.observations >= config.min_observations)
+                    f(slot.ball);
+            }
+        }
+};
+
+}  // namespace motion
+
+#endif  // MOTION__BALL_MAP_HPP_
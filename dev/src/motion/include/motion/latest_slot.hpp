@@ -0,0 +1,68 @@
+#ifndef MOTION__LATEST_SLOT_HPP_
+#define MOTION__LATEST_SLOT_HPP_
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace motion
+{
+
+// Holds the latest value written by one writer thread for any number of readers, without locks:
+// a sequence lock over a copy of the value. The writer never waits. A reader retries only if a
+// write lands while it is copying. The value is kept in atomic words, so a torn copy is
+// discarded rather than being a data race.
+template <typename T>
+class LatestSlot
+{
+    static_assert(std::is_trivially_copyable<T>::value, "LatestSlot values are copied bytewise");
+
+    private:
+        static constexpr std::size_t WORDS = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+        // Odd while a write is in progress; advanced by two per write.
+        std::atomic<uint32_t> sequence{0};
+        std::array<std::atomic<uint64_t>, WORDS> words{};
+
+    public:
+        // Writer side; only ever call it from one thread.
+        void store(const T &value)
+        {
+            uint64_t buffer[WORDS] = {};
+            std::memcpy(buffer, &value, sizeof(T));
+
+            uint32_t current = sequence.load(std::memory_order_relaxed);
+            sequence.store(current + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            for (std::size_t i = 0; i < WORDS; i++)
+                words[i].store(buffer[i], std::memory_order_relaxed);
+            sequence.store(current + 2, std::memory_order_release);
+        }
+
+        // Copies the latest value into value and returns how many values have been stored so far,
+        // so a reader can tell whether anything new arrived since it last looked. 0 means nothing has
+        // been stored yet, and value is left alone.
+        uint32_t load(T &value) const
+        {
+            uint64_t buffer[WORDS];
+            uint32_t before, after;
+            do
+            {
+                before = sequence.load(std::memory_order_acquire);
+                for (std::size_t i = 0; i < WORDS; i++)
+                    buffer[i] = words[i].load(std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                after = sequence.load(std::memory_order_relaxed);
+            } while ((before & 1) != 0 || before != after);
+
+            if (before != 0)
+                std::memcpy(&value, buffer, sizeof(T));
+            return before / 2;
+        }
+};
+
+}  // namespace motion
+
+#endif  // MOTION__LATEST_SLOT_HPP_
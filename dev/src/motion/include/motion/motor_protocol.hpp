@@ -0,0 +1,77 @@
+#ifndef MOTION__MOTOR_PROTOCOL_HPP_
+#define MOTION__MOTOR_PROTOCOL_HPP_
+
+#include <cstddef>
+#include <cstdint>
+
+// Framing of the binary motor link to the Arduino. Every frame is
+//
+//     START  type  sequence  length  payload[length]  crc_low  crc_high
+//
+// where the CRC is CRC-16/CCITT-FALSE (polynomial 0x1021, initial 0xFFFF) over type, sequence,
+// length and the payload. Multi-byte payload fields are little endian. After a bad frame the
+// receiver scans for the next START, so corruption costs the damaged frame and at most the one
+// it ran into. Commands are idempotent and superseded by the next one, so neither is resent.
+#define MOTOR_FRAME_START 0xA5
+#define MOTOR_FRAME_HEADER_SIZE 4
+#define MOTOR_FRAME_CRC_SIZE 2
+#define MOTOR_MAX_PAYLOAD 16
+#define MOTOR_MAX_FRAME_SIZE (MOTOR_FRAME_HEADER_SIZE + MOTOR_MAX_PAYLOAD + MOTOR_FRAME_CRC_SIZE)
+
+// Host to board: int16 left PWM, int16 right PWM, int16 draw bridge PWM.
+#define MOTOR_COMMAND_FRAME 0x01
+#define MOTOR_COMMAND_PAYLOAD 6
+// Board to host: uint8 sequence of the command it applied, uint8 status (0 is OK).
+#define MOTOR_ACK_FRAME 0x81
+#define MOTOR_ACK_PAYLOAD 2
+
+namespace motion
+{
+
+uint16_t crc16_ccitt(const uint8_t *data, std::size_t size, uint16_t crc = 0xFFFF);
+
+// Writes a command frame into out, which must hold MOTOR_MAX_FRAME_SIZE bytes, and returns its size.
+std::size_t encode_motor_command(uint8_t sequence, int16_t left, int16_t right, int16_t draw_bridge, uint8_t *out);
+
+struct MotorFrame
+{
+    uint8_t type, sequence, length;
+    uint8_t payload[MOTOR_MAX_PAYLOAD];
+};
+
+// Reassembles frames from the byte stream, a byte at a time so it can be fed straight from
+// whatever each read() returned.
+class MotorFrameParser
+{
+    private:
+        enum class State
+        {
+            START,
+            TYPE,
+            SEQUENCE,
+            LENGTH,
+            PAYLOAD,
+            CRC_LOW,
+            CRC_HIGH
+        };
+
+        State state;
+        MotorFrame frame;
+        std::size_t received;
+        uint16_t crc;
+        uint8_t crc_low;
+        uint64_t crc_errors;
+
+    public:
+        MotorFrameParser();
+
+        // Returns true, with the frame in out, when byte completes a frame whose CRC matches.
+        bool push(uint8_t byte, MotorFrame &out);
+
+        // Frames dropped so far because their CRC or length was wrong.
+        uint64_t errors() const { return crc_errors; }
+};
+
+}  // namespace motion
+
+#endif  // MOTION__MOTOR_PROTOCOL_HPP_
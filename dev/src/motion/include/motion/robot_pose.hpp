@@ -0,0 +1,32 @@
+#ifndef MOTION__ROBOT_POSE_HPP_
+#define MOTION__ROBOT_POSE_HPP_
+
+#include <cmath>
+#include <cstdint>
+
+namespace motion
+{
+
+// Where the robot is on the ground plane, from its odometry.
+struct RobotPose
+{
+    double x, y, yaw;
+    // ROS time of the odometry message.
+    int64_t stamp_ns;
+};
+
+// Heading about z of an orientation quaternion.
+inline double yaw_from_quaternion(double x, double y, double z, double w)
+{
+    return std::atan2(2.0 * (w * z + x * y), 1.0 - 2.0 * (y * y + z * z));
+}
+
+// angle wrapped into [-pi, pi].
+inline double wrap_angle(double angle)
+{
+    return std::atan2(std::sin(angle), std::cos(angle));
+}
+
+}  // namespace motion
+
+#endif  // MOTION__ROBOT_POSE_HPP_
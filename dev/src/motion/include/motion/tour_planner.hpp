@@ -0,0 +1,106 @@
+#ifndef MOTION__TOUR_PLANNER_HPP_
+#define MOTION__TOUR_PLANNER_HPP_
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace motion
+{
+
+struct TourPoint
+{
+    double x, y;
+};
+
+struct TourPlannerConfig
+{
+    // Moves are only tried between each ball and this many of its nearest balls.
+    int neighbours = 8;
+    // If more than this share of the balls is new, the tour is rebuilt nearest neighbour first
+    // instead of the new balls being inserted into it.
+    double rebuild_fraction = 0.5;
+};
+
+// Order to collect balls in: a path from the robot through every ball to the drop-off that is
+// kept short with 2-opt. The path is seeded nearest neighbour first; later changes to the balls
+// keep the order of those that remain and put new ones where they lengthen it least, so the path
+// only needs local repair. 2-opt only tries reconnecting each ball with its nearest neighbours
+// and only looks again at balls whose edges changed, and improve() stops at a time budget, so a
+// replan fits in a control period with thousands of balls and carries on in the next.
+class TourPlanner
+{
+    private:
+        // The balls bucketed into square cells, the balls of each cell contiguous in items.
+        struct Grid
+        {
+            double min_x, min_y, size;
+            int columns, rows;
+            std::vector<uint32_t> cell_begin, cell_end, items, slot;
+
+            void build(const std::vector<TourPoint> &points);
+            int column(double x) const;
+            int row(double y) const;
+            // Takes a ball out of the grid, so visit_ring() no longer sees it.
+            void remove(uint32_t node, const TourPoint &point);
+            // Calls visit(node) for the balls in the cells ring cells around (column, row). Returns
+            // false once the ring lies wholly outside the grid.
+            template <typename F>
+            bool visit_ring(int column, int row, int ring, F visit) const;
+            // Lower bound on the distance from point to any ball ring cells out from its cell.
+            double ring_bound(int ring) const { return ring > 0 ? (ring - 1) * size : 0.0; }
+        };
+
+        TourPlannerConfig config;
+        // Node 0 is the start, node 1 the end and node i + 2 ball i.
+        std::vector<TourPoint> points;
+        std::vector<std::string> names;
+        std::unordered_map<std::string, uint32_t> ball_by_name;
+        // tour[k] is the k-th node of the path and position[node] where it is in it.
+        std::vector<uint32_t> tour, position;
+        // neighbours[node * config.neighbours + j] is the node's j-th nearest ball.
+        std::vector<uint32_t> neighbours;
+        // Nodes whose edges changed since 2-opt last found no move for them.
+        std::vector<uint32_t> active;
+        std::vector<bool> queued;
+        Grid grid;
+
+        double distance(uint32_t a, uint32_t b) const;
+        void activate(uint32_t node);
+        void nearest_balls(const TourPoint &point, uint32_t self, uint32_t *out) const;
+        void build_neighbours();
+        void update_endpoint_neighbours();
+        void seed_nearest_neighbour();
+        void insert_cheapest(const std::vector<uint32_t> &order, const std::vector<bool> &is_new);
+        void reverse(std::size_t from, std::size_t to);
+        bool improve_node(uint32_t node);
+
+    public:
+        explicit TourPlanner(const TourPlannerConfig &config = TourPlannerConfig());
+
+        // Where the path starts (the robot) and ends (the drop-off). Both can move at any time.
+        void set_endpoints(const TourPoint &start, const TourPoint &end);
+        // Replaces the balls, identified by name. Balls that remain keep their place in the path.
+        void set_balls(const std::vector<std::string> &names, const std::vector<TourPoint> &balls);
+        // Takes the next ball off the path, e.g. once the robot has reached it.
+        void pop_next();
+
+        // Applies improving 2-opt moves until there are none or budget has passed. Returns true
+        // once the path is 2-optimal over the neighbour lists.
+        bool improve(std::chrono::nanoseconds budget);
+
+        std::size_t size() const { return tour.size() - 2; }
+        // The first ball of the path. False if there are no balls.
+        bool next(TourPoint &ball, std::string &name) const;
+        // Length of the whole path, start to end.
+        double length() const;
+        // Balls in the order they are to be collected.
+        std::vector<std::string> order() const;
+};
+
+}  // namespace motion
+
+#endif  // MOTION__TOUR_PLANNER_HPP_
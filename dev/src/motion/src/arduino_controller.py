@@ -44,7 +44,7 @@ class ArduinoController(Node):
         
         line = self.ser.readline().decode('utf-8').rstrip()
         
-        self.get_logger().info(f'Bytes Sent: {sent}. Received: {line}')
+        self.get_logger().debug(f'Bytes Sent: {sent}. Received: {line}')
         
     def pwm(self, linear: float, angular: float):
         if linear != 0.0:
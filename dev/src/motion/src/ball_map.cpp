@@ -0,0 +1,274 @@
+#include "motion/ball_map.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// A sighting moves a ball by at most 1 / BALL_MAP_MAX_WEIGHT of the way towards it, so a ball keeps
+// following something nudged by the robot instead of settling on its first position for good.
+#define BALL_MAP_MAX_WEIGHT 20
+
+namespace motion
+{
+
+BallMap::BallMap(const BallMapConfig &config)
+: config(config)
+{
+    if (this->config.cell_size <= 0.0)
+        this->config.cell_size = BallMapConfig().cell_size;
+    clear();
+}
+
+void BallMap::clear()
+{
+    slots.clear();
+    free_slots.clear();
+    cells.clear();
+    min_cell_x = min_cell_y = std::numeric_limits<int32_t>::max();
+    max_cell_x = max_cell_y = std::numeric_limits<int32_t>::min();
+    balls = 0;
+    confirmed = 0;
+    next_id = 0;
+}
+
+int32_t BallMap::cell_of(double coordinate) const
+{
+    return static_cast<int32_t>(std::floor(coordinate / config.cell_size));
+}
+
+int64_t BallMap::cell_key(int32_t cell_x, int32_t cell_y)
+{
+    return (static_cast<int64_t>(cell_x) << 32) | static_cast<uint32_t>(cell_y);
+}
+
+void BallMap::link(uint32_t slot, int32_t cell_x, int32_t cell_y)
+{
+    cells[cell_key(cell_x, cell_y)].push_back(slot);
+    min_cell_x = std::min(min_cell_x, cell_x);
+    max_cell_x = std::max(max_cell_x, cell_x);
+    min_cell_y = std::min(min_cell_y, cell_y);
+    max_cell_y = std::max(max_cell_y, cell_y);
+}
+
+void BallMap::unlink(uint32_t slot, int32_t cell_x, int32_t cell_y)
+{
+    auto cell = cells.find(cell_key(cell_x, cell_y));
+    if (cell != cells.end())
+    {
+        auto &members = cell->second;
+        auto member = std::find(members.begin(), members.end(), slot);
+        if (member != members.end())
+        {
+            *member = members.back();
+            members.pop_back();
+        }
+        if (members.empty())
+            cells.erase(cell);
+    }
+}
+
+uint32_t BallMap::insert(double x, double y, int64_t stamp_ns, uint32_t observations)
+{
+    uint32_t slot;
+    if (free_slots.empty())
+    {
+        slot = static_cast<uint32_t>(slots.size());
+        slots.push_back(Slot());
+    }
+    else
+    {
+        slot = free_slots.back();
+        free_slots.pop_back();
+    }
+
+    slots[slot].ball = MappedBall{next_id++, x, y, observations, stamp_ns};
+    slots[slot].used = true;
+
+    link(slot, cell_of(x), cell_of(y));
+
+    balls++;
+    if (observations >= config.min_observations)
+        confirmed++;
+    return slots[slot].ball.id;
+}
+
+void BallMap::erase(uint32_t slot)
+{
+    const MappedBall &ball = slots[slot].ball;
+    unlink(slot, cell_of(ball.x), cell_of(ball.y));
+
+    balls--;
+    if (ball.observations >= config.min_observations)
+        confirmed--;
+    slots[slot].used = false;
+    free_slots.push_back(slot);
+}
+
+void BallMap::move(uint32_t slot, double x, double y)
+{
+    MappedBall &ball = slots[slot].ball;
+    int32_t old_x = cell_of(ball.x), old_y = cell_of(ball.y);
+    int32_t new_x = cell_of(x), new_y = cell_of(y);
+    ball.x = x;
+    ball.y = y;
+    if (old_x == new_x && old_y == new_y)
+        return;
+
+    unlink(slot, old_x, old_y);
+    link(slot, new_x, new_y);
+}
+
+int64_t BallMap::find_within(double x, double y, double radius) const
+{
+    int64_t found = -1;
+    double best = radius * radius;
+    int32_t reach = static_cast<int32_t>(std::ceil(radius / config.cell_size));
+    int32_t cell_x = cell_of(x), cell_y = cell_of(y);
+    for (int32_t cx = cell_x - reach; cx <= cell_x + reach; cx++)
+    {
+        for (int32_t cy = cell_y - reach; cy <= cell_y + reach; cy++)
+        {
+            auto cell = cells.find(cell_key(cx, cy));
+            if (cell == cells.end())
+                continue;
+
+            for (uint32_t slot : cell->second)
+            {
+                const MappedBall &ball = slots[slot].ball;
+                double distance = (ball.x - x) * (ball.x - x) + (ball.y - y) * (ball.y - y);
+                if (distance <= best)
+                {
+                    best = distance;
+                    found = slot;
+                }
+            }
+        }
+    }
+
+    return found;
+}
+
+uint32_t BallMap::observe(double x, double y, int64_t stamp_ns)
+{
+    int64_t found = find_within(x, y, config.merge_radius);
+    if (found < 0)
+        return insert(x, y, stamp_ns, 1);
+
+    uint32_t slot = static_cast<uint32_t>(found);
+    MappedBall &ball = slots[slot].ball;
+    ball.observations++;
+    if (ball.observations == config.min_observations)
+        confirmed++;
+    ball.last_seen_ns = std::max(ball.last_seen_ns, stamp_ns);
+
+    double weight = std::min<uint32_t>(ball.observations, BALL_MAP_MAX_WEIGHT);
+    move(slot, ball.x + (x - ball.x) / weight, ball.y + (y - ball.y) / weight);
+    return ball.id;
+}
+
+uint32_t BallMap::add(double x, double y, int64_t stamp_ns)
+{
+    return insert(x, y, stamp_ns, std::max<uint32_t>(config.min_observations, 1));
+}
+
+std::size_t BallMap::remove_within(double x, double y, double radius)
+{
+    std::size_t removed = 0;
+    for (int64_t slot = find_within(x, y, radius); slot >= 0; slot = find_within(x, y, radius))
+    {
+        erase(static_cast<uint32_t>(slot));
+        removed++;
+    }
+
+    return removed;
+}
+
+std::size_t BallMap::expire(int64_t oldest_ns)
+{
+    std::size_t removed = 0;
+    for (uint32_t slot = 0; slot < slots.size(); slot++)
+    {
+        if (slots[slot].used && slots[slot].ball.last_seen_ns < oldest_ns)
+        {
+            erase(slot);
+            removed++;
+        }
+    }
+
+    return removed;
+}
+
+bool BallMap::nearest(double x, double y, MappedBall &ball) const
+{
+    if (confirmed == 0)
+        return false;
+
+    int32_t cell_x = cell_of(x), cell_y = cell_of(y);
+    // Rings beyond this lie wholly outside every cell that was ever occupied.
+    int32_t max_ring = std::max(
+        std::max(cell_x - min_cell_x, max_cell_x - cell_x),
+        std::max(cell_y - min_cell_y, max_cell_y - cell_y)
+    );
+
+    double best = std::numeric_limits<double>::infinity();
+    int64_t found = -1;
+    auto visit = [&](int32_t cx, int32_t cy) {
+        if (cx < min_cell_x || cx > max_cell_x || cy < min_cell_y || cy > max_cell_y)
+            return;
+
+        auto cell = cells.find(cell_key(cx, cy));
+        if (cell == cells.end())
+            return;
+
+        for (uint32_t slot : cell->second)
+        {
+            const MappedBall &candidate = slots[slot].ball;
+            if (candidate.observations < config.min_observations)
+                continue;
+
+            double distance = (candidate.x - x) * (candidate.x - x) + (candidate.y - y) * (candidate.y - y);
+            if (distance < best)
+            {
+                best = distance;
+                found = slot;
+            }
+        }
+    };
+
+    for (int32_t ring = 0; ring <= max_ring; ring++)
+    {
+        // Every ball in ring r is at least r - 1 cells away, so once the best is closer than that
+        // no further ring can hold a nearer one.
+        double bound = (ring - 1) * config.cell_size;
+        if (found >= 0 && bound > 0.0 && best <= bound * bound)
+            break;
+
+        if (ring == 0)
+        {
+            visit(cell_x, cell_y);
+            continue;
+        }
+
+        // Only the part of the ring that overlaps the occupied cells is walked.
+        int32_t from_x = std::max(cell_x - ring, min_cell_x), to_x = std::min(cell_x + ring, max_cell_x);
+        int32_t from_y = std::max(cell_y - ring + 1, min_cell_y), to_y = std::min(cell_y + ring - 1, max_cell_y);
+        for (int32_t cx = from_x; cx <= to_x; cx++)
+        {
+            visit(cx, cell_y - ring);
+            visit(cx, cell_y + ring);
+        }
+        for (int32_t cy = from_y; cy <= to_y; cy++)
+        {
+            visit(cell_x - ring, cy);
+            visit(cell_x + ring, cy);
+        }
+    }
+
+    if (found < 0)
+        return false;
+
+    ball = slots[found].ball;
+    return true;
+}
+
+}  // namespace motion
@@ -0,0 +1,249 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <string>
+
+#include "custom_interfaces/msg/image_data.hpp"
+#include "custom_interfaces/srv/transfer_golfball_locations.hpp"
+#include "instrumentation/node_health.hpp"
+#include "motion/ball_map.hpp"
+#include "motion/robot_pose.hpp"
+#include "nav_msgs/msg/odometry.hpp"
+#include "rclcpp/rclcpp.hpp"
+#include "rclcpp_components/register_node_macro.hpp"
+
+namespace motion
+{
+
+// Builds a map of the golf balls on the range from image_processing's ball candidates and the
+// robot's odometry, and sends the confirmed balls to navigation through its golfball_map
+// service whenever the map has changed, so that it can drive to a ball it saw earlier instead of
+// searching. Each candidate is projected onto the ground through the camera's mounting, see the
+// camera_* parameters. Without odometry nothing is mapped. image_processing only reports every
+// candidate in view with all_ball_candidates set; otherwise those far from a tracked ball are missed.
+class BallMapping : public rclcpp::Node
+{
+    private:
+        using TransferGolfballLocations = custom_interfaces::srv::TransferGolfballLocations;
+        // What the node's health is recorded under, see instrumentation/node_health.hpp. image_data
+        // drops are results that came without odometry close enough to map them with; transfer drops
+        // are transfers navigation never answered.
+        enum HealthCallback {
+            IMAGE_DATA_CALLBACK = 0,
+            ODOMETRY_CALLBACK,
+            ADD_CALLBACK,
+            TRANSFER_CALLBACK
+        };
+
+        BallMap map;
+        RobotPose pose;
+        bool have_pose, changed, transfer_pending;
+        double camera_height, camera_pitch, camera_forward, focal_length, image_center_x, image_center_y;
+        double max_range, pickup_radius;
+        rclcpp::Duration expiry, max_pose_age;
+        rclcpp::Subscription<custom_interfaces::msg::ImageData>::SharedPtr image_data_subscriber;
+        rclcpp::Subscription<nav_msgs::msg::Odometry>::SharedPtr odometry_subscriber;
+        rclcpp::Service<TransferGolfballLocations>::SharedPtr add_service;
+        rclcpp::Client<TransferGolfballLocations>::SharedPtr map_client;
+        rclcpp::TimerBase::SharedPtr transfer_timer;
+        // The transfer in flight, given up on once it has gone unanswered for transfer_timeout.
+        int64_t transfer_request;
+        std::chrono::steady_clock::time_point transfer_sent;
+        std::chrono::milliseconds transfer_timeout;
+        std::unique_ptr<instrumentation::NodeHealth> health;
+
+    public:
+        explicit BallMapping(const rclcpp::NodeOptions &options = rclcpp::NodeOptions())
+        : Node("ball_map", options), pose{0.0, 0.0, 0.0, 0}, have_pose(false), changed(false), transfer_pending(false),
+          expiry(0, 0), max_pose_age(0, 0), transfer_request(0)
+        {
+            BallMapConfig config;
+            config.cell_size = declare_parameter("cell_size_m", config.cell_size);
+            config.merge_radius = declare_parameter("merge_radius_m", config.merge_radius);
+            config.min_observations = std::max(1, declare_parameter("min_observations", static_cast<int>(config.min_observations)));
+            map = BallMap(config);
+
+            // Camera mounting: lens height above the ground, downward tilt, how far ahead of the robot's
+            // origin it sits, and its horizontal field of view across image_width x image_height pixels.
+            camera_height = declare_parameter("camera_height_m", 0.2);
+            camera_pitch = declare_parameter("camera_pitch_rad", 0.35);
+            camera_forward = declare_parameter("camera_forward_m", 0.1);
+            double horizontal_fov = declare_parameter("camera_hfov_rad", 1.085);
+            int image_width = declare_parameter("image_width", 360);
+            int image_height = declare_parameter("image_height", 240);
+            focal_length = (image_width / 2.0) / std::tan(horizontal_fov / 2.0);
+            image_center_x = image_width / 2.0;
+            image_center_y = image_height / 2.0;
+
+            // Sightings further away than this are too coarse to map. Balls within pickup_radius_m of
+            // the robot are taken to be collected and balls not seen for expiry_s are forgotten.
+            max_range = declare_parameter("max_range_m", 5.0);
+            pickup_radius = declare_parameter("pickup_radius_m", 0.2);
+            expiry = rclcpp::Duration(std::chrono::seconds(declare_parameter("expiry_s", 300)));
+            max_pose_age = rclcpp::Duration(std::chrono::milliseconds(declare_parameter("max_pose_age_ms", 200)));
+            health = std::make_unique<instrumentation::NodeHealth>(
+                this,
+                std::vector<std::string>{"image_data", "odom", "add", "transfer"}
+            );
+
+            image_data_subscriber = create_subscription<custom_interfaces::msg::ImageData>(
+                "image_data",
+                rclcpp::QoS(1).best_effort(),
+                std::bind(&BallMapping::map_detections, this, std::placeholders::_1)
+            );
+            odometry_subscriber = create_subscription<nav_msgs::msg::Odometry>(
+                declare_parameter("odom_topic", std::string("odom")),
+                10,
+                std::bind(&BallMapping::update_pose, this, std::placeholders::_1)
+            );
+
+            // Balls known from elsewhere, e.g. where the simulation spawned them, can be added here.
+            add_service = create_service<TransferGolfballLocations>(
+                "ball_map/add",
+                std::bind(&BallMapping::add_balls, this, std::placeholders::_1, std::placeholders::_2)
+            );
+            map_client = create_client<TransferGolfballLocations>("golfball_map");
+            std::chrono::milliseconds transfer_period(declare_parameter("transfer_period_ms", 500));
+            transfer_timeout = 2 * transfer_period;
+            transfer_timer = create_wall_timer(transfer_period, std::bind(&BallMapping::transfer_map, this));
+
+            RCLCPP_INFO(get_logger(), "%s node has started", get_name());
+        }
+
+    private:
+        void update_pose(const nav_msgs::msg::Odometry::SharedPtr odometry)
+        {
+            instrumentation::CallbackTimer health_timer(health->callback(ODOMETRY_CALLBACK));
+            const auto &orientation = odometry->pose.pose.orientation;
+            pose.x = odometry->pose.pose.position.x;
+            pose.y = odometry->pose.pose.position.y;
+            pose.yaw = yaw_from_quaternion(orientation.x, orientation.y, orientation.z, orientation.w);
+            pose.stamp_ns = rclcpp::Time(odometry->header.stamp, get_clock()->get_clock_type()).nanoseconds();
+            if (pose.stamp_ns == 0)
+                pose.stamp_ns = now().nanoseconds();
+            have_pose = true;
+
+            if (map.remove_within(pose.x, pose.y, pickup_radius) > 0)
+                changed = true;
+        }
+
+        void map_detections(const custom_interfaces::msg::ImageData::SharedPtr image_data)
+        {
+            instrumentation::CallbackTimer health_timer(health->callback(IMAGE_DATA_CALLBACK));
+            int64_t stamp_ns = rclcpp::Time(image_data->header.stamp, get_clock()->get_clock_type()).nanoseconds();
+            if (stamp_ns == 0)
+                stamp_ns = now().nanoseconds();
+            if (!have_pose || std::llabs(stamp_ns - pose.stamp_ns) > max_pose_age.nanoseconds())
+            {
+                RCLCPP_WARN_THROTTLE(get_logger(), *get_clock(), 5000, "No odometry close to the frame's time, not mapping");
+                health->callback(IMAGE_DATA_CALLBACK).record_dropped();
+                return;
+            }
+
+            double cos_yaw = std::cos(pose.yaw), sin_yaw = std::sin(pose.yaw);
+            for (const auto &ball : image_data->balls)
+            {
+                double forward, left;
+                if (!project_to_ground(ball.centroid_x, ball.centroid_y, forward, left))
+                    continue;
+
+                map.observe(
+                    pose.x + forward * cos_yaw - left * sin_yaw,
+                    pose.y + forward * sin_yaw + left * cos_yaw,
+                    stamp_ns
+                );
+                changed = true;
+            }
+        }
+
+        // Where the ray through pixel (u, v) meets the ground, relative to the robot: forward and to
+        // the left. False above the horizon or beyond max_range.
+        bool project_to_ground(double u, double v, double &forward, double &left) const
+        {
+            double right = (u - image_center_x) / focal_length;
+            double down = (v - image_center_y) / focal_length;
+            double ray_forward = std::cos(camera_pitch) - down * std::sin(camera_pitch);
+            double ray_down = std::sin(camera_pitch) + down * std::cos(camera_pitch);
+            if (ray_down <= 1.0e-6)
+                return false;
+
+            double distance = camera_height / ray_down;
+            forward = camera_forward + distance * ray_forward;
+            left = -distance * right;
+            return forward * forward + left * left <= max_range * max_range;
+        }
+
+        void add_balls(
+            const std::shared_ptr<TransferGolfballLocations::Request> request,
+            std::shared_ptr<TransferGolfballLocations::Response> response)
+        {
+            instrumentation::CallbackTimer health_timer(health->callback(ADD_CALLBACK));
+            if (request->xs.size() != request->ys.size())
+            {
+                response->success = false;
+                return;
+            }
+
+            int64_t stamp_ns = now().nanoseconds();
+            for (std::size_t i = 0; i < request->xs.size(); i++)
+                map.add(request->xs[i], request->ys[i], stamp_ns);
+            changed = true;
+            response->success = true;
+            RCLCPP_INFO(get_logger(), "Added %zu golf ball(s), %zu known", request->xs.size(), map.size());
+        }
+
+        void transfer_map()
+        {
+            instrumentation::CallbackTimer health_timer(health->callback(TRANSFER_CALLBACK));
+            if (map.expire(now().nanoseconds() - expiry.nanoseconds()) > 0)
+                changed = true;
+            if (transfer_pending)
+            {
+                if (std::chrono::steady_clock::now() - transfer_sent < transfer_timeout)
+                    return;
+
+                // The response is lost, e.g. navigation restarted with the request in flight. Without
+                // giving up on it no transfer would ever be sent again.
+                map_client->remove_pending_request(transfer_request);
+                transfer_pending = false;
+                changed = true;
+                health->callback(TRANSFER_CALLBACK).record_dropped();
+                RCLCPP_WARN(get_logger(), "Navigation did not answer the golf ball map transfer, sending it again");
+            }
+            if (!changed || !map_client->service_is_ready())
+                return;
+
+            auto request = std::make_shared<TransferGolfballLocations::Request>();
+            request->xs.reserve(map.confirmed_size());
+            request->ys.reserve(map.confirmed_size());
+            request->names.reserve(map.confirmed_size());
+            map.for_each_confirmed([&request](const MappedBall &ball) {
+                request->xs.push_back(static_cast<float>(ball.x));
+                request->ys.push_back(static_cast<float>(ball.y));
+                request->names.push_back("ball" + std::to_string(ball.id));
+            });
+
+            // One transfer at a time; whatever changes meanwhile goes with the next.
+            changed = false;
+            transfer_pending = true;
+            transfer_sent = std::chrono::steady_clock::now();
+            transfer_request = map_client->async_send_request(
+                request,
+                [this](rclcpp::Client<TransferGolfballLocations>::SharedFuture future) {
+                    transfer_pending = false;
+                    if (!future.get()->success)
+                    {
+                        RCLCPP_WARN(get_logger(), "Navigation rejected the golf ball map");
+                        changed = true;
+                    }
+                }
+            ).request_id;
+        }
+};
+
+}  // namespace motion
+
+RCLCPP_COMPONENTS_REGISTER_NODE(motion::BallMapping)
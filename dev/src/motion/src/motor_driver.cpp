@@ -0,0 +1,434 @@
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+#include "geometry_msgs/msg/twist.hpp"
+#include "instrumentation/latency_reporter.hpp"
+#include "instrumentation/node_health.hpp"
+#include "motion/latest_slot.hpp"
+#include "motion/motor_protocol.hpp"
+#include "rclcpp/rclcpp.hpp"
+#include "rclcpp_components/register_node_macro.hpp"
+#include "std_msgs/msg/float32.hpp"
+
+#define ABS_MAX_PWM     255
+#define MAX_PWM         153
+#define MAX_MSEC        0.9144
+
+// How long the serial thread sleeps in epoll at most, so it notices missing acks and stops promptly.
+#define SERIAL_POLL_MS  100
+
+namespace motion
+{
+
+struct MotorCommand
+{
+    int16_t left, right;
+};
+
+// Drives the Arduino over the framed binary protocol in motion/motor_protocol.hpp. The ROS
+// callbacks never touch the port: they store the latest command and wake the serial thread,
+// which owns the port. It writes without blocking and reads acknowledgements as they arrive, both
+// through epoll. A burst of cmd_vel while a frame is still going out is coalesced, so the next
+// frame always carries the newest command.
+class MotorDriver : public rclcpp::Node
+{
+    private:
+        // ack is the time from writing a command to the board acknowledging it.
+        enum LatencyStage {
+            ACK_LATENCY = 0
+        };
+        // What the node's health is recorded under, see instrumentation/node_health.hpp. cmd_vel drops
+        // are commands superseded before they could be sent.
+        enum HealthCallback {
+            CMD_VEL_CALLBACK = 0,
+            BALL_RELEASE_CALLBACK
+        };
+
+        std::string port;
+        speed_t baud;
+        std::chrono::milliseconds reset_delay, ack_timeout;
+        LatestSlot<MotorCommand> command;
+        std::atomic<int16_t> draw_bridge;
+        std::unique_ptr<instrumentation::LatencyReporter> latency;
+        std::unique_ptr<instrumentation::NodeHealth> health;
+        rclcpp::Subscription<geometry_msgs::msg::Twist>::SharedPtr cmd_vel_subscriber;
+        rclcpp::Subscription<std_msgs::msg::Float32>::SharedPtr draw_bridge_subscriber;
+
+        // Everything below belongs to the serial thread.
+        int wake_fd, epoll_fd, serial_fd;
+        std::atomic<bool> running;
+        std::thread serial_thread;
+        MotorFrameParser parser;
+        uint8_t frame[MOTOR_MAX_FRAME_SIZE];
+        std::size_t frame_size, frame_written;
+        uint8_t sequence;
+        uint32_t sent_version;
+        int16_t sent_draw_bridge;
+        uint64_t coalesced_commands;
+        std::array<std::chrono::steady_clock::time_point, 256> sent_at;
+        std::chrono::steady_clock::time_point last_sent, last_acked;
+
+    public:
+        explicit MotorDriver(const rclcpp::NodeOptions &options = rclcpp::NodeOptions())
+        : Node("motor_driver", options), draw_bridge(0), wake_fd(-1), epoll_fd(-1), serial_fd(-1), running(true), frame_size(0),
+          frame_written(0), sequence(0), sent_version(0), sent_draw_bridge(0), coalesced_commands(0)
+        {
+            port = declare_parameter("port", std::string("/dev/ttyACM0"));
+            int baud_rate = declare_parameter("baud", 115200);
+            baud = baud_constant(baud_rate);
+            if (baud == B0)
+            {
+                RCLCPP_WARN(get_logger(), "Unsupported baud %d, using 115200", baud_rate);
+                baud = B115200;
+            }
+            // Opening the port resets the board; it ignores the link until its bootloader is done.
+            reset_delay = std::chrono::milliseconds(declare_parameter("reset_delay_ms", 5000));
+            // Warn when the board has not acknowledged anything for this long while commands are sent.
+            ack_timeout = std::chrono::milliseconds(declare_parameter("ack_timeout_ms", 200));
+
+            latency = std::make_unique<instrumentation::LatencyReporter>(this, std::vector<std::string>{"ack"});
+            health = std::make_unique<instrumentation::NodeHealth>(this, std::vector<std::string>{"cmd_vel", "ball_release"});
+
+            cmd_vel_subscriber = create_subscription<geometry_msgs::msg::Twist>(
+                "cmd_vel",
+                10,
+                std::bind(&MotorDriver::send_velocity, this, std::placeholders::_1)
+            );
+            draw_bridge_subscriber = create_subscription<std_msgs::msg::Float32>(
+                "ball_release",
+                // manual_control publishes changes and republishes the current state now and then.
+                10,
+                std::bind(&MotorDriver::ball_release, this, std::placeholders::_1)
+            );
+
+            wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+            epoll_event event{};
+            event.events = EPOLLIN;
+            event.data.fd = wake_fd;
+            epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &event);
+            serial_thread = std::thread(&MotorDriver::serial_loop, this);
+
+            RCLCPP_INFO(get_logger(), "%s node has started", get_name());
+        }
+
+        ~MotorDriver() override
+        {
+            running = false;
+            wake();
+            if (serial_thread.joinable())
+                serial_thread.join();
+
+            close_port();
+            close(epoll_fd);
+            close(wake_fd);
+        }
+
+    private:
+        void send_velocity(const geometry_msgs::msg::Twist::SharedPtr message)
+        {
+            instrumentation::CallbackTimer health_timer(health->callback(CMD_VEL_CALLBACK));
+            command.store(pwm(message->linear.x, message->angular.z));
+            wake();
+        }
+
+        void ball_release(const std_msgs::msg::Float32::SharedPtr message)
+        {
+            instrumentation::CallbackTimer health_timer(health->callback(BALL_RELEASE_CALLBACK));
+            draw_bridge = static_cast<int16_t>(ABS_MAX_PWM * message->data / 2);
+            wake();
+        }
+
+        void wake()
+        {
+            uint64_t one = 1;
+            ssize_t written = write(wake_fd, &one, sizeof(one));
+            (void)written;
+        }
+
+        static MotorCommand pwm(double linear, double angular)
+        {
+            double total_pwm, x;
+            if (linear != 0.0)
+            {
+                total_pwm = linear * MAX_PWM / MAX_MSEC;
+                x = angular * total_pwm / M_PI;
+            }
+            else
+            {
+                total_pwm = 0;
+                x = MAX_PWM * angular / M_PI;
+            }
+
+            long left_pwm = std::lround(total_pwm - x);
+            long right_pwm = std::lround(total_pwm + x);
+
+            // Saturating one side takes the excess off the other, so the turn is kept.
+            if (right_pwm > ABS_MAX_PWM)
+            {
+                left_pwm -= right_pwm - ABS_MAX_PWM;
+                right_pwm = ABS_MAX_PWM;
+            }
+            if (left_pwm > ABS_MAX_PWM)
+            {
+                right_pwm -= left_pwm - ABS_MAX_PWM;
+                left_pwm = ABS_MAX_PWM;
+            }
+
+            MotorCommand result;
+            result.left = static_cast<int16_t>(std::max<long>(-ABS_MAX_PWM, std::min<long>(ABS_MAX_PWM, left_pwm)));
+            result.right = static_cast<int16_t>(std::max<long>(-ABS_MAX_PWM, std::min<long>(ABS_MAX_PWM, right_pwm)));
+            return result;
+        }
+
+        static speed_t baud_constant(int baud_rate)
+        {
+            switch (baud_rate)
+            {
+                case 9600: return B9600;
+                case 19200: return B19200;
+                case 38400: return B38400;
+                case 57600: return B57600;
+                case 115200: return B115200;
+                case 230400: return B230400;
+                case 460800: return B460800;
+                case 921600: return B921600;
+                default: return B0;
+            }
+        }
+
+        void serial_loop()
+        {
+            health->add_current_thread("serial");
+            std::array<epoll_event, 4> events;
+            while (running)
+            {
+                if (serial_fd < 0 && !open_port())
+                {
+                    // Retry about once a second, still waking up promptly to stop.
+                    wait_for(std::chrono::seconds(1));
+                    continue;
+                }
+
+                int count = epoll_wait(epoll_fd, events.data(), events.size(), SERIAL_POLL_MS);
+                if (count < 0 && errno != EINTR)
+                {
+                    RCLCPP_ERROR(get_logger(), "epoll_wait failed: %s", std::strerror(errno));
+                    return;
+                }
+
+                for (int i = 0; i < count; i++)
+                {
+                    if (events[i].data.fd == wake_fd)
+                    {
+                        uint64_t wakes;
+                        ssize_t got = read(wake_fd, &wakes, sizeof(wakes));
+                        (void)got;
+                        continue;
+                    }
+
+                    if (events[i].events & (EPOLLERR | EPOLLHUP))
+                    {
+                        RCLCPP_WARN(get_logger(), "Lost %s, reconnecting", port.c_str());
+                        close_port();
+                        break;
+                    }
+                    if (events[i].events & EPOLLIN)
+                        read_acks();
+                }
+
+                if (serial_fd >= 0)
+                {
+                    queue_latest_command();
+                    flush();
+                    check_acks();
+                }
+            }
+        }
+
+        // Sleeps until timeout or a wake-up.
+        void wait_for(std::chrono::milliseconds timeout)
+        {
+            epoll_event event;
+            if (epoll_wait(epoll_fd, &event, 1, static_cast<int>(timeout.count())) > 0)
+            {
+                uint64_t wakes;
+                ssize_t got = read(wake_fd, &wakes, sizeof(wakes));
+                (void)got;
+            }
+        }
+
+        bool open_port()
+        {
+            int fd = open(port.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+            if (fd < 0)
+            {
+                RCLCPP_WARN_THROTTLE(get_logger(), *get_clock(), 10000, "Cannot open %s: %s", port.c_str(), std::strerror(errno));
+                return false;
+            }
+
+            termios options;
+            if (tcgetattr(fd, &options) != 0)
+            {
+                close(fd);
+                return false;
+            }
+            cfmakeraw(&options);
+            cfsetispeed(&options, baud);
+            cfsetospeed(&options, baud);
+            options.c_cflag |= CLOCAL | CREAD;
+            options.c_cc[VMIN] = 0;
+            options.c_cc[VTIME] = 0;
+            if (tcsetattr(fd, TCSANOW, &options) != 0)
+            {
+                RCLCPP_WARN(get_logger(), "Cannot configure %s: %s", port.c_str(), std::strerror(errno));
+                close(fd);
+                return false;
+            }
+
+            auto deadline = std::chrono::steady_clock::now() + reset_delay;
+            while (running && std::chrono::steady_clock::now() < deadline)
+                wait_for(std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()));
+            tcflush(fd, TCIOFLUSH);
+
+            serial_fd = fd;
+            epoll_event event{};
+            event.events = EPOLLIN;
+            event.data.fd = serial_fd;
+            epoll_ctl(epoll_fd, EPOLL_CTL_ADD, serial_fd, &event);
+
+            parser = MotorFrameParser();
+            frame_size = frame_written = 0;
+            // Whatever was commanded while disconnected is sent straight away.
+            sent_version = 0;
+            last_sent = last_acked = std::chrono::steady_clock::now();
+            RCLCPP_INFO(get_logger(), "Connected to %s", port.c_str());
+            return true;
+        }
+
+        void close_port()
+        {
+            if (serial_fd < 0)
+                return;
+
+            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, serial_fd, nullptr);
+            close(serial_fd);
+            serial_fd = -1;
+        }
+
+        // Builds the next frame from the newest command, unless a frame is still being written or
+        // nothing has changed since the last one.
+        void queue_latest_command()
+        {
+            if (frame_written < frame_size)
+                return;
+
+            MotorCommand latest{0, 0};
+            uint32_t version = command.load(latest);
+            int16_t bridge = draw_bridge;
+            if (version == 0 || (version == sent_version && bridge == sent_draw_bridge))
+                return;
+
+            if (sent_version != 0 && version - sent_version > 1)
+            {
+                coalesced_commands += version - sent_version - 1;
+                health->callback(CMD_VEL_CALLBACK).record_dropped(version - sent_version - 1);
+                RCLCPP_DEBUG(get_logger(), "%llu command(s) superseded before they were sent", static_cast<unsigned long long>(coalesced_commands));
+            }
+
+            sequence++;
+            frame_size = encode_motor_command(sequence, latest.left, latest.right, bridge, frame);
+            frame_written = 0;
+            sent_version = version;
+            sent_draw_bridge = bridge;
+            last_sent = sent_at[sequence] = std::chrono::steady_clock::now();
+        }
+
+        // Writes as much of the frame as the port takes and waits for EPOLLOUT for the rest.
+        void flush()
+        {
+            while (frame_written < frame_size)
+            {
+                ssize_t written = write(serial_fd, frame + frame_written, frame_size - frame_written);
+                if (written > 0)
+                {
+                    frame_written += written;
+                    continue;
+                }
+                if (written < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                {
+                    RCLCPP_WARN(get_logger(), "Writing to %s failed: %s", port.c_str(), std::strerror(errno));
+                    close_port();
+                    return;
+                }
+                break;
+            }
+
+            epoll_event event{};
+            event.events = EPOLLIN | (frame_written < frame_size ? EPOLLOUT : 0);
+            event.data.fd = serial_fd;
+            epoll_ctl(epoll_fd, EPOLL_CTL_MOD, serial_fd, &event);
+        }
+
+        void read_acks()
+        {
+            uint8_t buffer[256];
+            ssize_t got;
+            while ((got = read(serial_fd, buffer, sizeof(buffer))) > 0)
+            {
+                MotorFrame ack;
+                for (ssize_t i = 0; i < got; i++)
+                {
+                    if (parser.push(buffer[i], ack))
+                        handle_ack(ack);
+                }
+            }
+        }
+
+        void handle_ack(const MotorFrame &ack)
+        {
+            if (ack.type != MOTOR_ACK_FRAME || ack.length < MOTOR_ACK_PAYLOAD)
+                return;
+
+            uint8_t acked = ack.payload[0];
+            uint8_t status = ack.payload[1];
+            if (status != 0)
+                RCLCPP_WARN_THROTTLE(get_logger(), *get_clock(), 1000, "Board rejected command %u with status %u", acked, status);
+
+            auto now = std::chrono::steady_clock::now();
+            last_acked = now;
+            // Only recent sequence numbers map to a send time; older ones have wrapped around.
+            if (static_cast<uint8_t>(sequence - acked) < 128)
+                latency->record(ACK_LATENCY, now - sent_at[acked]);
+        }
+
+        void check_acks()
+        {
+            if (last_sent - last_acked > ack_timeout)
+            {
+                RCLCPP_WARN_THROTTLE(
+                    get_logger(),
+                    *get_clock(),
+                    1000,
+                    "No acknowledgement from the board for %lld ms, CRC errors so far: %llu",
+                    static_cast<long long>(std::chrono::duration_cast<std::chrono::milliseconds>(last_sent - last_acked).count()),
+                    static_cast<unsigned long long>(parser.errors())
+                );
+            }
+        }
+};
+
+}  // namespace motion
+
+RCLCPP_COMPONENTS_REGISTER_NODE(motion::MotorDriver)
@@ -0,0 +1,101 @@
+#include "motion/motor_protocol.hpp"
+
+namespace motion
+{
+
+uint16_t crc16_ccitt(const uint8_t *data, std::size_t size, uint16_t crc)
+{
+    for (std::size_t i = 0; i < size; i++)
+    {
+        crc ^= static_cast<uint16_t>(data[i]) << 8;
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc & 0x8000) ? static_cast<uint16_t>((crc << 1) ^ 0x1021) : static_cast<uint16_t>(crc << 1);
+    }
+
+    return crc;
+}
+
+static void put_int16(uint8_t *out, int16_t value)
+{
+    uint16_t bits = static_cast<uint16_t>(value);
+    out[0] = bits & 0xFF;
+    out[1] = bits >> 8;
+}
+
+std::size_t encode_motor_command(uint8_t sequence, int16_t left, int16_t right, int16_t draw_bridge, uint8_t *out)
+{
+    out[0] = MOTOR_FRAME_START;
+    out[1] = MOTOR_COMMAND_FRAME;
+    out[2] = sequence;
+    out[3] = MOTOR_COMMAND_PAYLOAD;
+    put_int16(out + 4, left);
+    put_int16(out + 6, right);
+    put_int16(out + 8, draw_bridge);
+
+    // The start byte is not covered.
+    uint16_t crc = crc16_ccitt(out + 1, MOTOR_FRAME_HEADER_SIZE - 1 + MOTOR_COMMAND_PAYLOAD);
+    std::size_t size = MOTOR_FRAME_HEADER_SIZE + MOTOR_COMMAND_PAYLOAD;
+    out[size] = crc & 0xFF;
+    out[size + 1] = crc >> 8;
+    return size + MOTOR_FRAME_CRC_SIZE;
+}
+
+MotorFrameParser::MotorFrameParser() : state(State::START), frame{}, received(0), crc(0xFFFF), crc_low(0), crc_errors(0)
+{
+}
+
+bool MotorFrameParser::push(uint8_t byte, MotorFrame &out)
+{
+    switch (state)
+    {
+        case State::START:
+            if (byte == MOTOR_FRAME_START)
+            {
+                crc = 0xFFFF;
+                state = State::TYPE;
+            }
+            return false;
+        case State::TYPE:
+            frame.type = byte;
+            state = State::SEQUENCE;
+            break;
+        case State::SEQUENCE:
+            frame.sequence = byte;
+            state = State::LENGTH;
+            break;
+        case State::LENGTH:
+            if (byte > MOTOR_MAX_PAYLOAD)
+            {
+                crc_errors++;
+                state = State::START;
+                return false;
+            }
+            frame.length = byte;
+            received = 0;
+            state = byte == 0 ? State::CRC_LOW : State::PAYLOAD;
+            break;
+        case State::PAYLOAD:
+            frame.payload[received++] = byte;
+            if (received == frame.length)
+                state = State::CRC_LOW;
+            break;
+        case State::CRC_LOW:
+            crc_low = byte;
+            state = State::CRC_HIGH;
+            return false;
+        case State::CRC_HIGH:
+            state = State::START;
+            if ((static_cast<uint16_t>(byte) << 8 | crc_low) != crc)
+            {
+                crc_errors++;
+                return false;
+            }
+            out = frame;
+            return true;
+    }
+
+    crc = crc16_ccitt(&byte, 1, crc);
+    return false;
+}
+
+}  // namespace motion
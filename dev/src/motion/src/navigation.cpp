@@ -1,25 +1,100 @@
+#include <algorithm>
 #include <climits>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <vector>
 
 #include "custom_interfaces/msg/image_data.hpp"
 #include "custom_interfaces/msg/manual_control.hpp"
+#include "custom_interfaces/srv/transfer_golfball_locations.hpp"
 #include "geometry_msgs/msg/twist.hpp"
+#include "instrumentation/latency_reporter.hpp"
+#include "instrumentation/node_health.hpp"
+#include "motion/ball_map.hpp"
+#include "motion/latest_slot.hpp"
+#include "motion/robot_pose.hpp"
+#include "motion/tour_planner.hpp"
+#include "nav_msgs/msg/odometry.hpp"
 #include "rclcpp/rclcpp.hpp"
+#include "rclcpp_components/register_node_macro.hpp"
 
 #define NO_BALL_IN_VIEW             -180
 #define NO_EDGE                     INT_MAX
 #define ANGULAR_VELOCITY_FACTOR     -0.01
 #define MAX_SPEED                   0.91
+// Steering towards a known ball: angular velocity per radian of heading error, and the heading
+// error below which the robot also drives forward.
+#define KNOWN_BALL_TURN_GAIN        1.5
+#define KNOWN_BALL_DRIVE_HEADING    0.35
 
+namespace motion
+{
+
+// What the controller needs from the latest ImageData.
+struct Perception
+{
+    int32_t ball_position, corner_position;
+    // Capture stamp of the frame (0 if unstamped) and when the result arrived, in ROS time.
+    int64_t capture_ns, received_ns;
+};
+
+struct ManualCommand
+{
+    bool stop, manual;
+    float linear_percentage, angular_percentage;
+};
 
 class Navigation : public rclcpp::Node
 {
     private:
-        // Determines if manual control is enabled / if we need to stop.
-        bool manual_control, stop;
+        // Written by their subscriptions, read by the control timer.
+        LatestSlot<Perception> perception;
+        LatestSlot<ManualCommand> manual_command;
+        LatestSlot<RobotPose> pose;
+        uint32_t last_perception_version;
+        // Balls seen earlier, as sent by ball_map. Only used from the control group.
+        BallMap known_balls;
+        // With planned collection, the order the known balls are collected in, ending at dropoff.
+        bool planned_collection;
+        TourPlanner tour_planner;
+        TourPoint dropoff;
+        double pickup_radius;
+        std::chrono::nanoseconds plan_budget;
+        rclcpp::Duration max_pose_age;
+        // Vision results and odometry are stored from their own group, so they never wait behind the
+        // controller. Joystick overrides and the ball map are handled in the control group, where
+        // joystick overrides are applied at once.
+        rclcpp::CallbackGroup::SharedPtr control_group, vision_group;
+        rclcpp::TimerBase::SharedPtr control_timer;
         rclcpp::Publisher<geometry_msgs::msg::Twist>::SharedPtr velocity_publisher;
         rclcpp::Subscription<custom_interfaces::msg::ImageData>::SharedPtr image_data_subscriber;
         rclcpp::Subscription<custom_interfaces::msg::ManualControl>::SharedPtr manual_control_subscriber;
+        rclcpp::Subscription<nav_msgs::msg::Odometry>::SharedPtr odometry_subscriber;
+        rclcpp::Service<custom_interfaces::srv::TransferGolfballLocations>::SharedPtr golfball_map_service;
         rclcpp::Time time_since_last_seen;
+        // With no ImageData newer than this (by its capture stamp, or arrival if unstamped) the robot is
+        // stopped until perception recovers.
+        rclcpp::Duration max_data_age;
+        bool watchdog_stopped;
+        uint64_t watchdog_stops;
+        // control is the time spent in control_loop; end_to_end is capture to cmd_vel; teleop is
+        // joystick input to cmd_vel.
+        enum LatencyStage {
+            CONTROL_LATENCY = 0,
+            END_TO_END_LATENCY,
+            TELEOP_LATENCY
+        };
+        std::unique_ptr<instrumentation::LatencyReporter> latency;
+        // What the node's health is recorded under, see instrumentation/node_health.hpp.
+        enum HealthCallback {
+            CONTROL_CALLBACK = 0,
+            IMAGE_DATA_CALLBACK,
+            ODOMETRY_CALLBACK,
+            MANUAL_CONTROL_CALLBACK,
+            GOLFBALL_MAP_CALLBACK
+        };
+        std::unique_ptr<instrumentation::NodeHealth> health;
         enum TurnDirection {
             LEFT = 1,
             STRAIGHT = 0,
@@ -27,61 +102,289 @@ class Navigation : public rclcpp::Node
         };
 
     public:
-        Navigation() : Node("navigation")
+        explicit Navigation(const rclcpp::NodeOptions &options = rclcpp::NodeOptions())
+        : Node("navigation", options), last_perception_version(0), known_balls(BallMapConfig{0.5, 0.0, 1}),
+          planned_collection(false), dropoff{0.0, 0.0}, pickup_radius(0.2), plan_budget(0), max_pose_age(0, 0),
+          max_data_age(0, 0), watchdog_stopped(false), watchdog_stops(0)
         {
-            manual_control = false;
-            stop = false;
             time_since_last_seen = rclcpp::Time(1000000);
+            max_data_age = rclcpp::Duration(std::chrono::milliseconds(declare_parameter("max_data_age_ms", 150)));
+            latency = std::make_unique<instrumentation::LatencyReporter>(
+                this,
+                std::vector<std::string>{"control", "end_to_end", "teleop"}
+            );
+            health = std::make_unique<instrumentation::NodeHealth>(
+                this,
+                std::vector<std::string>{"control", "image_data", "odom", "navigation_control", "golfball_map"}
+            );
+
+            control_group = create_callback_group(rclcpp::CallbackGroupType::MutuallyExclusive);
+            vision_group = create_callback_group(rclcpp::CallbackGroupType::MutuallyExclusive);
+            rclcpp::SubscriptionOptions vision_options, joystick_options;
+            vision_options.callback_group = vision_group;
+            joystick_options.callback_group = control_group;
 
             velocity_publisher = create_publisher<geometry_msgs::msg::Twist>(
                 "cmd_vel",
                 10
             );
             
+            // Only steer on the newest result; must match image_processing's freshest_only.
+            bool freshest_only = declare_parameter("freshest_only", true);
             image_data_subscriber = create_subscription<custom_interfaces::msg::ImageData>(
                 "image_data",
-                5,
-                std::bind(&Navigation::control_loop, this, std::placeholders::_1)
+                freshest_only ? rclcpp::QoS(1).best_effort() : rclcpp::QoS(5),
+                std::bind(&Navigation::store_perception, this, std::placeholders::_1),
+                vision_options
             );
             manual_control_subscriber = create_subscription<custom_interfaces::msg::ManualControl>(
                 "navigation_control",
+                // manual_control publishes changes and republishes the current state now and then.
                 10,
-                std::bind(&Navigation::joy_control_handler, this, std::placeholders::_1)
+                std::bind(&Navigation::joy_control_handler, this, std::placeholders::_1),
+                joystick_options
+            );
+
+            // Once no ball has been in view for a while, the robot turns to and drives at the nearest ball
+            // in the map ball_map sends, as long as its odometry is no older than max_pose_age_ms.
+            max_pose_age = rclcpp::Duration(std::chrono::milliseconds(declare_parameter("max_pose_age_ms", 200)));
+            odometry_subscriber = create_subscription<nav_msgs::msg::Odometry>(
+                declare_parameter("odom_topic", std::string("odom")),
+                10,
+                std::bind(&Navigation::store_pose, this, std::placeholders::_1),
+                vision_options
+            );
+            golfball_map_service = create_service<custom_interfaces::srv::TransferGolfballLocations>(
+                "golfball_map",
+                std::bind(&Navigation::replace_known_balls, this, std::placeholders::_1, std::placeholders::_2),
+                rmw_qos_profile_services_default,
+                control_group
+            );
+
+            // collection_mode "planned" collects the known balls in the order of a short path from the
+            // robot through all of them to the drop-off at (dropoff_x, dropoff_y) in the odometry frame,
+            // which starts in the drop-off area as the robot does. A ball within pickup_radius_m counts
+            // as collected. "reactive" only drives at the nearest one once nothing is in view.
+            std::string collection_mode = declare_parameter("collection_mode", std::string("reactive"));
+            planned_collection = collection_mode == "planned";
+            if (!planned_collection && collection_mode != "reactive")
+                RCLCPP_WARN(get_logger(), "Unknown collection_mode %s, using reactive", collection_mode.c_str());
+            dropoff.x = declare_parameter("dropoff_x", 0.0);
+            dropoff.y = declare_parameter("dropoff_y", 0.0);
+            pickup_radius = declare_parameter("pickup_radius_m", 0.2);
+
+            // cmd_vel is published at exactly this rate, whatever the camera does, so the Arduino link
+            // always has a fresh command. It is timed on the node's clock, like the watchdog, so that in
+            // simulation both keep pace with simulated time.
+            double control_rate = declare_parameter("control_rate_hz", 20.0);
+            if (control_rate <= 0.0)
+            {
+                RCLCPP_WARN(get_logger(), "control_rate_hz must be positive, using 20");
+                control_rate = 20.0;
+            }
+            // The plan is improved for at most this share of each control period and carries on in the next.
+            plan_budget = std::chrono::nanoseconds(static_cast<int64_t>(0.4e9 / control_rate));
+            control_timer = rclcpp::create_timer(
+                this,
+                get_clock(),
+                rclcpp::Duration(std::chrono::nanoseconds(static_cast<int64_t>(1e9 / control_rate))),
+                std::bind(&Navigation::control_loop, this),
+                control_group
             );
 
             RCLCPP_INFO(get_logger(), "%s node has started", get_name());
         }
 
     private:
-        void control_loop(const custom_interfaces::msg::ImageData::SharedPtr image_data)
+        void store_perception(const custom_interfaces::msg::ImageData::SharedPtr image_data)
         {
-            if (stop)
+            instrumentation::CallbackTimer health_timer(health->callback(IMAGE_DATA_CALLBACK));
+            rclcpp::Time capture_time(image_data->header.stamp, get_clock()->get_clock_type());
+
+            Perception latest;
+            latest.ball_position = image_data->ball_position;
+            latest.corner_position = image_data->corner_position;
+            latest.capture_ns = capture_time.nanoseconds();
+            latest.received_ns = now().nanoseconds();
+            perception.store(latest);
+        }
+
+        void control_loop()
+        {
+            instrumentation::StageTimer timer(*latency, CONTROL_LATENCY);
+            instrumentation::CallbackTimer health_timer(health->callback(CONTROL_CALLBACK));
+
+            ManualCommand command{false, false, 0.0f, 0.0f};
+            manual_command.load(command);
+            if (command.stop)
             {
                 publish_velocity();
+                return;
             }
-            else if (manual_control)
+            if (command.manual)
             {
-                // method that receives manual control calls publish_velocity()
+                publish_velocity(MAX_SPEED * command.linear_percentage, command.angular_percentage);
                 return;
             }
-            else if (image_data->ball_position == NO_BALL_IN_VIEW)
+
+            Perception latest;
+            uint32_t version = perception.load(latest);
+            rclcpp::Time time = now();
+            if (!check_watchdog(version, latest, time))
             {
-                double seconds = now().seconds() - time_since_last_seen.seconds();
-                if (seconds > 1.5 && seconds < 9.0)
+                publish_velocity();
+                return;
+            }
+
+            // Tape always wins, so the robot never follows the map off the range.
+            if (planned_collection && latest.corner_position == NO_EDGE && follow_plan(time))
+            {
+            }
+            else if (latest.ball_position == NO_BALL_IN_VIEW)
+            {
+                double seconds = time.seconds() - time_since_last_seen.seconds();
+                if (seconds > 1.5 && latest.corner_position == NO_EDGE && steer_to_known_ball(time))
+                {
+                }
+                else if (seconds > 1.5 && seconds < 9.0)
                 {
                     publish_velocity(0, 1);
                 }
                 else
                 {
-                    TurnDirection direction = determine_direction(image_data->corner_position);
+                    TurnDirection direction = determine_direction(latest.corner_position);
                     publish_velocity(direction == STRAIGHT ? MAX_SPEED : 0, direction);
                 }
             }
             else
             {
-                time_since_last_seen = now();
-                publish_velocity(0.8 * MAX_SPEED, image_data->ball_position * ANGULAR_VELOCITY_FACTOR);
+                time_since_last_seen = time;
+                publish_velocity(0.8 * MAX_SPEED, latest.ball_position * ANGULAR_VELOCITY_FACTOR);
+            }
+
+            // End to end is measured once per result, on the first command steered from it.
+            if (version != last_perception_version && latest.capture_ns != 0)
+                latency->record(END_TO_END_LATENCY, std::chrono::nanoseconds((now() - rclcpp::Time(latest.capture_ns, time.get_clock_type())).nanoseconds()));
+            last_perception_version = version;
+        }
+
+        // Returns false, logging the transition, while there is no ImageData recent enough to steer on.
+        bool check_watchdog(uint32_t version, const Perception &latest, const rclcpp::Time &time)
+        {
+            bool fresh = version != 0;
+            if (fresh && max_data_age.nanoseconds() > 0)
+            {
+                int64_t reference_ns = latest.capture_ns != 0 ? latest.capture_ns : latest.received_ns;
+                fresh = time.nanoseconds() - reference_ns <= max_data_age.nanoseconds();
+            }
+
+            if (!fresh && !watchdog_stopped)
+            {
+                watchdog_stops++;
+                RCLCPP_WARN(
+                    get_logger(),
+                    "No image data newer than %ld ms, stopping (%llu time(s) so far)",
+                    static_cast<long>(max_data_age.nanoseconds() / 1000000), static_cast<unsigned long long>(watchdog_stops)
+                );
+            }
+            else if (fresh && watchdog_stopped)
+            {
+                RCLCPP_INFO(get_logger(), "Image data is fresh again, resuming");
             }
+
+            watchdog_stopped = !fresh;
+            return fresh;
+        }
+
+        void store_pose(const nav_msgs::msg::Odometry::SharedPtr odometry)
+        {
+            instrumentation::CallbackTimer health_timer(health->callback(ODOMETRY_CALLBACK));
+            const auto &orientation = odometry->pose.pose.orientation;
+            RobotPose latest;
+            latest.x = odometry->pose.pose.position.x;
+            latest.y = odometry->pose.pose.position.y;
+            latest.yaw = yaw_from_quaternion(orientation.x, orientation.y, orientation.z, orientation.w);
+            latest.stamp_ns = rclcpp::Time(odometry->header.stamp, get_clock()->get_clock_type()).nanoseconds();
+            if (latest.stamp_ns == 0)
+                latest.stamp_ns = now().nanoseconds();
+            pose.store(latest);
+        }
+
+        void replace_known_balls(
+            const std::shared_ptr<custom_interfaces::srv::TransferGolfballLocations::Request> request,
+            std::shared_ptr<custom_interfaces::srv::TransferGolfballLocations::Response> response)
+        {
+            instrumentation::CallbackTimer health_timer(health->callback(GOLFBALL_MAP_CALLBACK));
+            if (request->xs.size() != request->ys.size() || request->xs.size() != request->names.size())
+            {
+                response->success = false;
+                return;
+            }
+
+            known_balls.clear();
+            int64_t stamp_ns = now().nanoseconds();
+            std::vector<TourPoint> balls;
+            balls.reserve(request->xs.size());
+            for (std::size_t i = 0; i < request->xs.size(); i++)
+            {
+                known_balls.add(request->xs[i], request->ys[i], stamp_ns);
+                balls.push_back(TourPoint{request->xs[i], request->ys[i]});
+            }
+            // Balls still in the map keep their place in the plan, so this is cheap to repeat.
+            if (planned_collection)
+                tour_planner.set_balls(request->names, balls);
+            response->success = true;
+        }
+
+        // The latest pose, if it is recent enough to steer by.
+        bool fresh_pose(const rclcpp::Time &time, RobotPose &latest)
+        {
+            return pose.load(latest) != 0 && time.nanoseconds() - latest.stamp_ns <= max_pose_age.nanoseconds();
+        }
+
+        // Publishes a command towards the nearest known ball. False, publishing nothing, without a
+        // recent pose or a known ball.
+        bool steer_to_known_ball(const rclcpp::Time &time)
+        {
+            RobotPose latest;
+            MappedBall ball;
+            if (!fresh_pose(time, latest) || !known_balls.nearest(latest.x, latest.y, ball))
+                return false;
+
+            steer_towards(latest, ball.x, ball.y);
+            return true;
+        }
+
+        // Replans from where the robot is and publishes a command towards the next ball of the plan.
+        // False, publishing nothing, without a recent pose or with no balls left.
+        bool follow_plan(const rclcpp::Time &time)
+        {
+            RobotPose latest;
+            if (!fresh_pose(time, latest) || tour_planner.size() == 0)
+                return false;
+
+            tour_planner.set_endpoints(TourPoint{latest.x, latest.y}, dropoff);
+            tour_planner.improve(plan_budget);
+
+            // ball_map drops collected balls too, but only on its next transfer.
+            TourPoint ball;
+            std::string name;
+            while (tour_planner.next(ball, name) && std::hypot(ball.x - latest.x, ball.y - latest.y) < pickup_radius)
+                tour_planner.pop_next();
+            if (!tour_planner.next(ball, name))
+                return false;
+
+            steer_towards(latest, ball.x, ball.y);
+            return true;
+        }
+
+        void steer_towards(const RobotPose &latest, double x, double y)
+        {
+            // Positive is to the left, as is positive angular velocity.
+            double heading_error = wrap_angle(std::atan2(y - latest.y, x - latest.x) - latest.yaw);
+            double angular = std::max(-1.0, std::min(1.0, KNOWN_BALL_TURN_GAIN * heading_error));
+            double linear = std::fabs(heading_error) < KNOWN_BALL_DRIVE_HEADING ? 0.8 * MAX_SPEED : 0.0;
+            publish_velocity(linear, angular);
         }
 
         TurnDirection determine_direction(int corner_position)
@@ -94,43 +397,47 @@ class Navigation : public rclcpp::Node
 
         void publish_velocity(double linear = 0, double angular = 0)
         {
-            auto message = geometry_msgs::msg::Twist();
-            message.linear.x = linear;
-            message.angular.z = angular;
-            velocity_publisher->publish(message);
+            // Published as a unique_ptr so that within a container the motor driver receives this very
+            // message rather than a copy.
+            auto message = std::make_unique<geometry_msgs::msg::Twist>();
+            message->linear.x = linear;
+            message->angular.z = angular;
+            velocity_publisher->publish(std::move(message));
         }
 
+        // Applies the command at once instead of on the next tick, so a stop is not up to a control
+        // period late. It shares the control group with the timer, so the two never interleave.
         void joy_control_handler(const custom_interfaces::msg::ManualControl::SharedPtr message)
         {
+            instrumentation::CallbackTimer health_timer(health->callback(MANUAL_CONTROL_CALLBACK));
+            ManualCommand command{false, false, 0.0f, 0.0f};
             if (message->stop)
             {
-                stop = true;
-                manual_control = false;
+                command.stop = true;
             }
             else
             {
                 float linear_percentage = message->linear_percentage;
                 float angular_percentage = message->angular_percentage;
 
-                if (abs(linear_percentage) < 1.0e-6 && abs(angular_percentage) < 1.0e-6)
-                {
-                    stop = false;
-                    manual_control = false;
-                }
-                else
+                // Both near zero hands control back to vision.
+                if (std::fabs(linear_percentage) >= 1.0e-6 || std::fabs(angular_percentage) >= 1.0e-6)
                 {
-                    stop = false;
-                    manual_control = true;
-                    publish_velocity(MAX_SPEED * linear_percentage, angular_percentage);
+                    command.manual = true;
+                    command.linear_percentage = linear_percentage;
+                    command.angular_percentage = angular_percentage;
                 }
             }
+
+            manual_command.store(command);
+            control_loop();
+
+            rclcpp::Time input_time(message->header.stamp, get_clock()->get_clock_type());
+            if (input_time.nanoseconds() != 0)
+                latency->record(TELEOP_LATENCY, std::chrono::nanoseconds((now() - input_time).nanoseconds()));
         }
 };
 
-int main(int argc, char **argv)
-{
-    rclcpp::init(argc, argv);
-    rclcpp::spin(std::make_shared<Navigation>());
-    rclcpp::shutdown();
-    return 0;
-}
+}  // namespace motion
+
+RCLCPP_COMPONENTS_REGISTER_NODE(motion::Navigation)
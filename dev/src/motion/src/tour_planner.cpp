@@ -0,0 +1,506 @@
+#include "motion/tour_planner.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+#define START_NODE 0
+#define END_NODE 1
+#define FIRST_BALL_NODE 2
+#define NO_NODE UINT32_MAX
+// Smallest gain a 2-opt move needs, so rounding cannot make two moves undo each other forever.
+#define MIN_GAIN 1.0e-9
+// Balls per grid cell on average.
+#define BALLS_PER_CELL 2.0
+
+namespace motion
+{
+
+void TourPlanner::Grid::build(const std::vector<TourPoint> &points)
+{
+    std::size_t balls = points.size() - FIRST_BALL_NODE;
+    double max_x, max_y;
+    min_x = min_y = 0.0;
+    max_x = max_y = 1.0;
+    if (balls > 0)
+    {
+        min_x = max_x = points[FIRST_BALL_NODE].x;
+        min_y = max_y = points[FIRST_BALL_NODE].y;
+        for (std::size_t node = FIRST_BALL_NODE; node < points.size(); node++)
+        {
+            min_x = std::min(min_x, points[node].x);
+            max_x = std::max(max_x, points[node].x);
+            min_y = std::min(min_y, points[node].y);
+            max_y = std::max(max_y, points[node].y);
+        }
+    }
+
+    double area = std::max(max_x - min_x, 1.0e-3) * std::max(max_y - min_y, 1.0e-3);
+    size = std::max(std::sqrt(area * BALLS_PER_CELL / std::max<std::size_t>(balls, 1)), 1.0e-3);
+    columns = static_cast<int>((max_x - min_x) / size) + 1;
+    rows = static_cast<int>((max_y - min_y) / size) + 1;
+
+    // Counting sort of the balls by cell.
+    std::size_t cells = static_cast<std::size_t>(columns) * rows;
+    cell_begin.assign(cells + 1, 0);
+    for (std::size_t node = FIRST_BALL_NODE; node < points.size(); node++)
+        cell_begin[row(points[node].y) * columns + column(points[node].x) + 1]++;
+    for (std::size_t cell = 0; cell < cells; cell++)
+        cell_begin[cell + 1] += cell_begin[cell];
+
+    cell_end.assign(cell_begin.begin(), cell_begin.end() - 1);
+    items.resize(balls);
+    slot.assign(points.size(), 0);
+    for (std::size_t node = FIRST_BALL_NODE; node < points.size(); node++)
+    {
+        std::size_t cell = row(points[node].y) * columns + column(points[node].x);
+        slot[node] = cell_end[cell];
+        items[cell_end[cell]++] = static_cast<uint32_t>(node);
+    }
+}
+
+int TourPlanner::Grid::column(double x) const
+{
+    return std::max(0, std::min(columns - 1, static_cast<int>(std::floor((x - min_x) / size))));
+}
+
+int TourPlanner::Grid::row(double y) const
+{
+    return std::max(0, std::min(rows - 1, static_cast<int>(std::floor((y - min_y) / size))));
+}
+
+void TourPlanner::Grid::remove(uint32_t node, const TourPoint &point)
+{
+    std::size_t cell = row(point.y) * columns + column(point.x);
+    uint32_t last = items[--cell_end[cell]];
+    std::swap(items[slot[node]], items[cell_end[cell]]);
+    slot[last] = slot[node];
+    slot[node] = cell_end[cell];
+}
+
+template <typename F>
+bool TourPlanner::Grid::visit_ring(int center_column, int center_row, int ring, F visit) const
+{
+    if (center_column - ring < 0 && center_column + ring >= columns && center_row - ring < 0 && center_row + ring >= rows)
+        return false;
+
+    auto visit_cell = [&](int cell_column, int cell_row) {
+        if (cell_column < 0 || cell_column >= columns || cell_row < 0 || cell_row >= rows)
+            return;
+
+        std::size_t cell = static_cast<std::size_t>(cell_row) * columns + cell_column;
+        for (uint32_t i = cell_begin[cell]; i < cell_end[cell]; i++)
+            visit(items[i]);
+    };
+
+    if (ring == 0)
+    {
+        visit_cell(center_column, center_row);
+        return true;
+    }
+
+    for (int c = std::max(center_column - ring, 0); c <= std::min(center_column + ring, columns - 1); c++)
+    {
+        visit_cell(c, center_row - ring);
+        visit_cell(c, center_row + ring);
+    }
+    for (int r = std::max(center_row - ring + 1, 0); r <= std::min(center_row + ring - 1, rows - 1); r++)
+    {
+        visit_cell(center_column - ring, r);
+        visit_cell(center_column + ring, r);
+    }
+
+    return true;
+}
+
+TourPlanner::TourPlanner(const TourPlannerConfig &config)
+: config(config), points(FIRST_BALL_NODE, TourPoint{0.0, 0.0}), tour{START_NODE, END_NODE}, position{0, 1}
+{
+    this->config.neighbours = std::max(1, this->config.neighbours);
+    neighbours.assign(points.size() * this->config.neighbours, NO_NODE);
+    queued.assign(points.size(), false);
+    grid.build(points);
+}
+
+double TourPlanner::distance(uint32_t a, uint32_t b) const
+{
+    return std::hypot(points[a].x - points[b].x, points[a].y - points[b].y);
+}
+
+void TourPlanner::activate(uint32_t node)
+{
+    if (!queued[node])
+    {
+        queued[node] = true;
+        active.push_back(node);
+    }
+}
+
+// The config.neighbours nearest balls to point other than self, nearest first, padded with NO_NODE.
+void TourPlanner::nearest_balls(const TourPoint &point, uint32_t self, uint32_t *out) const
+{
+    std::size_t k = config.neighbours;
+    // Max-heap on distance of the best k so far.
+    std::vector<std::pair<double, uint32_t>> best;
+    best.reserve(k + 1);
+    int column = grid.column(point.x), row = grid.row(point.y);
+    for (int ring = 0;; ring++)
+    {
+        double bound = grid.ring_bound(ring);
+        if (best.size() == k && best.front().first <= bound * bound)
+            break;
+
+        bool inside = grid.visit_ring(column, row, ring, [&](uint32_t node) {
+            if (node == self)
+                return;
+
+            double dx = points[node].x - point.x, dy = points[node].y - point.y;
+            double squared = dx * dx + dy * dy;
+            if (best.size() < k)
+            {
+                best.emplace_back(squared, node);
+                std::push_heap(best.begin(), best.end());
+            }
+            else if (squared < best.front().first)
+            {
+                std::pop_heap(best.begin(), best.end());
+                best.back() = std::make_pair(squared, node);
+                std::push_heap(best.begin(), best.end());
+            }
+        });
+        if (!inside)
+            break;
+    }
+
+    std::sort_heap(best.begin(), best.end());
+    for (std::size_t j = 0; j < k; j++)
+        out[j] = j < best.size() ? best[j].second : NO_NODE;
+}
+
+void TourPlanner::build_neighbours()
+{
+    neighbours.assign(points.size() * config.neighbours, NO_NODE);
+    for (uint32_t node = FIRST_BALL_NODE; node < points.size(); node++)
+        nearest_balls(points[node], node, &neighbours[node * config.neighbours]);
+    update_endpoint_neighbours();
+}
+
+void TourPlanner::update_endpoint_neighbours()
+{
+    nearest_balls(points[START_NODE], START_NODE, &neighbours[START_NODE * config.neighbours]);
+    nearest_balls(points[END_NODE], END_NODE, &neighbours[END_NODE * config.neighbours]);
+}
+
+void TourPlanner::set_endpoints(const TourPoint &start, const TourPoint &end)
+{
+    points[START_NODE] = start;
+    points[END_NODE] = end;
+    update_endpoint_neighbours();
+
+    // Only the first and last edge changed.
+    activate(START_NODE);
+    activate(tour[1]);
+    activate(END_NODE);
+    activate(tour[tour.size() - 2]);
+}
+
+void TourPlanner::seed_nearest_neighbour()
+{
+    std::size_t balls = points.size() - FIRST_BALL_NODE;
+    tour.assign(1, START_NODE);
+    uint32_t current = START_NODE;
+    for (std::size_t visited = 0; visited < balls; visited++)
+    {
+        const TourPoint &point = points[current];
+        uint32_t nearest = NO_NODE;
+        double best = std::numeric_limits<double>::infinity();
+        int column = grid.column(point.x), row = grid.row(point.y);
+        for (int ring = 0;; ring++)
+        {
+            double bound = grid.ring_bound(ring);
+            if (nearest != NO_NODE && best <= bound * bound)
+                break;
+
+            bool inside = grid.visit_ring(column, row, ring, [&](uint32_t node) {
+                double dx = points[node].x - point.x, dy = points[node].y - point.y;
+                if (dx * dx + dy * dy < best)
+                {
+                    best = dx * dx + dy * dy;
+                    nearest = node;
+                }
+            });
+            if (!inside)
+                break;
+        }
+
+        grid.remove(nearest, points[nearest]);
+        tour.push_back(nearest);
+        current = nearest;
+    }
+    tour.push_back(END_NODE);
+
+    // The seed emptied the grid.
+    grid.build(points);
+}
+
+void TourPlanner::insert_cheapest(const std::vector<uint32_t> &order, const std::vector<bool> &is_new)
+{
+    // A linked list while inserting, flattened into tour afterwards.
+    std::vector<uint32_t> next(points.size(), NO_NODE), previous(points.size(), NO_NODE);
+    std::vector<bool> in_tour(points.size(), false);
+    for (std::size_t k = 0; k < order.size(); k++)
+    {
+        in_tour[order[k]] = true;
+        if (k + 1 < order.size())
+        {
+            next[order[k]] = order[k + 1];
+            previous[order[k + 1]] = order[k];
+        }
+    }
+
+    auto cost = [this](uint32_t from, uint32_t node, uint32_t to) {
+        return distance(from, node) + distance(node, to) - distance(from, to);
+    };
+
+    for (uint32_t node = FIRST_BALL_NODE; node < points.size(); node++)
+    {
+        if (!is_new[node])
+            continue;
+
+        // Next to one of its nearest balls that is already in the path, or else just before the end.
+        uint32_t after = previous[END_NODE];
+        double best = cost(after, node, END_NODE);
+        const uint32_t *near = &neighbours[node * config.neighbours];
+        for (int j = 0; j < config.neighbours; j++)
+        {
+            uint32_t other = near[j];
+            if (other == NO_NODE || !in_tour[other])
+                continue;
+
+            double before_other = cost(previous[other], node, other);
+            if (before_other < best)
+            {
+                best = before_other;
+                after = previous[other];
+            }
+            double after_other = cost(other, node, next[other]);
+            if (after_other < best)
+            {
+                best = after_other;
+                after = other;
+            }
+        }
+
+        next[node] = next[after];
+        previous[node] = after;
+        previous[next[after]] = node;
+        next[after] = node;
+        in_tour[node] = true;
+    }
+
+    tour.clear();
+    for (uint32_t node = START_NODE; node != NO_NODE; node = next[node])
+        tour.push_back(node);
+}
+
+void TourPlanner::set_balls(const std::vector<std::string> &new_names, const std::vector<TourPoint> &balls)
+{
+    std::size_t count = std::min(new_names.size(), balls.size());
+    std::vector<TourPoint> new_points(points.begin(), points.begin() + FIRST_BALL_NODE);
+    std::unordered_map<std::string, uint32_t> new_ball_by_name;
+    std::vector<std::string> kept_names;
+    // Node of each old ball in the new set, NO_NODE if it is gone.
+    std::vector<uint32_t> renumbered(points.size(), NO_NODE);
+    renumbered[START_NODE] = START_NODE;
+    renumbered[END_NODE] = END_NODE;
+    std::vector<bool> is_new(FIRST_BALL_NODE, false);
+    std::size_t added = 0;
+    for (std::size_t i = 0; i < count; i++)
+    {
+        if (!new_ball_by_name.emplace(new_names[i], static_cast<uint32_t>(kept_names.size())).second)
+            continue;
+
+        uint32_t node = static_cast<uint32_t>(new_points.size());
+        new_points.push_back(balls[i]);
+        kept_names.push_back(new_names[i]);
+        auto old = ball_by_name.find(new_names[i]);
+        is_new.push_back(old == ball_by_name.end());
+        if (old == ball_by_name.end())
+            added++;
+        else
+            renumbered[old->second + FIRST_BALL_NODE] = node;
+    }
+
+    // The old order, without the balls that are gone. Those either side of a gap get a new edge.
+    std::vector<uint32_t> order;
+    std::vector<bool> changed(is_new);
+    order.reserve(new_points.size());
+    bool gap = false;
+    for (uint32_t node : tour)
+    {
+        if (renumbered[node] == NO_NODE)
+        {
+            gap = true;
+            continue;
+        }
+        if (gap)
+        {
+            changed[renumbered[node]] = true;
+            changed[order.back()] = true;
+            gap = false;
+        }
+        order.push_back(renumbered[node]);
+    }
+
+    points = std::move(new_points);
+    names = std::move(kept_names);
+    ball_by_name = std::move(new_ball_by_name);
+    std::size_t total = points.size() - FIRST_BALL_NODE;
+    grid.build(points);
+    build_neighbours();
+
+    active.clear();
+    queued.assign(points.size(), false);
+    if (added > config.rebuild_fraction * total)
+    {
+        seed_nearest_neighbour();
+        for (uint32_t node = 0; node < points.size(); node++)
+            activate(node);
+    }
+    else
+    {
+        insert_cheapest(order, is_new);
+        // Only the nodes whose edges may have changed need looking at again.
+        for (std::size_t k = 0; k < tour.size(); k++)
+        {
+            bool touched = changed[tour[k]] || (k > 0 && is_new[tour[k - 1]]) || (k + 1 < tour.size() && is_new[tour[k + 1]]);
+            if (touched)
+                activate(tour[k]);
+        }
+    }
+
+    position.assign(points.size(), 0);
+    for (std::size_t k = 0; k < tour.size(); k++)
+        position[tour[k]] = static_cast<uint32_t>(k);
+}
+
+void TourPlanner::pop_next()
+{
+    if (size() == 0)
+        return;
+
+    std::vector<std::string> remaining;
+    std::vector<TourPoint> balls;
+    remaining.reserve(size() - 1);
+    balls.reserve(size() - 1);
+    for (std::size_t k = 2; k + 1 < tour.size(); k++)
+    {
+        remaining.push_back(names[tour[k] - FIRST_BALL_NODE]);
+        balls.push_back(points[tour[k]]);
+    }
+    set_balls(remaining, balls);
+}
+
+void TourPlanner::reverse(std::size_t from, std::size_t to)
+{
+    while (from < to)
+    {
+        std::swap(tour[from], tour[to]);
+        position[tour[from]] = static_cast<uint32_t>(from);
+        position[tour[to]] = static_cast<uint32_t>(to);
+        from++;
+        to--;
+    }
+}
+
+// Tries the two 2-opt moves that give node an edge to each of its neighbours, and applies the
+// first that shortens the path. The start and end never move.
+bool TourPlanner::improve_node(uint32_t a)
+{
+    const uint32_t *near = &neighbours[a * config.neighbours];
+    for (int j = 0; j < config.neighbours; j++)
+    {
+        uint32_t c = near[j];
+        if (c == NO_NODE)
+            break;
+
+        std::size_t pa = position[a], pc = position[c];
+        // Replace (a, next a) and (c, next c) with (a, c) and (next a, next c).
+        if (a != END_NODE && c != END_NODE)
+        {
+            uint32_t b = tour[pa + 1], d = tour[pc + 1];
+            if (b != c && d != a && distance(a, b) + distance(c, d) - distance(a, c) - distance(b, d) > MIN_GAIN)
+            {
+                reverse(std::min(pa, pc) + 1, std::max(pa, pc));
+                activate(a);
+                activate(b);
+                activate(c);
+                activate(d);
+                return true;
+            }
+        }
+        // Replace (previous a, a) and (previous c, c) with (a, c) and (previous a, previous c).
+        if (a != START_NODE && c != START_NODE)
+        {
+            uint32_t p = tour[pa - 1], q = tour[pc - 1];
+            if (p != c && q != a && distance(p, a) + distance(q, c) - distance(a, c) - distance(p, q) > MIN_GAIN)
+            {
+                reverse(std::min(pa, pc), std::max(pa, pc) - 1);
+                activate(a);
+                activate(p);
+                activate(c);
+                activate(q);
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+bool TourPlanner::improve(std::chrono::nanoseconds budget)
+{
+    auto deadline = std::chrono::steady_clock::now() + budget;
+    for (uint32_t steps = 1; !active.empty(); steps++)
+    {
+        if ((steps & 63) == 0 && std::chrono::steady_clock::now() >= deadline)
+            return false;
+
+        uint32_t node = active.back();
+        active.pop_back();
+        queued[node] = false;
+        improve_node(node);
+    }
+
+    return true;
+}
+
+bool TourPlanner::next(TourPoint &ball, std::string &name) const
+{
+    if (size() == 0)
+        return false;
+
+    ball = points[tour[1]];
+    name = names[tour[1] - FIRST_BALL_NODE];
+    return true;
+}
+
+double TourPlanner::length() const
+{
+    double total = 0.0;
+    for (std::size_t k = 0; k + 1 < tour.size(); k++)
+        total += distance(tour[k], tour[k + 1]);
+    return total;
+}
+
+std::vector<std::string> TourPlanner::order() const
+{
+    std::vector<std::string> balls;
+    balls.reserve(size());
+    for (std::size_t k = 1; k + 1 < tour.size(); k++)
+        balls.push_back(names[tour[k] - FIRST_BALL_NODE]);
+    return balls;
+}
+
+}  // namespace motion
@@ -0,0 +1,92 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <random>
+
+#include "motion/ball_map.hpp"
+
+namespace motion
+{
+
+// Distance from (x, y) to the nearest confirmed ball, looked for among every ball.
+static double brute_force_nearest(const BallMap &map, double x, double y)
+{
+    double best = std::numeric_limits<double>::infinity();
+    map.for_each_confirmed([&](const MappedBall &ball) {
+        best = std::min(best, std::hypot(ball.x - x, ball.y - y));
+    });
+    return best;
+}
+
+TEST(BallMap, NearestMatchesBruteForce)
+{
+    std::mt19937 random(1);
+    std::uniform_real_distribution<double> field(-20.0, 20.0);
+    BallMap map;
+
+    for (int i = 0; i < 500; i++)
+        map.add(field(random), field(random), 0);
+    // Seen once, so not confirmed and never reported.
+    for (int i = 0; i < 200; i++)
+        map.observe(field(random), field(random), 0);
+    // Holes, so some queries have to search further out.
+    for (int i = 0; i < 20; i++)
+        map.remove_within(field(random), field(random), 2.0);
+
+    // Also from well outside the field.
+    std::uniform_real_distribution<double> query(-40.0, 40.0);
+    for (int i = 0; i < 2000; i++)
+    {
+        double x = query(random), y = query(random);
+        MappedBall ball;
+        ASSERT_TRUE(map.nearest(x, y, ball));
+        EXPECT_GE(ball.observations, map.get_config().min_observations);
+        EXPECT_DOUBLE_EQ(std::hypot(ball.x - x, ball.y - y), brute_force_nearest(map, x, y));
+    }
+}
+
+TEST(BallMap, ObservationsConfirmAndMerge)
+{
+    BallMap map;
+    MappedBall ball;
+
+    uint32_t id = map.observe(1.0, 1.0, 0);
+    EXPECT_FALSE(map.nearest(0.0, 0.0, ball));
+
+    EXPECT_EQ(map.observe(1.1, 1.0, 1), id);
+    EXPECT_EQ(map.observe(1.0, 0.9, 2), id);
+    ASSERT_TRUE(map.nearest(0.0, 0.0, ball));
+    EXPECT_EQ(ball.id, id);
+    EXPECT_EQ(ball.observations, 3u);
+    EXPECT_EQ(ball.last_seen_ns, 2);
+    EXPECT_EQ(map.size(), 1u);
+    EXPECT_EQ(map.confirmed_size(), 1u);
+
+    // Beyond merge_radius a sighting is another ball.
+    EXPECT_NE(map.observe(2.0, 1.0, 3), id);
+    EXPECT_EQ(map.size(), 2u);
+    EXPECT_EQ(map.confirmed_size(), 1u);
+}
+
+TEST(BallMap, RemoveAndExpire)
+{
+    BallMap map;
+    map.add(0.0, 0.0, 10);
+    map.add(0.3, 0.0, 20);
+    map.add(5.0, 5.0, 30);
+
+    EXPECT_EQ(map.remove_within(0.1, 0.0, 0.5), 2u);
+    EXPECT_EQ(map.size(), 1u);
+
+    map.add(-5.0, -5.0, 40);
+    EXPECT_EQ(map.expire(35), 1u);
+    MappedBall ball;
+    ASSERT_TRUE(map.nearest(0.0, 0.0, ball));
+    EXPECT_DOUBLE_EQ(ball.x, -5.0);
+    EXPECT_EQ(map.confirmed_size(), 1u);
+}
+
+}  // namespace motion
@@ -0,0 +1,62 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstring>
+
+#include "motion/motor_protocol.hpp"
+
+namespace motion
+{
+
+TEST(MotorProtocol, CrcMatchesTheCcittFalseCheckValue)
+{
+    const char *check = "123456789";
+    EXPECT_EQ(crc16_ccitt(reinterpret_cast<const uint8_t *>(check), std::strlen(check)), 0x29B1);
+    EXPECT_EQ(crc16_ccitt(nullptr, 0), 0xFFFF);
+}
+
+TEST(MotorProtocol, ParsesAnEncodedCommand)
+{
+    uint8_t bytes[MOTOR_MAX_FRAME_SIZE];
+    std::size_t size = encode_motor_command(7, -153, 255, -1, bytes);
+    ASSERT_EQ(size, static_cast<std::size_t>(MOTOR_FRAME_HEADER_SIZE + MOTOR_COMMAND_PAYLOAD + MOTOR_FRAME_CRC_SIZE));
+
+    // Noise before the frame is skipped.
+    MotorFrameParser parser;
+    MotorFrame frame;
+    EXPECT_FALSE(parser.push(0x42, frame));
+    for (std::size_t i = 0; i + 1 < size; i++)
+        EXPECT_FALSE(parser.push(bytes[i], frame));
+    ASSERT_TRUE(parser.push(bytes[size - 1], frame));
+
+    EXPECT_EQ(frame.type, MOTOR_COMMAND_FRAME);
+    EXPECT_EQ(frame.sequence, 7);
+    ASSERT_EQ(frame.length, MOTOR_COMMAND_PAYLOAD);
+    EXPECT_EQ(static_cast<int16_t>(frame.payload[0] | frame.payload[1] << 8), -153);
+    EXPECT_EQ(static_cast<int16_t>(frame.payload[2] | frame.payload[3] << 8), 255);
+    EXPECT_EQ(static_cast<int16_t>(frame.payload[4] | frame.payload[5] << 8), -1);
+    EXPECT_EQ(parser.errors(), 0u);
+}
+
+TEST(MotorProtocol, DropsACorruptedFrame)
+{
+    uint8_t bytes[MOTOR_MAX_FRAME_SIZE];
+    std::size_t size = encode_motor_command(1, 100, 100, 0, bytes);
+    bytes[5] ^= 0x10;
+
+    MotorFrameParser parser;
+    MotorFrame frame;
+    for (std::size_t i = 0; i < size; i++)
+        EXPECT_FALSE(parser.push(bytes[i], frame));
+    EXPECT_EQ(parser.errors(), 1u);
+
+    // The next good frame still gets through.
+    size = encode_motor_command(2, 100, 100, 0, bytes);
+    bool parsed = false;
+    for (std::size_t i = 0; i < size; i++)
+        parsed = parser.push(bytes[i], frame);
+    EXPECT_TRUE(parsed);
+    EXPECT_EQ(frame.sequence, 2);
+}
+
+}  // namespace motion
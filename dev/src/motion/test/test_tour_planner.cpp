@@ -0,0 +1,128 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "motion/tour_planner.hpp"
+
+namespace motion
+{
+
+static void random_balls(std::mt19937 &random, std::size_t count, std::size_t first_name, std::vector<std::string> &names, std::vector<TourPoint> &balls)
+{
+    std::uniform_real_distribution<double> field(0.0, 23.0);
+    for (std::size_t i = 0; i < count; i++)
+    {
+        names.push_back("golfball" + std::to_string(first_name + i));
+        balls.push_back(TourPoint{field(random), field(random)});
+    }
+}
+
+static void expect_permutation(std::vector<std::string> order, std::vector<std::string> names)
+{
+    std::sort(order.begin(), order.end());
+    std::sort(names.begin(), names.end());
+    EXPECT_EQ(order, names);
+}
+
+// Runs 2-opt a few moves at a time until it is done, checking that no call lengthens the path.
+static void improve_to_end(TourPlanner &planner)
+{
+    double length = planner.length();
+    bool done = false;
+    for (int call = 0; call < 100000 && !done; call++)
+    {
+        done = planner.improve(std::chrono::nanoseconds(0));
+        double improved = planner.length();
+        ASSERT_LE(improved, length + 1e-9);
+        length = improved;
+    }
+    EXPECT_TRUE(done);
+}
+
+TEST(TourPlanner, OrderIsAPermutationOfTheBalls)
+{
+    std::mt19937 random(1);
+    std::vector<std::string> names;
+    std::vector<TourPoint> balls;
+    random_balls(random, 300, 0, names, balls);
+
+    TourPlanner planner;
+    planner.set_endpoints(TourPoint{0.0, 0.0}, TourPoint{1.5, 1.5});
+    planner.set_balls(names, balls);
+    EXPECT_EQ(planner.size(), names.size());
+    expect_permutation(planner.order(), names);
+    improve_to_end(planner);
+    expect_permutation(planner.order(), names);
+
+    // Popping walks the order, each ball once.
+    std::vector<std::string> order = planner.order(), popped;
+    TourPoint ball;
+    std::string name;
+    while (planner.next(ball, name))
+    {
+        popped.push_back(name);
+        planner.pop_next();
+        planner.improve(std::chrono::milliseconds(1));
+    }
+    EXPECT_EQ(planner.size(), 0u);
+    expect_permutation(popped, names);
+    EXPECT_EQ(popped.front(), order.front());
+}
+
+TEST(TourPlanner, ReplacingBallsKeepsAPermutation)
+{
+    std::mt19937 random(2);
+    std::vector<std::string> names;
+    std::vector<TourPoint> balls;
+    random_balls(random, 200, 0, names, balls);
+
+    TourPlanner planner;
+    planner.set_endpoints(TourPoint{0.0, 0.0}, TourPoint{1.5, 1.5});
+    planner.set_balls(names, balls);
+    improve_to_end(planner);
+
+    // Drop every third ball and add a few new ones, which are inserted rather than rebuilt.
+    std::vector<std::string> kept_names;
+    std::vector<TourPoint> kept_balls;
+    for (std::size_t i = 0; i < names.size(); i++)
+    {
+        if (i % 3 != 0)
+        {
+            kept_names.push_back(names[i]);
+            kept_balls.push_back(balls[i]);
+        }
+    }
+    random_balls(random, 20, names.size(), kept_names, kept_balls);
+    planner.set_balls(kept_names, kept_balls);
+    expect_permutation(planner.order(), kept_names);
+    improve_to_end(planner);
+    expect_permutation(planner.order(), kept_names);
+}
+
+TEST(TourPlanner, TwoOptNeverLengthensTheTour)
+{
+    for (unsigned seed = 0; seed < 5; seed++)
+    {
+        std::mt19937 random(seed);
+        std::vector<std::string> names;
+        std::vector<TourPoint> balls;
+        random_balls(random, 500, 0, names, balls);
+
+        TourPlanner planner;
+        planner.set_endpoints(TourPoint{0.0, 0.0}, TourPoint{1.5, 1.5});
+        planner.set_balls(names, balls);
+        double seeded = planner.length();
+        improve_to_end(planner);
+        EXPECT_LE(planner.length(), seeded);
+
+        // Moving the start only changes its edge; 2-opt still only shortens from there.
+        planner.set_endpoints(TourPoint{20.0, 5.0}, TourPoint{1.5, 1.5});
+        improve_to_end(planner);
+    }
+}
+
+}  // namespace motion
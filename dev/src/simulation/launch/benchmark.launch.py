@@ -0,0 +1,121 @@
+from simulation.filepaths import directories
+import os
+from launch import LaunchDescription
+from launch.actions import DeclareLaunchArgument, ExecuteProcess, RegisterEventHandler, Shutdown, TimerAction
+from launch.conditions import IfCondition
+from launch.event_handlers import OnProcessExit
+from launch.substitutions import LaunchConfiguration
+from launch_ros.actions import Node
+from os.path import join
+
+# Headless regression benchmark of the whole stack: gzserver without a GUI on the golf ball field,
+# stepping as fast as the machine allows with a fixed field so runs compare. Gazebo's camera
+# plugin stands in for camera_driver and its diff drive for motor_driver. image_processing and
+# navigation run as processes of their own so the recorder can tell their CPU use apart; it writes
+# the results to output and ends the launch. For example:
+#   ros2 launch simulation benchmark.launch.py duration_s:=600 output:=/tmp/planned.json collection_mode:=planned
+# The stage latencies the nodes time on the steady clock are compute time and are reported as wall
+# time whatever the rate. Ages measured between stamps, such as navigation's end_to_end, are in
+# simulated time and are reported apart; real_time_update_rate:=1000 steps in real time when those
+# are wanted comparable with the robot. The rate is recorded with the results.
+def generate_launch_description():
+    world_file_name = 'golfball_field.world'
+
+    os.environ["GAZEBO_MODEL_PATH"] = directories['models']
+    world = join(directories['worlds'], world_file_name)
+
+    seed = LaunchConfiguration('seed')
+    golfball_count = LaunchConfiguration('golfball_count')
+    parameters = {'use_sim_time': True}
+
+    gazebo = ExecuteProcess(
+        cmd=[
+            'gzserver',
+            world,
+            '-s',
+            'libgazebo_ros_init.so',
+            '-s',
+            'libgazebo_ros_factory.so'
+        ],
+        output='screen'
+    )
+    # Physics steps are 1 ms, so the rate is the real time factor times 1000; 0 lifts the limit.
+    update_rate = TimerAction(
+        period=5.0,
+        actions=[
+            ExecuteProcess(
+                cmd=['gz', 'physics', '-u', LaunchConfiguration('real_time_update_rate')],
+                output='screen'
+            )
+        ]
+    )
+
+    spawn_entity = Node(
+        package='simulation',
+        executable='spawn_demo',
+        parameters=[parameters, {'seed': seed, 'golfball_count': golfball_count}],
+        output='screen'
+    )
+    delete_entity = Node(
+        package='simulation',
+        executable='remove_golfballs',
+        parameters=[parameters],
+        output='screen'
+    )
+
+    image_processing = Node(
+        package='vision',
+        executable='image_processing',
+        parameters=[parameters, {'all_ball_candidates': LaunchConfiguration('ball_map')}],
+        output='screen'
+    )
+    navigation = Node(
+        package='motion',
+        executable='navigation',
+        parameters=[parameters, {'collection_mode': LaunchConfiguration('collection_mode')}],
+        output='screen'
+    )
+    ball_mapping = Node(
+        package='motion',
+        executable='ball_mapping',
+        condition=IfCondition(LaunchConfiguration('ball_map')),
+        parameters=[parameters],
+        output='screen'
+    )
+
+    recorder = Node(
+        package='simulation',
+        executable='benchmark_recorder',
+        parameters=[parameters, {
+            'duration_s': LaunchConfiguration('duration_s'),
+            'output': LaunchConfiguration('output'),
+            'golfball_count': golfball_count,
+            'real_time_update_rate': LaunchConfiguration('real_time_update_rate'),
+            'processes': ['gzserver', 'image_processing', 'navigation', 'ball_mapping']
+        }],
+        output='screen'
+    )
+
+    return LaunchDescription([
+        DeclareLaunchArgument('duration_s', default_value='300.0'),
+        DeclareLaunchArgument('output', default_value='benchmark.json'),
+        DeclareLaunchArgument('seed', default_value='1'),
+        DeclareLaunchArgument('golfball_count', default_value='45'),
+        DeclareLaunchArgument('collection_mode', default_value='reactive'),
+        DeclareLaunchArgument('ball_map', default_value='false'),
+        DeclareLaunchArgument('real_time_update_rate', default_value='0'),
+        gazebo,
+        update_rate,
+        spawn_entity,
+        delete_entity,
+        image_processing,
+        navigation,
+        ball_mapping,
+        recorder,
+        RegisterEventHandler(
+            OnProcessExit(
+                target_action=recorder,
+                on_exit=[Shutdown(reason='Benchmark finished')]
+            )
+        )
+    ])
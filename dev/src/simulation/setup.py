@@ -25,7 +25,8 @@ setup(
     entry_points={
         'console_scripts': [
             f'spawn_demo = {package_name}.spawn_demo:main',
-            f'remove_golfballs = {package_name}.remove_golfballs:main'
+            f'remove_golfballs = {package_name}.remove_golfballs:main',
+            f'benchmark_recorder = {package_name}.benchmark_recorder:main'
         ],
     },
 )
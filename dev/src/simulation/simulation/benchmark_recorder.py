@@ -0,0 +1,207 @@
+import json
+import os
+import rclpy
+
+from diagnostic_msgs.msg import DiagnosticArray
+from rcl_interfaces.msg import ParameterDescriptor
+from rclpy.clock import Clock
+from rclpy.node import Node
+from rclpy.subscription import Subscription
+from rclpy.timer import Timer
+from statistics import median
+from std_msgs.msg import UInt64
+from time import monotonic
+from typing import Dict, List
+
+# Stages the nodes measure as the age of a stamp on their ROS clock, so in simulated time here. All
+# other stages are timed on the steady clock around the work itself, i.e. wall time.
+SIM_TIME_STAGES = {'frame_age', 'end_to_end', 'teleop'}
+
+class ProcessCpu:
+    '''
+        CPU use of one process, sampled from /proc/<pid>/stat.
+    '''
+    name: str
+    pid: int
+    ticks: int
+    samples: List[float]
+
+    def __init__(self, name: str, pid: int):
+        self.name = name
+        self.pid = pid
+        self.ticks = self.read_ticks()
+        self.samples = []
+
+    def read_ticks(self) -> int:
+        try:
+            with open(f'/proc/{self.pid}/stat') as stat:
+                # The command may contain spaces, so fields are counted from after it.
+                fields = stat.read().rsplit(')', 1)[1].split()
+            return int(fields[11]) + int(fields[12])
+        except (OSError, IndexError, ValueError):
+            return -1
+
+    def sample(self, seconds: float):
+        ticks = self.read_ticks()
+        if ticks >= 0 and self.ticks >= 0 and seconds > 0:
+            self.samples.append(100.0 * (ticks - self.ticks) / os.sysconf('SC_CLK_TCK') / seconds)
+        self.ticks = ticks
+
+class BenchmarkRecorder(Node):
+    '''
+        Runs for duration_s of simulated time, then writes what the stack achieved to output as
+        JSON and exits: balls collected per simulated and per wall minute, the real time factor,
+        the CPU use of each process in processes and the per-stage latencies every node reported
+        on /diagnostics. Compute stages go under wall_latency_ms. Stamp ages, among them
+        navigation's end_to_end from image_raw capture to cmd_vel, go under sim_latency_ms with
+        the real_time_update_rate they were measured at, since they are in simulated time.
+    '''
+    collected_subscription: Subscription
+    diagnostics_subscription: Subscription
+    sample_timer: Timer
+    processes: Dict[str, ProcessCpu]
+    # Per 'node: stage', the p50, p99 and max of every report, in ms.
+    latencies: Dict[str, Dict[str, List[float]]]
+
+    def __init__(self):
+        super().__init__('benchmark_recorder')
+        # Either an integer or a float, as given on the command line.
+        self.duration = float(self.declare_parameter('duration_s', 300.0, ParameterDescriptor(dynamic_typing=True)).value)
+        self.output = self.declare_parameter('output', 'benchmark.json').value
+        self.golfball_count = self.declare_parameter('golfball_count', 0).value
+        self.real_time_update_rate = float(
+            self.declare_parameter('real_time_update_rate', 0.0, ParameterDescriptor(dynamic_typing=True)).value
+        )
+        self.process_names = self.declare_parameter('processes', ['gzserver', 'image_processing', 'navigation']).value
+
+        self.collected = 0
+        self.latencies = {}
+        self.processes = {}
+        self.sim_start = None
+        self.wall_start = None
+        self.last_sample = monotonic()
+
+        self.collected_subscription = self.create_subscription(UInt64, 'golfballs_collected', self.count_collected, 10)
+        self.diagnostics_subscription = self.create_subscription(DiagnosticArray, '/diagnostics', self.record_latencies, 100)
+        # On a wall clock timer, so CPU is sampled the same however fast the simulation runs.
+        self.sample_timer = self.create_timer(1.0, self.sample, clock=Clock())
+
+        self.get_logger().info(f'{self.get_name()} node has started, recording {self.duration:.0f} s of simulation')
+
+    def count_collected(self, msg: UInt64):
+        self.collected = msg.data
+
+    def record_latencies(self, msg: DiagnosticArray):
+        for status in msg.status:
+            if not status.name.endswith(': latency'):
+                continue
+
+            node = status.name[:-len(': latency')]
+            values = {entry.key: entry.value for entry in status.values}
+            for key in values:
+                if not key.endswith(' p50 (ms)'):
+                    continue
+
+                stage = key[:-len(' p50 (ms)')]
+                try:
+                    count = float(values.get(f'{stage} count', '0'))
+                    report = [float(values[f'{stage} {field} (ms)']) for field in ('p50', 'p99', 'max')]
+                except (KeyError, ValueError):
+                    continue
+                if count == 0:
+                    continue
+
+                stages = self.latencies.setdefault(f'{node}: {stage}', {'p50': [], 'p99': [], 'max': []})
+                for field, value in zip(('p50', 'p99', 'max'), report):
+                    stages[field].append(value)
+
+    def find_processes(self):
+        for pid in filter(str.isdigit, os.listdir('/proc')):
+            try:
+                with open(f'/proc/{pid}/cmdline', 'rb') as cmdline:
+                    arguments = cmdline.read().split(b'\0')
+            except OSError:
+                continue
+
+            names = {os.path.basename(argument.decode(errors='replace')) for argument in arguments[:2]}
+            for name in self.process_names:
+                if name in names and name not in self.processes:
+                    self.processes[name] = ProcessCpu(name, int(pid))
+
+    def sample(self):
+        now = monotonic()
+        seconds = now - self.last_sample
+        self.last_sample = now
+
+        sim_now = self.get_clock().now().nanoseconds / 1e9
+        if self.sim_start is None:
+            # Simulated time only starts once gzserver publishes /clock.
+            if sim_now == 0:
+                return
+            self.sim_start = sim_now
+            self.wall_start = now
+            self.find_processes()
+            return
+
+        if len(self.processes) < len(self.process_names):
+            self.find_processes()
+        for process in self.processes.values():
+            process.sample(seconds)
+
+        if sim_now - self.sim_start >= self.duration:
+            self.write_results(sim_now - self.sim_start, now - self.wall_start)
+            raise SystemExit
+
+    def summarise_latencies(self, sim_time: bool) -> Dict[str, Dict[str, float]]:
+        return {
+            stage: {
+                'p50': median(fields['p50']),
+                'p99': max(fields['p99']),
+                'max': max(fields['max']),
+                'reports': len(fields['p50'])
+            }
+            for stage, fields in self.latencies.items()
+            if (stage.rsplit(': ', 1)[-1] in SIM_TIME_STAGES) == sim_time
+        }
+
+    def write_results(self, sim_seconds: float, wall_seconds: float):
+        results = {
+            'sim_seconds': sim_seconds,
+            'wall_seconds': wall_seconds,
+            'real_time_factor': sim_seconds / wall_seconds if wall_seconds > 0 else 0.0,
+            'real_time_update_rate': self.real_time_update_rate,
+            'golfballs_spawned': self.golfball_count,
+            'golfballs_collected': self.collected,
+            'golfballs_per_sim_minute': 60.0 * self.collected / sim_seconds,
+            'golfballs_per_wall_minute': 60.0 * self.collected / wall_seconds if wall_seconds > 0 else 0.0,
+            'cpu_percent': {
+                name: {
+                    'mean': sum(process.samples) / len(process.samples),
+                    'max': max(process.samples)
+                }
+                for name, process in self.processes.items() if process.samples
+            },
+            # Per stage, the median of the reported p50s, and the worst p99 and max of any report.
+            'wall_latency_ms': self.summarise_latencies(sim_time=False),
+            'sim_latency_ms': self.summarise_latencies(sim_time=True)
+        }
+
+        with open(self.output, 'w') as output:
+            json.dump(results, output, indent=2, sort_keys=True)
+        self.get_logger().info(
+            f'Collected {self.collected} golf balls in {sim_seconds:.0f} s of simulation '
+            f'({wall_seconds:.0f} s wall), results written to {self.output}'
+        )
+
+def main(args=None):
+    rclpy.init(args=args)
+    recorder = BenchmarkRecorder()
+    try:
+        rclpy.spin(recorder)
+    except SystemExit:
+        pass
+    recorder.destroy_node()
+    rclpy.shutdown()
+
+if __name__ == '__main__':
+    main()
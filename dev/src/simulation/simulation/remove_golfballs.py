@@ -5,7 +5,9 @@ from gazebo_msgs.srv import DeleteEntity
 from geometry_msgs.msg import Point
 from math import sqrt
 from nav_msgs.msg import Odometry
+from std_msgs.msg import UInt64
 from rclpy.node import Node
+from rclpy.publisher import Publisher
 from rclpy.service import Service
 from rclpy.subscription import Subscription
 from rclpy.task import Future
@@ -29,13 +31,18 @@ class RemoveGolfballs(Node):
     
     golfball_locations: Service
     odom_subscription: Subscription
+    collected_publisher: Publisher
     golfballs: List[Golfball]
+    collected: int
 
     def __init__(self):
         super().__init__('remove_golfballs')
 
         sleep(20)
         self.golfballs = None
+        self.collected = 0
+        # Running count of the balls collected, e.g. for the benchmark.
+        self.collected_publisher = self.create_publisher(UInt64, 'golfballs_collected', 10)
         self.golfball_locations = self.create_service(
             GolfballLocations,
             'golfball_locations',
@@ -67,6 +74,8 @@ class RemoveGolfballs(Node):
                 response = future.result()
                 if response.success:
                     self.golfballs.pop(index)
+                    self.collected += 1
+                    self.collected_publisher.publish(UInt64(data=self.collected))
                 self.get_logger().info(f'Deleted golfball: {response.success}')
             except Exception as e:
                 self.get_logger().warn(f'Service call failed. Exception: {e}')
@@ -18,6 +18,10 @@ class CreateWorld(Node):
 
     def __init__(self):
         super().__init__('world_creator')
+        # A seed of -1 gives a different field every run; the benchmark fixes it so runs compare.
+        # A golfball_count of 0 picks 30 to 60 balls.
+        self.seed = self.declare_parameter('seed', -1).value
+        self.golfball_count = self.declare_parameter('golfball_count', 0).value
         self.client = self.create_client(
             srv_type=SpawnEntity,
             srv_name='/spawn_entity',
@@ -81,13 +85,14 @@ class CreateWorld(Node):
         future.add_done_callback(spawn_result)
 
     def spawn_golfballs(self):
-        num_golfballs = random.randint(30, 60)
+        layout = random.Random(None if self.seed < 0 else self.seed)
+        num_golfballs = self.golfball_count if self.golfball_count > 0 else layout.randint(30, 60)
         pose = {'z': 0.0}
         dist = feet_to_meters(75)
         for i in range(num_golfballs):
             while True:
-                pose['x'] = (random.random() * dist) - (dist / 2)
-                pose['y'] = (random.random() * dist) - (dist / 2)
+                pose['x'] = (layout.random() * dist) - (dist / 2)
+                pose['y'] = (layout.random() * dist) - (dist / 2)
                 # Make sure golf balls do not spawn in the dropoff area.
                 if pose['y'] > -8.430388 or pose['x'] < 8.421658:
                     break
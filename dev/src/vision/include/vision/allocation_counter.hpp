@@ -0,0 +1,39 @@
+#ifndef VISION__ALLOCATION_COUNTER_HPP_
+#define VISION__ALLOCATION_COUNTER_HPP_
+
+#include <cstddef>
+
+namespace vision
+{
+
+// Counts the heap allocations made by threads while they are inside an AllocationScope.
+// libvision_allocation_counter.so replaces malloc and the other C allocation functions, which
+// operator new and cv::Mat's allocator both go through, to do the counting. Nothing links against
+// it, so it only takes over when it is preloaded, e.g.
+//
+//     LD_PRELOAD=libvision_allocation_counter.so ros2 run vision image_processing
+//
+// Otherwise the C library's allocator stays in place, a scope costs a null check and nothing is
+// counted.
+class AllocationScope
+{
+    private:
+        bool previous;
+
+    public:
+        AllocationScope();
+        ~AllocationScope();
+
+        AllocationScope(const AllocationScope &) = delete;
+        AllocationScope &operator=(const AllocationScope &) = delete;
+};
+
+// Whether the counting allocator is the one in use.
+bool allocation_counting_active();
+
+// Allocations made inside an AllocationScope so far, by any thread.
+std::size_t counted_allocations();
+
+}  // namespace vision
+
+#endif  // VISION__ALLOCATION_COUNTER_HPP_
@@ -0,0 +1,53 @@
+#ifndef VISION__AUTO_THRESHOLD_HPP_
+#define VISION__AUTO_THRESHOLD_HPP_
+
+#include "vision/pixel_classifier.hpp"
+
+namespace vision
+{
+
+struct AutoThresholdConfig
+{
+    // Golf balls cover a small part of the rows of interest and are brighter than anything else
+    // there, so this percentile of the intensities is taken as the brightest background.
+    float background_percentile = 0.99f;
+    // How far above the brightest background the white threshold sits.
+    int margin = 20;
+    // The threshold is kept within these, so a frame of nothing but ball or nothing at all cannot
+    // run it off.
+    int min_threshold = 100, max_threshold = 230;
+    // Weight of each frame in the smoothed background level, in (0, 1].
+    float smoothing = 0.1f;
+    // The threshold only moves once the smoothed level is this far from it. Besides keeping the
+    // mask from flickering, every move rebuilds the classifier's tables.
+    int hysteresis = 4;
+};
+
+// Follows the lighting by placing the white (gray) threshold a margin above the brightest
+// background, read off the intensity histogram of the frame the classifier has just produced.
+// Each update is O(INTENSITY_BINS) and needs no pass over the frame of its own.
+class AutoThreshold
+{
+    private:
+        AutoThresholdConfig config;
+        // Smoothed target, negative until the first frame.
+        float level;
+        int applied;
+
+    public:
+        explicit AutoThreshold(const AutoThresholdConfig &config = AutoThresholdConfig());
+
+        void set_config(const AutoThresholdConfig &config) { this->config = config; }
+        const AutoThresholdConfig &get_config() const { return config; }
+        // Forgets the lighting; the next update() starts from that frame alone.
+        void reset();
+
+        // Takes a frame's histogram, counted on the Y plane if luma is set and on gray otherwise,
+        // and returns the gray threshold to classify the next frame with. Returns fallback while no
+        // frame has been counted.
+        int update(const IntensityHistogram &histogram, bool luma, int fallback);
+};
+
+}  // namespace vision
+
+#endif  // VISION__AUTO_THRESHOLD_HPP_
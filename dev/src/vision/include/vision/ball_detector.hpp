@@ -0,0 +1,69 @@
+#ifndef VISION__BALL_DETECTOR_HPP_
+#define VISION__BALL_DETECTOR_HPP_
+
+#include <cstdint>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+// Upper bound of ImageData.balls.
+#define MAX_BALL_CANDIDATES 8
+
+namespace vision
+{
+
+// An 8-connected blob of white mask pixels, in the coordinates of the mask it was found in.
+struct BallCandidate
+{
+    float centroid_x, centroid_y;
+    int area;
+    cv::Rect box;
+};
+
+// Labels the white mask in a single pass over its runs of set pixels. Runs overlapping a run
+// of the row above are joined with union-find, and each blob's area, centroid and bounding box
+// are accumulated per run rather than per pixel. All buffers are sized once in the constructor;
+// a frame with more runs than they hold is only labelled up to that point, which bounds the
+// time spent on pathological (e.g. overexposed) frames.
+class BallDetector
+{
+    private:
+        struct Run
+        {
+            int16_t row, start, end;
+        };
+
+        // Per-run union-find parent, then per-root blob statistics.
+        struct Blob
+        {
+            int64_t sum_x, sum_y;
+            int area;
+            int16_t left, top, right, bottom;
+        };
+
+        std::vector<Run> runs;
+        std::vector<int> parent;
+        std::vector<Blob> blobs;
+        std::vector<BallCandidate> found;
+        std::size_t run_count;
+        bool truncated;
+
+        int find_root(int run);
+        void join(int a, int b);
+        void label(const cv::Mat &mask, const cv::Rect &region);
+
+    public:
+        explicit BallDetector(std::size_t max_runs);
+
+        // Writes up to MAX_BALL_CANDIDATES blobs of at least min_area pixels inside region into
+        // candidates, largest first. candidates does not reallocate once it has reached
+        // MAX_BALL_CANDIDATES capacity.
+        void detect(const cv::Mat &mask, const cv::Rect &region, int min_area, std::vector<BallCandidate> &candidates);
+
+        // Whether the last frame ran out of run buffer and was only partly labelled.
+        bool was_truncated() const { return truncated; }
+};
+
+}  // namespace vision
+
+#endif  // VISION__BALL_DETECTOR_HPP_
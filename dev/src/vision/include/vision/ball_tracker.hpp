@@ -0,0 +1,83 @@
+#ifndef VISION__BALL_TRACKER_HPP_
+#define VISION__BALL_TRACKER_HPP_
+
+#include <chrono>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "vision/ball_detector.hpp"
+
+namespace vision
+{
+
+struct BallTrackerConfig
+{
+    // Alpha-beta gains of the position and velocity updates, both in (0, 1].
+    float alpha = 0.5f, beta = 0.1f;
+    // Candidates further than this many columns from the prediction are not the tracked ball.
+    float gate = 40.0f;
+    // Consecutive gated detections before a new track is reported, so one-frame false positives
+    // never steer.
+    int confirm_frames = 2;
+    // Frames a confirmed track is coasted on its prediction without a detection before it is dropped.
+    int max_coast_frames = 10;
+    // While a track is held, only this many columns either side of the prediction are labelled.
+    // 0 always labels the whole region.
+    int search_margin = 60;
+};
+
+// Alpha-beta filter on the ball column, so the ball is followed from frame to frame instead of
+// being picked afresh from every frame's candidates. Each frame is predict() (from the frame's
+// capture time), then search_region() to narrow where the detector looks, then update() with
+// what it found. Only one thread may use a tracker at a time.
+class BallTracker
+{
+    private:
+        enum class State
+        {
+            // No track: the largest candidate starts a tentative one.
+            SEARCHING,
+            // Seen for fewer than confirm_frames frames; not reported yet.
+            TENTATIVE,
+            // Confirmed, reported, and coasted through short misses.
+            TRACKING
+        };
+
+        BallTrackerConfig config;
+        State state;
+        float position, velocity, predicted;
+        // Seconds between the last frame and this one.
+        float dt;
+        int hits, misses;
+        std::chrono::nanoseconds last_stamp;
+
+        const BallCandidate *gated_candidate(const std::vector<BallCandidate> &candidates) const;
+        void start(const BallCandidate &candidate);
+
+    public:
+        explicit BallTracker(const BallTrackerConfig &config = BallTrackerConfig());
+
+        void set_config(const BallTrackerConfig &config) { this->config = config; }
+        void reset();
+
+        // Advances the prediction to a frame captured at stamp (on any monotonic clock). Unstamped
+        // frames (0) are assumed to be one nominal frame apart; a gap of more than half a second
+        // drops the track, since the prediction is worthless by then.
+        void predict(std::chrono::nanoseconds stamp);
+
+        // The part of region worth labelling: region itself unless a track is held and was seen on
+        // the last frame, then the columns within search_margin of the prediction.
+        cv::Rect search_region(const cv::Rect &region) const;
+
+        // Feeds this frame's candidates (largest first). Returns true and the tracked column if a
+        // confirmed track is held, including while it is being coasted.
+        bool update(const std::vector<BallCandidate> &candidates, int &column);
+
+        // The reported column is a prediction, not a detection of this frame.
+        bool coasting() const { return state == State::TRACKING && misses > 0; }
+};
+
+}  // namespace vision
+
+#endif  // VISION__BALL_TRACKER_HPP_
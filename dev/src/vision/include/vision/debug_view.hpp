@@ -0,0 +1,76 @@
+#ifndef VISION__DEBUG_VIEW_HPP_
+#define VISION__DEBUG_VIEW_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <image_transport/image_transport.hpp>
+#include <opencv2/core.hpp>
+
+#include "rclcpp/rclcpp.hpp"
+#include "sensor_msgs/msg/image.hpp"
+#include "vision/ball_detector.hpp"
+#include "vision/pixel_classifier.hpp"
+
+namespace vision
+{
+
+// Everything the debug image is drawn from, captured at the end of a processing pass.
+struct DebugSnapshot
+{
+    // Keeps the camera buffer frame points into alive while the debug thread reads it.
+    sensor_msgs::msg::Image::ConstSharedPtr message;
+    cv::Mat frame;
+    PixelLayout layout;
+    // Copies, since the node reuses its masks for the next frame.
+    cv::Mat white, red;
+    int ball_column;
+    std::vector<BallCandidate> balls;
+};
+
+// Draws the detector overlays and publishes them on their own thread, so the frame callback
+// never pays for it. Snapshots are only wanted while enabled, while someone is subscribed
+// and at most max_rate times a second; anything arriving while the last one is still being
+// drawn replaces it.
+class DebugView
+{
+    private:
+        rclcpp::Node *node;
+        image_transport::Publisher publisher;
+        std::atomic<bool> enabled;
+        std::atomic<int64_t> period_ns;
+        std::chrono::steady_clock::time_point last_snapshot;
+
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::unique_ptr<DebugSnapshot> pending;
+        bool running;
+        std::thread thread;
+
+        void render_loop();
+        void render(const DebugSnapshot &snapshot);
+
+    public:
+        DebugView(rclcpp::Node *node, const std::string &topic, bool enabled, double max_rate);
+        ~DebugView();
+
+        DebugView(const DebugView &) = delete;
+        DebugView &operator=(const DebugView &) = delete;
+
+        void set_enabled(bool value) { enabled = value; }
+        void set_max_rate(double rate);
+
+        // Called from the frame callback. True when a snapshot of this frame should be submitted.
+        bool wanted();
+        void submit(std::unique_ptr<DebugSnapshot> snapshot);
+};
+
+}  // namespace vision
+
+#endif  // VISION__DEBUG_VIEW_HPP_
@@ -0,0 +1,95 @@
+#ifndef VISION__DETECTION_KERNELS_HPP_
+#define VISION__DETECTION_KERNELS_HPP_
+
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "vision/ball_detector.hpp"
+#include "vision/detector_regions.hpp"
+#include "vision/frame_size.hpp"
+
+#define WHITE 255
+#define NO_EDGE_FOUND INT_MAX
+#define NO_BALL_FOUND -180
+// A tape strip column needs more mask pixels than this to count as tape.
+#define EDGE_MIN_PIXELS 5
+
+// The detectors as pure functions: everything they read is passed in and everything they produce
+// is returned or written to a caller-owned buffer, so they can run on any thread and be
+// benchmarked on their own.
+namespace vision
+{
+
+// Counts the WHITE pixels of each of columns consecutive columns, starting at pixels, over rows
+// rows step bytes apart, into counts. Mask pixels are either 0 or WHITE. The rows are walked
+// once, adding each into the counts with a loop simple enough for the compiler to vectorise.
+inline void count_columns(const uint8_t *pixels, std::size_t step, int rows, int columns, int *counts)
+{
+    for (int i = 0; i < columns; i++)
+        counts[i] = 0;
+
+    for (int row = 0; row < rows; row++, pixels += step)
+    {
+        for (int i = 0; i < columns; i++)
+            counts[i] += pixels[i] == WHITE;
+    }
+}
+
+// count_columns for a column count known at compile time, so the inner loop has a constant trip
+// count the compiler can fully unroll around its vector body.
+template <int Columns>
+inline void count_columns(const uint8_t *pixels, std::size_t step, int rows, int *counts)
+{
+    static_assert(Columns > 0, "Columns must be positive");
+
+    for (int i = 0; i < Columns; i++)
+        counts[i] = 0;
+
+    for (int row = 0; row < rows; row++, pixels += step)
+    {
+        for (int i = 0; i < Columns; i++)
+            counts[i] += pixels[i] == WHITE;
+    }
+}
+
+// Column counts of region of an 8-bit mask. counts is resized to region.width, so with enough
+// capacity reserved it never allocates. The widths of the default regions at WIDTH use the
+// fixed-size kernels, anything else the runtime-sized one.
+void column_histogram(const cv::Mat &mask, const cv::Rect &region, std::vector<int> &counts);
+
+// Index of the first of columns counts above min_count, or -1.
+int first_dense_column(const int *counts, int columns, int min_count);
+
+// Column the ball is in: that of the largest candidate, or 0 if there is none, which puts
+// ball_offset() at NO_BALL_FOUND.
+int ball_column(const std::vector<BallCandidate> &candidates);
+
+// Offset of a ball column from the centre of the frame; positive is to the right.
+inline int ball_offset(int column)
+{
+    return column - (WIDTH / 2);
+}
+
+// Offset of a tape column from the centre, mirrored: tape on the left means turn right, on the
+// right turn left.
+inline int edge_offset(int column)
+{
+    return WIDTH - column - (WIDTH / 2);
+}
+
+// Looks for tape in the left strip of regions, then the right, and returns the edge_offset() of
+// the first column dense enough to be tape, or NO_EDGE_FOUND. counts is scratch, as for
+// column_histogram().
+int find_edge(const cv::Mat &red, const DetectorRegions &regions, std::vector<int> &counts);
+
+// find_edge for strip counts that were already taken, e.g. on the GPU: counts holds the columns
+// of regions.left_edge followed by those of regions.right_edge.
+int edge_from_strip_counts(const std::vector<int> &counts, const DetectorRegions &regions);
+
+}  // namespace vision
+
+#endif  // VISION__DETECTION_KERNELS_HPP_
@@ -0,0 +1,63 @@
+#ifndef VISION__DETECTOR_REGIONS_HPP_
+#define VISION__DETECTOR_REGIONS_HPP_
+
+#include <algorithm>
+
+#include <opencv2/core.hpp>
+
+#include "vision/frame_size.hpp"
+
+// Default regions: the ball histogram starts just below the middle of the frame, the tape
+// strips closer to the bottom at either edge.
+#define BALL_ROI_TOP ((HEIGHT / 2) + 10)
+#define EDGE_ROI_TOP 160
+#define EDGE_STRIP_WIDTH 40
+
+namespace vision
+{
+
+// The parts of the frame each detector reads, in full-frame (WIDTH x HEIGHT) coordinates.
+// Everything above first_row() is never looked at, so it is not classified at all and the
+// camera can drop it before it is even converted.
+struct DetectorRegions
+{
+    cv::Size frame_size;
+    // Rows the ball histogram covers, below the top of the trapezoid.
+    cv::Rect ball;
+    // Strips at the left and right edges find_edge scans for tape.
+    cv::Rect left_edge, right_edge;
+
+    int first_row() const
+    {
+        return std::min(ball.y, std::min(left_edge.y, right_edge.y));
+    }
+
+    // Frames shorter than frame_size hold its bottom rows, i.e. they were cropped at capture.
+    // Returns the regions in that frame's coordinates.
+    DetectorRegions for_frame(cv::Size size) const
+    {
+        int offset = frame_size.height - size.height;
+        cv::Rect bounds(0, 0, size.width, size.height);
+
+        DetectorRegions regions = *this;
+        regions.frame_size = size;
+        regions.ball = (ball - cv::Point(0, offset)) & bounds;
+        regions.left_edge = (left_edge - cv::Point(0, offset)) & bounds;
+        regions.right_edge = (right_edge - cv::Point(0, offset)) & bounds;
+        return regions;
+    }
+};
+
+inline DetectorRegions make_detector_regions(int width, int height, int ball_top, int edge_top, int edge_width)
+{
+    DetectorRegions regions;
+    regions.frame_size = cv::Size(width, height);
+    regions.ball = cv::Rect(0, ball_top, width, height - ball_top);
+    regions.left_edge = cv::Rect(0, edge_top, edge_width, height - edge_top);
+    regions.right_edge = cv::Rect(width - edge_width, edge_top, edge_width, height - edge_top);
+    return regions;
+}
+
+}  // namespace vision
+
+#endif  // VISION__DETECTOR_REGIONS_HPP_
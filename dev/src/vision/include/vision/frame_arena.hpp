@@ -0,0 +1,40 @@
+#ifndef VISION__FRAME_ARENA_HPP_
+#define VISION__FRAME_ARENA_HPP_
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "vision/ball_detector.hpp"
+
+namespace vision
+{
+
+// Every buffer the frame path writes into. It is sized from the first frame and reused for every
+// later one, so the steady state never touches the heap; only a change of frame size reallocates.
+struct FrameArena
+{
+    // White (golf ball) and red (tape) masks, written by the classify stage.
+    cv::Mat white, red;
+    // Column counts of the tape strips, written by the edge stage.
+    std::vector<int> strip_counts;
+    std::vector<BallCandidate> ball_candidates;
+
+    // Returns true if the buffers had to be allocated for this size.
+    bool prepare(cv::Size frame_size)
+    {
+        if (white.size() == frame_size)
+            return false;
+
+        // Rows above the detector regions are never written, so they stay black.
+        white = cv::Mat::zeros(frame_size, CV_8UC1);
+        red = cv::Mat::zeros(frame_size, CV_8UC1);
+        strip_counts.reserve(frame_size.width);
+        ball_candidates.reserve(MAX_BALL_CANDIDATES);
+        return true;
+    }
+};
+
+}  // namespace vision
+
+#endif  // VISION__FRAME_ARENA_HPP_
@@ -0,0 +1,195 @@
+#ifndef VISION__FRAME_PIPELINE_HPP_
+#define VISION__FRAME_PIPELINE_HPP_
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "vision/auto_threshold.hpp"
+#include "vision/ball_detector.hpp"
+#include "vision/ball_tracker.hpp"
+#include "vision/detection_kernels.hpp"
+#include "vision/detector_regions.hpp"
+#include "vision/frame_arena.hpp"
+#include "vision/frame_size.hpp"
+#include "vision/pipeline_executor.hpp"
+#include "vision/pixel_classifier.hpp"
+#ifdef VISION_WITH_OPENCL
+#include "vision/umat_classifier.hpp"
+#endif
+
+// Run buffer of the ball labeller, enough for every eighth pixel of a frame to start a run.
+#define BALL_LABEL_RUNS (WIDTH * HEIGHT / 8)
+
+namespace vision
+{
+
+// Points frame at an image buffer of the given layout without copying it. Returns false if size
+// is smaller than height rows of step bytes (plus the UV plane for NV12).
+bool view_frame(PixelLayout layout, int width, int height, std::size_t step, const uint8_t *data, std::size_t size, cv::Mat &frame);
+
+// Where the mask stage runs. The ball labeller always runs on the CPU.
+enum class MaskBackend
+{
+    // PixelClassifier, split across the two pipeline workers.
+    CPU,
+    // UMatClassifier, only with VISION_WITH_OPENCL.
+    OPENCL
+};
+
+// "cpu" or "opencl", or false if the name is neither.
+bool mask_backend_from_name(const std::string &name, MaskBackend &backend);
+
+struct FrameDetections
+{
+    // Offset of the ball from the frame centre, NO_BALL_FOUND if there is none.
+    int ball_position;
+    // ball_position is the tracker's prediction; the ball was not seen in this frame.
+    bool ball_predicted;
+    // Offset of the tape from the frame centre, NO_EDGE_FOUND if there is none.
+    int corner_position;
+    // Column the ball is in.
+    int ball_column;
+    // The white mask had more runs than the labeller holds and was only partly labelled.
+    bool labelling_truncated;
+};
+
+struct StageDurations
+{
+    std::chrono::nanoseconds threshold, histogram, corners;
+};
+
+// Everything between a camera frame and the detections, without ROS: the frame is classified
+// into the white and red masks in two row bands, then the ball and edge detectors (see
+// detection_kernels.hpp) run on them in parallel, each on its own persistent worker. Used by the
+// image_processing node and by the offline benchmark.
+class FramePipeline
+{
+    private:
+        // Each detector runs as a stage on its own persistent worker.
+        enum Stage {
+            BALL_STAGE = 0,
+            EDGE_STAGE = 1
+        };
+
+        int lower_threshold, lower_red_value, min_ball_area, frame_height;
+        // What the masks are classified with: the thresholds set, or what auto_threshold made of them.
+        int white_threshold, red_threshold;
+        AutoThreshold auto_threshold;
+        bool auto_thresholding;
+        // Written by the ball and edge stage respectively, read once both are done.
+        int ball_stage_column, edge_stage_offset;
+        PixelLayout frame_layout;
+        // Where each detector looks, in full-frame coordinates and in the current frame's.
+        DetectorRegions regions, frame_regions;
+        // Produces the white and red masks in one pass over the frame.
+        PixelClassifier classifier;
+        MaskBackend backend;
+        bool keep_red_mask;
+#ifdef VISION_WITH_OPENCL
+        UMatClassifier umat_classifier;
+#endif
+        // Labels the white mask into ball candidates; owned by the ball stage.
+        BallDetector ball_detector;
+        // Follows the ball between frames and narrows ball_search around its prediction. Only used
+        // between stages, on the thread calling process().
+        BallTracker tracker;
+        bool tracking;
+        cv::Rect ball_search;
+        // Row band of the frame each worker classifies.
+        struct ClassifyBand
+        {
+            FramePipeline *self;
+            int row_begin, row_end;
+            // Intensities of the band, only counted while auto thresholding.
+            IntensityHistogram intensity;
+        } classify_bands[2];
+        // frame is shared read-only by all stages. The classify stage fills arena.white and arena.red in
+        // disjoint row bands; after that ball_candidates belongs to the ball stage and strip_counts to
+        // the edge stage.
+        cv::Mat frame;
+        FrameArena arena;
+        StageDurations durations;
+        // Possibly shared with the pipelines of other streams, see the constructors.
+        std::shared_ptr<PipelineExecutor> pipeline;
+        StageCompletion ball_done, edge_done;
+
+        static void run_classify_stage(void *context);
+        static void run_ball_stage(void *context);
+        static void run_edge_stage(void *context);
+
+        void classify_on_cpu();
+        void classify_on_device();
+        void update_auto_threshold();
+
+    public:
+        // worker_cpus holds the CPU each stage's worker is pinned to, indexed by Stage; -1 leaves
+        // a worker unpinned.
+        explicit FramePipeline(const std::vector<int> &worker_cpus);
+        // Runs the stages on workers shared with other pipelines, one worker per Stage. The workers
+        // take submissions from a single thread, so every pipeline sharing them has to be processed
+        // from the same thread.
+        explicit FramePipeline(std::shared_ptr<PipelineExecutor> workers);
+
+        FramePipeline(const FramePipeline &) = delete;
+        FramePipeline &operator=(const FramePipeline &) = delete;
+
+        // Take effect from the next frame, or on the CPU backend once the classifier has rebuilt its
+        // tables for them, usually a frame or two later. With auto thresholding they are the pair the red value was
+        // tuned with, see set_auto_threshold().
+        void set_thresholds(int lower_threshold, int lower_red_value);
+        // With auto thresholding the white threshold follows the lighting, from the intensities the
+        // classifier counts on its pass over each frame, and the red value keeps the offset from it
+        // it was given in set_thresholds(). The new thresholds apply as set_thresholds() ones do. Only the
+        // CPU backend counts intensities, so on a device backend the thresholds from set_thresholds()
+        // apply instead, see auto_threshold_active(). Enabling or a new config restarts from the next
+        // frame alone.
+        void set_auto_threshold(bool enabled, const AutoThresholdConfig &config);
+        // Whether the thresholds follow the lighting: auto thresholding is enabled and the backend
+        // is the CPU.
+        bool auto_threshold_active() const { return auto_thresholding && backend == MaskBackend::CPU; }
+        // Moves the margin without restarting, e.g. for an operator nudging it.
+        void set_auto_threshold_margin(int margin);
+        // Thresholds in effect, i.e. those the next frame is classified with.
+        int applied_lower_threshold() const { return white_threshold; }
+        int applied_lower_red_value() const { return red_threshold; }
+        void set_regions(const DetectorRegions &regions) { this->regions = regions; }
+        void set_min_ball_area(int area) { min_ball_area = area; }
+        // Without tracking every frame reports its own largest candidate. Changing either resets the track.
+        void set_tracking(bool enabled, const BallTrackerConfig &config);
+
+        // Returns false, leaving the CPU backend in place, if the backend was not built in or has no
+        // device to run on.
+        bool set_backend(MaskBackend backend);
+        MaskBackend mask_backend() const { return backend; }
+        // On the CPU the red mask is always there. A device backend only downloads it while this is
+        // set; otherwise buffers().red keeps whatever it last held.
+        void set_keep_red_mask(bool keep) { keep_red_mask = keep; }
+
+        // Runs the detectors over a frame viewed with view_frame(); height is the image height and
+        // stamp its capture time, which the tracker predicts from (0 if unknown). Returns true if
+        // the buffers had to be sized for this frame, which only happens on the first frame and
+        // when the frame size changes.
+        bool process(
+            const cv::Mat &frame,
+            PixelLayout layout,
+            int height,
+            std::chrono::nanoseconds stamp,
+            FrameDetections &detections);
+
+        // How long each stage of the last frame took.
+        const StageDurations &stage_durations() const { return durations; }
+
+        // Masks and ball candidates of the last frame, valid until the next process(). While a ball
+        // is tracked, candidates are only looked for near it.
+        const FrameArena &buffers() const { return arena; }
+};
+
+}  // namespace vision
+
+#endif  // VISION__FRAME_PIPELINE_HPP_
@@ -0,0 +1,8 @@
+#ifndef VISION__FRAME_SIZE_HPP_
+#define VISION__FRAME_SIZE_HPP_
+
+// Resolution the camera is configured for and the detectors are tuned to.
+#define WIDTH 360
+#define HEIGHT 240
+
+#endif  // VISION__FRAME_SIZE_HPP_
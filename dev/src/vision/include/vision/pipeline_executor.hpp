@@ -0,0 +1,133 @@
+#ifndef VISION__PIPELINE_EXECUTOR_HPP_
+#define VISION__PIPELINE_EXECUTOR_HPP_
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace vision
+{
+
+// Bounded lock-free ring buffer between exactly one producer and one consumer thread.
+template <typename T, std::size_t Capacity>
+class SpscQueue
+{
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+    private:
+        std::array<T, Capacity> items;
+        // Padded onto separate cache lines so the producer and consumer do not false-share.
+        // (Padding rather than alignas, since C++14 new does not honour over-alignment.)
+        std::atomic<std::size_t> head{0};
+        char head_padding[64 - sizeof(std::atomic<std::size_t>)];
+        std::atomic<std::size_t> tail{0};
+
+    public:
+        // Producer side. Returns false when the queue is full.
+        bool push(const T &item)
+        {
+            const std::size_t current_tail = tail.load(std::memory_order_relaxed);
+            if (current_tail - head.load(std::memory_order_acquire) == Capacity)
+                return false;
+
+            items[current_tail & (Capacity - 1)] = item;
+            tail.store(current_tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        // Consumer side. Returns false when the queue is empty.
+        bool pop(T &item)
+        {
+            const std::size_t current_head = head.load(std::memory_order_relaxed);
+            if (current_head == tail.load(std::memory_order_acquire))
+                return false;
+
+            item = items[current_head & (Capacity - 1)];
+            head.store(current_head + 1, std::memory_order_release);
+            return true;
+        }
+
+        // Consumer side.
+        bool empty() const
+        {
+            return head.load(std::memory_order_relaxed) == tail.load(std::memory_order_acquire);
+        }
+};
+
+// Signalled by a worker once its stage has finished. Waiting spins (yielding) for a while before
+// sleeping, since stages only last a few milliseconds and waking from a futex adds jitter. The spin
+// is bounded because yielding does not give way to a lower priority thread: a SCHED_FIFO waiter
+// sharing a CPU with the worker it waits for would otherwise spin forever.
+class StageCompletion
+{
+    private:
+        std::atomic<bool> done{true};
+        std::atomic<bool> sleeping{false};
+        std::mutex mutex;
+        std::condition_variable wake;
+
+    public:
+        void reset() { done.store(false, std::memory_order_relaxed); }
+        void signal();
+        bool ready() const { return done.load(std::memory_order_acquire); }
+
+        void wait();
+};
+
+// Small pool of persistent, optionally CPU-pinned worker threads. Each worker owns an SPSC
+// queue, so work has to be submitted from a single thread (the node's frame callback).
+// Tasks are a function pointer plus context so submitting never allocates.
+class PipelineExecutor
+{
+    private:
+        struct Task
+        {
+            void (*run)(void *context);
+            void *context;
+            StageCompletion *completion;
+        };
+
+        struct Worker
+        {
+            std::thread thread;
+            SpscQueue<Task, 8> queue;
+            std::mutex mutex;
+            std::condition_variable wake;
+            std::atomic<bool> sleeping{false};
+            // Signalled once the worker has tried to pin itself; scheduling_error says why it could not.
+            StageCompletion started;
+            std::string scheduling_error;
+        };
+
+        std::vector<std::unique_ptr<Worker>> workers;
+        std::atomic<bool> running;
+
+        void worker_loop(Worker &worker, int cpu);
+
+    public:
+        // Starts one worker per entry of cpus. A negative entry leaves that worker unpinned; one that
+        // cannot be pinned still runs, see scheduling_error().
+        explicit PipelineExecutor(const std::vector<int> &cpus);
+        ~PipelineExecutor();
+
+        PipelineExecutor(const PipelineExecutor &) = delete;
+        PipelineExecutor &operator=(const PipelineExecutor &) = delete;
+
+        std::size_t size() const { return workers.size(); }
+        // Why a worker could not be pinned to its CPU, empty if it was.
+        const std::string &scheduling_error(std::size_t worker) const { return workers.at(worker)->scheduling_error; }
+
+        // Queues run(context) on the given worker and resets completion; it is signalled once
+        // the task has run. Returns false if the worker's queue is full.
+        bool submit(std::size_t worker, void (*run)(void *), void *context, StageCompletion &completion);
+};
+
+}  // namespace vision
+
+#endif  // VISION__PIPELINE_EXECUTOR_HPP_
@@ -0,0 +1,165 @@
+#ifndef VISION__PIXEL_CLASSIFIER_HPP_
+#define VISION__PIXEL_CLASSIFIER_HPP_
+
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <opencv2/core.hpp>
+
+// sensor_msgs encodings for the camera's native formats. Spelled out here since older
+// sensor_msgs/image_encodings.hpp releases do not define them.
+#define YUYV_ENCODING "yuv422_yuy2"
+#define NV12_ENCODING "nv12"
+
+// HSV bounds of the red tape (OpenCV 8-bit HSV: hue is in [0, 180)). Red wraps around 180.
+#define RED_LOW_HUE_MAX 10
+#define RED_HIGH_HUE_MIN 170
+#define RED_MIN_SATURATION 120
+
+// Bins of the intensity histogram the classifier can fill as it goes.
+#define INTENSITY_BINS 256
+
+namespace vision
+{
+
+enum class PixelLayout
+{
+    BGR,
+    YUYV,
+    NV12
+};
+
+// Counts of the intensity the white test looks at: luma for YUYV and NV12, gray for BGR.
+using IntensityHistogram = std::array<uint32_t, INTENSITY_BINS>;
+
+// Layout of a sensor_msgs::Image encoding, or false if it is not one we classify natively.
+bool pixel_layout_from_encoding(const std::string &encoding, PixelLayout &layout);
+
+// Camera luma is BT.601 limited range, so a gray threshold from the BGR path maps to
+// 16 + gray / 1.164 on the Y plane.
+int luma_threshold_from_gray(int gray_threshold);
+
+// The exact per-pixel tests the BGR table stands in for: gray as cv::COLOR_BGR2GRAY computes it,
+// and the red tape test, i.e. cv::COLOR_BGR2HSV followed by the two inRange calls.
+int bgr_gray(int b, int g, int r);
+bool is_red_bgr(int b, int g, int r, int lower_red_value);
+
+// Splits every pixel into white (golf ball), red (tape) or background, writing both masks in
+// a single pass over the frame. The lookup tables behind it depend only on lower_threshold
+// and lower_red_value. After the first frame they are rebuilt on a builder thread of their
+// own and swapped in whole, so a new threshold never stalls the frame it arrives on.
+class PixelClassifier
+{
+    private:
+        // BGR table: 5 bits per channel, 32 KB. A cell is a cube of 8x8x8 colours, marked white or
+        // red only if every colour in it is; cells that may straddle a threshold are flagged and
+        // those pixels get the exact test instead, so the masks match the exact tests.
+        static constexpr int BGR_SHIFT = 3;
+        static constexpr int BGR_CELLS = 256 >> BGR_SHIFT;
+        enum CellClass : uint8_t {
+            CELL_WHITE = 1,
+            CELL_RED = 2,
+            CELL_CHECK_WHITE = 4,
+            CELL_CHECK_RED = 8
+        };
+
+        // YUV table: per quantised (U, V), the luma interval for which the red test passes.
+        // For a fixed chroma, raising Y scales the HSV value up and the saturation down, so
+        // the passing lumas form one contiguous interval. 8 KB.
+        static constexpr int CHROMA_SHIFT = 2;
+        static constexpr int CHROMA_CELLS = 256 >> CHROMA_SHIFT;
+
+        // One set of tables. Only the half the layout reads is built: the BGR cells for BGR, the
+        // chroma table and luma threshold for YUYV and NV12.
+        struct Tables
+        {
+            std::array<uint8_t, BGR_CELLS * BGR_CELLS * BGR_CELLS> bgr_cells;
+            std::array<uint8_t, CHROMA_CELLS * CHROMA_CELLS> lowest_red_luma, highest_red_luma;
+            // What each half was built for, -1 until it has been.
+            int bgr_lower_threshold, bgr_lower_red_value;
+            int yuv_lower_threshold, yuv_lower_red_value, luma_threshold;
+
+            Tables();
+            bool built_for(bool bgr, int lower_threshold, int lower_red_value) const;
+            bool built(bool bgr) const;
+            // Rebuilds only what changed since the half was last built.
+            void build(bool bgr, int lower_threshold, int lower_red_value);
+            void build_bgr_table(bool white, bool red);
+            void build_chroma_table();
+        };
+
+        struct Request
+        {
+            bool bgr;
+            int lower_threshold, lower_red_value;
+        };
+
+        enum class BackState
+        {
+            IDLE,
+            BUILDING,
+            READY
+        };
+
+        // classify() reads front; the builder thread writes back, and configure() swaps them once
+        // back is READY. Everything below tables is guarded by mutex.
+        std::array<Tables, 2> tables;
+        Tables *front, *back;
+        std::mutex mutex;
+        std::condition_variable wake;
+        BackState back_state;
+        Request building, requested;
+        bool has_request, running;
+        std::thread builder;
+
+        void run_builder();
+
+        void classify_bgr(const cv::Mat &bgr, int row_begin, int row_end, cv::Mat &white, cv::Mat &red, IntensityHistogram *histogram) const;
+        void classify_yuyv(const cv::Mat &yuyv, int row_begin, int row_end, cv::Mat &white, cv::Mat &red, IntensityHistogram *histogram) const;
+        void classify_nv12(
+            const cv::Mat &nv12,
+            int height,
+            int row_begin,
+            int row_end,
+            cv::Mat &white,
+            cv::Mat &red,
+            IntensityHistogram *histogram) const;
+
+    public:
+        PixelClassifier();
+        ~PixelClassifier();
+        PixelClassifier(const PixelClassifier &) = delete;
+        PixelClassifier &operator=(const PixelClassifier &) = delete;
+
+        // Asks for tables for these thresholds and the layout of the frames to come. The first call
+        // for a layout builds them before returning; later ones hand the work to the builder, and
+        // classify() keeps to the previous thresholds until a later configure() finds the new
+        // tables ready, usually a frame or two on. Requests made in the meantime collapse into the
+        // latest. Must not run concurrently with classify().
+        void configure(int lower_threshold, int lower_red_value, PixelLayout layout);
+        // Whether classify() applies these thresholds to the layout yet. Call it from the thread
+        // that calls configure().
+        bool uses(int lower_threshold, int lower_red_value, PixelLayout layout) const;
+
+        // Classifies rows [row_begin, row_end). white and red must already be height x width
+        // CV_8UC1; disjoint row bands can be classified from different threads. For NV12,
+        // frame holds the Y plane followed by the UV plane, and height is the image height. With a
+        // histogram, the intensity of every classified pixel is added to it on the same pass.
+        void classify(
+            const cv::Mat &frame,
+            PixelLayout layout,
+            int height,
+            int row_begin,
+            int row_end,
+            cv::Mat &white,
+            cv::Mat &red,
+            IntensityHistogram *histogram = nullptr) const;
+};
+
+}  // namespace vision
+
+#endif  // VISION__PIXEL_CLASSIFIER_HPP_
@@ -0,0 +1,75 @@
+#ifndef VISION__PREVIEW_STREAM_HPP_
+#define VISION__PREVIEW_STREAM_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <image_transport/image_transport.hpp>
+#include <opencv2/core.hpp>
+
+#include "rclcpp/rclcpp.hpp"
+#include "std_msgs/msg/header.hpp"
+#include "vision/pixel_classifier.hpp"
+
+namespace vision
+{
+
+// A scaled down copy of a frame or mask for watching the robot remotely, e.g. over Wi-Fi, through
+// image_transport. Every transport plugin installed is offered: compressed (JPEG), and e.g.
+// ffmpeg_image_transport for H.264 on the hardware encoder. A plugin only encodes for its own
+// subscribers, and frames are only wanted while there are any, at most max_rate times a second,
+// so with nobody watching nothing is copied, scaled or encoded. Frames are converted, scaled down
+// by decimation and published on their own thread; one arriving while the last is still being
+// published replaces it.
+class PreviewStream
+{
+    private:
+        struct Frame
+        {
+            std_msgs::msg::Header header;
+            cv::Mat image;
+            PixelLayout layout;
+        };
+
+        rclcpp::Node *node;
+        image_transport::Publisher publisher;
+        int decimation;
+        std::atomic<int64_t> period_ns;
+        std::chrono::steady_clock::time_point last_frame;
+
+        std::mutex mutex;
+        std::condition_variable wake;
+        // pending is handed to the thread; spare is the buffer the next frame is copied into, so
+        // steady streaming reuses the same two images.
+        std::unique_ptr<Frame> pending, spare;
+        bool running;
+        std::thread thread;
+
+        void publish_loop();
+        void publish(Frame &frame);
+
+    public:
+        // decimation is the factor both sides are divided by, at least 1.
+        PreviewStream(rclcpp::Node *node, const std::string &topic, int decimation, double max_rate);
+        ~PreviewStream();
+
+        PreviewStream(const PreviewStream &) = delete;
+        PreviewStream &operator=(const PreviewStream &) = delete;
+
+        void set_max_rate(double rate);
+
+        // True when the current frame should be submitted.
+        bool wanted();
+        // Copies frame, a BGR, YUYV or NV12 image as viewed by layout. A single channel BGR
+        // image, e.g. a mask, is published as mono8.
+        void submit(const std_msgs::msg::Header &header, const cv::Mat &frame, PixelLayout layout = PixelLayout::BGR);
+};
+
+}  // namespace vision
+
+#endif  // VISION__PREVIEW_STREAM_HPP_
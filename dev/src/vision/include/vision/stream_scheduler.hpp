@@ -0,0 +1,94 @@
+#ifndef VISION__STREAM_SCHEDULER_HPP_
+#define VISION__STREAM_SCHEDULER_HPP_
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace vision
+{
+
+// Hands the frames of several streams to a single processing thread. Each stream only holds its
+// newest frame, a frame that arrives before the last one was taken replacing it, and streams with
+// a frame waiting are served round robin starting after the one served last, so a faster camera
+// cannot starve a slower one. Frame is a pointer type, null meaning no frame.
+template <typename Frame>
+class StreamScheduler
+{
+    private:
+        std::mutex mutex;
+        std::condition_variable ready;
+        std::vector<Frame> pending;
+        std::size_t next_stream;
+        bool running;
+
+    public:
+        explicit StreamScheduler(std::size_t streams)
+        : pending(streams), next_stream(0), running(true)
+        {
+        }
+
+        std::size_t size() const { return pending.size(); }
+
+        // Any thread. Returns true if it replaced a frame of the stream that was never taken.
+        bool submit(std::size_t stream, Frame frame)
+        {
+            bool replaced;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                replaced = static_cast<bool>(pending[stream]);
+                pending[stream] = std::move(frame);
+            }
+            ready.notify_one();
+            return replaced;
+        }
+
+        // Blocks until a stream has a frame and takes it, or returns false once stopped. waiting is
+        // how many streams had a frame at that point, the taken one included.
+        bool take(std::size_t &stream, Frame &frame, std::size_t &waiting)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            for (;;)
+            {
+                if (!running)
+                    return false;
+
+                waiting = 0;
+                for (const auto &candidate : pending)
+                    waiting += static_cast<bool>(candidate);
+
+                for (std::size_t i = 0; waiting > 0 && i < pending.size(); i++)
+                {
+                    std::size_t candidate = (next_stream + i) % pending.size();
+                    if (pending[candidate])
+                    {
+                        stream = candidate;
+                        frame = std::move(pending[candidate]);
+                        pending[candidate] = nullptr;
+                        next_stream = (candidate + 1) % pending.size();
+                        return true;
+                    }
+                }
+
+                ready.wait(lock);
+            }
+        }
+
+        // Wakes take() for good and drops whatever is still pending.
+        void stop()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                running = false;
+                for (auto &frame : pending)
+                    frame = nullptr;
+            }
+            ready.notify_all();
+        }
+};
+
+}  // namespace vision
+
+#endif  // VISION__STREAM_SCHEDULER_HPP_
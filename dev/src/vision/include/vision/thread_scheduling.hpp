@@ -0,0 +1,17 @@
+#ifndef VISION__THREAD_SCHEDULING_HPP_
+#define VISION__THREAD_SCHEDULING_HPP_
+
+#include <string>
+
+namespace vision
+{
+
+// Pins the calling thread to cpu and, if realtime_priority is above 0, moves it to SCHED_FIFO at
+// that priority (1-99). A negative cpu leaves the thread's affinity alone. A realtime priority
+// needs CAP_SYS_NICE or an rtprio limit (see limits.conf); if either step fails, error says why
+// and false is returned, leaving the thread running as before for whatever failed.
+bool set_thread_scheduling(int cpu, int realtime_priority, std::string &error);
+
+}  // namespace vision
+
+#endif  // VISION__THREAD_SCHEDULING_HPP_
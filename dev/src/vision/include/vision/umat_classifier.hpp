@@ -0,0 +1,54 @@
+#ifndef VISION__UMAT_CLASSIFIER_HPP_
+#define VISION__UMAT_CLASSIFIER_HPP_
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "vision/detector_regions.hpp"
+#include "vision/pixel_classifier.hpp"
+
+namespace vision
+{
+
+// The mask stage on the GPU through OpenCV's transparent API (cv::UMat, i.e. OpenCL). Each frame
+// is uploaded once, from the first row a detector looks at down. The white mask comes back
+// because the ball labeller walks it on the CPU; of the red mask only the column counts of the
+// two tape strips come back, as one small download. The full red mask is only downloaded when
+// asked for, e.g. for the debug view.
+//
+// Produces the same masks as PixelClassifier up to rounding: gray and the luma threshold are
+// compared directly, red goes through cv::COLOR_BGR2HSV and inRange on the device.
+class UMatClassifier
+{
+    private:
+        // Device buffers, reallocated only when the frame size changes.
+        cv::UMat device_frame, bgr, luma, hsv, white, red, red_high, strip_counts;
+        int lower_threshold, lower_red_value, luma_threshold;
+
+    public:
+        UMatClassifier();
+
+        // True if OpenCV was built with OpenCL and a device is available for it.
+        static bool available();
+
+        void configure(int lower_threshold, int lower_red_value);
+
+        // Classifies rows [row_begin, height) of a frame viewed with view_frame(). white (and red,
+        // if given) must already be height x width CV_8UC1. regions are in frame coordinates;
+        // strip_counts is resized to hold the red counts of regions.left_edge followed by those of
+        // regions.right_edge.
+        void classify(
+            const cv::Mat &frame,
+            PixelLayout layout,
+            int height,
+            int row_begin,
+            const DetectorRegions &regions,
+            cv::Mat &white,
+            cv::Mat *red,
+            std::vector<int> &strip_counts);
+};
+
+}  // namespace vision
+
+#endif  // VISION__UMAT_CLASSIFIER_HPP_
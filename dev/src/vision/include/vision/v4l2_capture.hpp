@@ -0,0 +1,84 @@
+#ifndef VISION__V4L2_CAPTURE_HPP_
+#define VISION__V4L2_CAPTURE_HPP_
+
+#include <linux/videodev2.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace vision
+{
+
+// One filled kernel buffer. data points into the driver's mmap'd memory and stays valid
+// until the frame is handed back with V4l2Capture::requeue().
+struct V4l2Frame
+{
+    const uint8_t *data;
+    std::size_t bytes_used;
+    uint32_t sequence;
+    // Time the driver captured the frame, in nanoseconds on CLOCK_MONOTONIC.
+    int64_t monotonic_stamp_ns;
+    uint32_t index;
+};
+
+// Minimal V4L2 streaming capture: configures the format and frame rate, then streams
+// through a small ring of mmap'd buffers. Errors are reported as std::runtime_error.
+class V4l2Capture
+{
+    private:
+        struct Buffer
+        {
+            void *start;
+            std::size_t length;
+        };
+
+        int fd;
+        bool streaming, cropped;
+        std::vector<Buffer> buffers;
+        uint32_t width, height, pixel_format, bytes_per_line;
+
+        int xioctl(unsigned long request, void *argument);
+        bool set_format(uint32_t requested_width, uint32_t requested_height, uint32_t requested_pixel_format);
+        bool crop_top_rows(uint32_t rows);
+
+    public:
+        V4l2Capture();
+        ~V4l2Capture();
+
+        V4l2Capture(const V4l2Capture &) = delete;
+        V4l2Capture &operator=(const V4l2Capture &) = delete;
+
+        // Opens the device and starts streaming. The driver may pick the closest supported
+        // resolution, so check get_width()/get_height() afterwards. With crop_rows set, the
+        // top crop_rows rows are cropped away on the sensor through the V4L2 selection API if
+        // the driver supports it; is_cropped() tells whether that worked.
+        void open(
+            const std::string &device,
+            uint32_t requested_width,
+            uint32_t requested_height,
+            uint32_t fps,
+            uint32_t requested_pixel_format,
+            uint32_t crop_rows = 0,
+            uint32_t buffer_count = 4);
+        void close();
+        bool is_open() const { return fd != -1; }
+        bool is_cropped() const { return cropped; }
+
+        // Waits up to timeout_ms for the next frame. Returns false on timeout.
+        bool dequeue(V4l2Frame &frame, int timeout_ms);
+        void requeue(const V4l2Frame &frame);
+
+        uint32_t get_width() const { return width; }
+        uint32_t get_height() const { return height; }
+        uint32_t get_pixel_format() const { return pixel_format; }
+        uint32_t get_bytes_per_line() const { return bytes_per_line; }
+};
+
+// Converts a string such as "YUYV" or "MJPG" into a V4L2 fourcc.
+uint32_t fourcc_from_string(const std::string &name);
+
+}  // namespace vision
+
+#endif  // VISION__V4L2_CAPTURE_HPP_
@@ -0,0 +1,59 @@
+#include "vision/allocation_counter.hpp"
+
+#include <dlfcn.h>
+
+#include <new>
+
+namespace vision
+{
+
+// The preloaded counter's entry points, null when it is not loaded.
+struct AllocationCounter
+{
+    bool (*set_counting)(bool enabled);
+    std::size_t (*allocations)();
+};
+
+static const AllocationCounter &allocation_counter()
+{
+    static const AllocationCounter counter = {
+        reinterpret_cast<bool (*)(bool)>(dlsym(RTLD_DEFAULT, "vision_allocation_counter_set_counting")),
+        reinterpret_cast<std::size_t (*)()>(dlsym(RTLD_DEFAULT, "vision_allocation_counter_allocations"))
+    };
+    return counter;
+}
+
+AllocationScope::AllocationScope() : previous(false)
+{
+    if (allocation_counter().set_counting != nullptr)
+        previous = allocation_counter().set_counting(true);
+}
+
+AllocationScope::~AllocationScope()
+{
+    if (allocation_counter().set_counting != nullptr)
+        allocation_counter().set_counting(previous);
+}
+
+bool allocation_counting_active()
+{
+    if (allocation_counter().set_counting == nullptr || allocation_counter().allocations == nullptr)
+        return false;
+
+    // Loaded is not enough: its malloc only counts if it is the one in use, i.e. was preloaded. The volatile store keeps the compiler from eliding the probe.
+    static void *volatile probe;
+    std::size_t before = counted_allocations();
+    {
+        AllocationScope scope;
+        probe = ::operator new(1);
+    }
+    ::operator delete(probe);
+    return counted_allocations() != before;
+}
+
+std::size_t counted_allocations()
+{
+    return allocation_counter().allocations != nullptr ? allocation_counter().allocations() : 0;
+}
+
+}  // namespace vision
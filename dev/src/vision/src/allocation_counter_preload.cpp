@@ -0,0 +1,81 @@
+// libvision_allocation_counter.so: counting versions of the C allocation functions, for LD_PRELOAD
+// only. operator new, cv::fastMalloc and most other allocators end up in these, so replacing them
+// catches a cv::Mat being allocated as well as a std::vector. Nothing links against the module, so
+// without the preload the C library's allocator stays in place. vision_core finds the counter
+// through the functions below at runtime, see src/allocation_counter.cpp.
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+
+// glibc's own allocator, which the functions below forward to. Going through these rather than
+// dlsym(RTLD_NEXT) means nothing has to be looked up before the first allocation.
+extern "C" void *__libc_malloc(std::size_t size);
+extern "C" void *__libc_calloc(std::size_t count, std::size_t size);
+extern "C" void *__libc_realloc(void *pointer, std::size_t size);
+extern "C" void *__libc_memalign(std::size_t alignment, std::size_t size);
+
+// Initial exec, so that reading it never allocates on the thread's first access.
+static thread_local bool counting __attribute__((tls_model("initial-exec"))) = false;
+static std::atomic<std::size_t> allocations{0};
+
+extern "C" bool vision_allocation_counter_set_counting(bool enabled)
+{
+    bool previous = counting;
+    counting = enabled;
+    return previous;
+}
+
+extern "C" std::size_t vision_allocation_counter_allocations()
+{
+    return allocations.load(std::memory_order_relaxed);
+}
+
+static void count()
+{
+    if (counting)
+        allocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+extern "C" void *malloc(std::size_t size)
+{
+    count();
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(std::size_t number, std::size_t size)
+{
+    count();
+    return __libc_calloc(number, size);
+}
+
+extern "C" void *realloc(void *pointer, std::size_t size)
+{
+    count();
+    return __libc_realloc(pointer, size);
+}
+
+extern "C" int posix_memalign(void **pointer, std::size_t alignment, std::size_t size)
+{
+    if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0)
+        return EINVAL;
+
+    count();
+    void *allocated = __libc_memalign(alignment, size);
+    if (allocated == nullptr)
+        return ENOMEM;
+    *pointer = allocated;
+    return 0;
+}
+
+extern "C" void *aligned_alloc(std::size_t alignment, std::size_t size)
+{
+    count();
+    return __libc_memalign(alignment, size);
+}
+
+extern "C" void *memalign(std::size_t alignment, std::size_t size)
+{
+    count();
+    return __libc_memalign(alignment, size);
+}
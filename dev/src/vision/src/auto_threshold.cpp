@@ -0,0 +1,52 @@
+#include "vision/auto_threshold.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+namespace vision
+{
+
+AutoThreshold::AutoThreshold(const AutoThresholdConfig &config) : config(config)
+{
+    reset();
+}
+
+void AutoThreshold::reset()
+{
+    level = -1.0f;
+    applied = -1;
+}
+
+int AutoThreshold::update(const IntensityHistogram &histogram, bool luma, int fallback)
+{
+    uint64_t total = 0;
+    for (uint32_t count : histogram)
+        total += count;
+    if (total == 0)
+        return applied < 0 ? fallback : applied;
+
+    uint64_t background = static_cast<uint64_t>(std::ceil(config.background_percentile * total));
+    uint64_t cumulative = 0;
+    int bin = 0;
+    for (; bin < INTENSITY_BINS - 1; bin++)
+    {
+        cumulative += histogram[bin];
+        if (cumulative >= background)
+            break;
+    }
+
+    // Camera luma is BT.601 limited range; thresholds are in gray, as luma_threshold_from_gray()
+    // converts them back.
+    float brightest_background = luma ? 1.164f * (bin - 16) : static_cast<float>(bin);
+    float target = std::min<float>(config.max_threshold, std::max<float>(config.min_threshold, brightest_background + config.margin));
+
+    level = level < 0.0f ? target : level + config.smoothing * (target - level);
+    int candidate = static_cast<int>(level + 0.5f);
+    if (applied < 0 || std::abs(candidate - applied) >= config.hysteresis)
+        applied = candidate;
+
+    return applied;
+}
+
+}  // namespace vision
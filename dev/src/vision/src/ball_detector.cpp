@@ -0,0 +1,147 @@
+#include "vision/ball_detector.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace vision
+{
+
+BallDetector::BallDetector(std::size_t max_runs)
+: runs(max_runs), parent(max_runs), blobs(max_runs), run_count(0), truncated(false)
+{
+    found.reserve(max_runs);
+}
+
+int BallDetector::find_root(int run)
+{
+    while (parent[run] != run)
+    {
+        // Path halving keeps the trees flat without recursion.
+        parent[run] = parent[parent[run]];
+        run = parent[run];
+    }
+    return run;
+}
+
+void BallDetector::join(int a, int b)
+{
+    a = find_root(a);
+    b = find_root(b);
+    // The older run becomes the root, so roots always precede their children.
+    if (a < b)
+        parent[b] = a;
+    else if (b < a)
+        parent[a] = b;
+}
+
+void BallDetector::label(const cv::Mat &mask, const cv::Rect &region)
+{
+    run_count = 0;
+    truncated = false;
+
+    // Runs of the previous row are [previous_begin, previous_end).
+    std::size_t previous_begin = 0, previous_end = 0;
+
+    for (int row = region.y; row < region.y + region.height; row++)
+    {
+        const uint8_t *pixels = mask.ptr<uint8_t>(row);
+        std::size_t row_begin = run_count;
+        std::size_t above = previous_begin;
+
+        int x = region.x;
+        int end = region.x + region.width;
+        while (x < end)
+        {
+            // Background dominates the mask, so skip it eight pixels at a time.
+            uint64_t chunk;
+            while (x + 8 <= end && (std::memcpy(&chunk, pixels + x, sizeof(chunk)), chunk == 0))
+                x += 8;
+            while (x < end && pixels[x] == 0)
+                x++;
+            if (x == end)
+                break;
+
+            int start = x;
+            while (x < end && pixels[x] != 0)
+                x++;
+
+            if (run_count == runs.size())
+            {
+                truncated = true;
+                return;
+            }
+
+            int index = static_cast<int>(run_count++);
+            runs[index] = {static_cast<int16_t>(row), static_cast<int16_t>(start), static_cast<int16_t>(x - 1)};
+            parent[index] = index;
+
+            // 8-connectivity: runs of the row above touching [start - 1, x] are the same blob. Runs
+            // are ordered by column, so the scan resumes where the last run of this row left off.
+            while (above < previous_end && runs[above].end < start - 1)
+                above++;
+            for (std::size_t i = above; i < previous_end && runs[i].start <= x; i++)
+                join(static_cast<int>(i), index);
+        }
+
+        previous_begin = row_begin;
+        previous_end = run_count;
+    }
+}
+
+void BallDetector::detect(const cv::Mat &mask, const cv::Rect &region, int min_area, std::vector<BallCandidate> &candidates)
+{
+    CV_Assert(mask.type() == CV_8UC1);
+
+    candidates.clear();
+    cv::Rect bounds = region & cv::Rect(0, 0, mask.cols, mask.rows);
+    if (bounds.empty())
+        return;
+
+    label(mask, bounds);
+
+    // Roots precede their children, so one forward pass resolves every run and accumulates
+    // its blob into the root's slot.
+    found.clear();
+    for (std::size_t i = 0; i < run_count; i++)
+    {
+        const Run &run = runs[i];
+        int length = run.end - run.start + 1;
+        int root = find_root(static_cast<int>(i));
+        Blob &blob = blobs[root];
+
+        if (root == static_cast<int>(i))
+            blob = {0, 0, 0, run.start, run.row, run.end, run.row};
+
+        blob.area += length;
+        blob.sum_x += static_cast<int64_t>(run.start + run.end) * length / 2;
+        blob.sum_y += static_cast<int64_t>(run.row) * length;
+        blob.left = std::min(blob.left, run.start);
+        blob.right = std::max(blob.right, run.end);
+        blob.bottom = run.row;
+    }
+
+    for (std::size_t i = 0; i < run_count; i++)
+    {
+        if (parent[i] != static_cast<int>(i) || blobs[i].area < min_area)
+            continue;
+
+        const Blob &blob = blobs[i];
+        found.push_back({
+            static_cast<float>(blob.sum_x) / blob.area,
+            static_cast<float>(blob.sum_y) / blob.area,
+            blob.area,
+            cv::Rect(blob.left, blob.top, blob.right - blob.left + 1, blob.bottom - blob.top + 1)
+        });
+    }
+
+    std::size_t count = std::min<std::size_t>(found.size(), MAX_BALL_CANDIDATES);
+    std::partial_sort(
+        found.begin(),
+        found.begin() + count,
+        found.end(),
+        [](const BallCandidate &a, const BallCandidate &b) { return a.area > b.area; }
+    );
+    candidates.assign(found.begin(), found.begin() + count);
+}
+
+}  // namespace vision
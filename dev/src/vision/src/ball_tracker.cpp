@@ -0,0 +1,112 @@
+#include "vision/ball_tracker.hpp"
+
+#include <cmath>
+
+namespace vision
+{
+
+// Frame interval assumed for unstamped frames, i.e. the camera's 30 fps.
+static constexpr float NOMINAL_FRAME_SECONDS = 1.0f / 30.0f;
+static constexpr float MAX_FRAME_GAP_SECONDS = 0.5f;
+
+BallTracker::BallTracker(const BallTrackerConfig &config) : config(config)
+{
+    reset();
+}
+
+void BallTracker::reset()
+{
+    state = State::SEARCHING;
+    position = velocity = predicted = 0.0f;
+    dt = NOMINAL_FRAME_SECONDS;
+    hits = misses = 0;
+    last_stamp = std::chrono::nanoseconds(0);
+}
+
+void BallTracker::predict(std::chrono::nanoseconds stamp)
+{
+    dt = NOMINAL_FRAME_SECONDS;
+    if (stamp.count() != 0 && last_stamp.count() != 0)
+        dt = std::chrono::duration<float>(stamp - last_stamp).count();
+    last_stamp = stamp;
+
+    if (dt <= 0.0f)
+        dt = NOMINAL_FRAME_SECONDS;
+    else if (dt > MAX_FRAME_GAP_SECONDS)
+        state = State::SEARCHING;
+
+    predicted = position + velocity * dt;
+}
+
+cv::Rect BallTracker::search_region(const cv::Rect &region) const
+{
+    if (state != State::TRACKING || misses > 0 || config.search_margin <= 0)
+        return region;
+
+    int centre = static_cast<int>(std::lround(predicted));
+    cv::Rect window(centre - config.search_margin, region.y, 2 * config.search_margin + 1, region.height);
+    return window & region;
+}
+
+const BallCandidate *BallTracker::gated_candidate(const std::vector<BallCandidate> &candidates) const
+{
+    const BallCandidate *nearest = nullptr;
+    float nearest_distance = config.gate;
+    for (const auto &candidate : candidates)
+    {
+        float distance = std::fabs(candidate.centroid_x - predicted);
+        if (distance <= nearest_distance)
+        {
+            nearest = &candidate;
+            nearest_distance = distance;
+        }
+    }
+
+    return nearest;
+}
+
+void BallTracker::start(const BallCandidate &candidate)
+{
+    state = config.confirm_frames <= 1 ? State::TRACKING : State::TENTATIVE;
+    position = predicted = candidate.centroid_x;
+    velocity = 0.0f;
+    hits = 1;
+    misses = 0;
+}
+
+bool BallTracker::update(const std::vector<BallCandidate> &candidates, int &column)
+{
+    const BallCandidate *match = state == State::SEARCHING ? nullptr : gated_candidate(candidates);
+
+    if (match != nullptr)
+    {
+        float residual = match->centroid_x - predicted;
+        position = predicted + config.alpha * residual;
+        velocity += config.beta * residual / dt;
+        misses = 0;
+        if (state == State::TENTATIVE && ++hits >= config.confirm_frames)
+            state = State::TRACKING;
+    }
+    else if (state == State::TRACKING && ++misses <= config.max_coast_frames)
+    {
+        position = predicted;
+    }
+    else if (!candidates.empty())
+    {
+        // Nothing to follow, or what was followed is gone: the largest candidate is the best new guess.
+        start(candidates.front());
+    }
+    else
+    {
+        state = State::SEARCHING;
+        velocity = 0.0f;
+    }
+
+    if (state != State::TRACKING)
+        return false;
+
+    column = static_cast<int>(std::lround(position));
+    return true;
+}
+
+}  // namespace vision
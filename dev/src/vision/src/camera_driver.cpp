@@ -1,66 +1,523 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <thread>
+
 #include "cv_bridge/cv_bridge.h"
+#include "instrumentation/latency_reporter.hpp"
+#include "instrumentation/node_health.hpp"
 #include "opencv2/opencv.hpp"
 #include "rclcpp/rclcpp.hpp"
+#include "rclcpp_components/register_node_macro.hpp"
+#include "sensor_msgs/msg/compressed_image.hpp"
 #include "sensor_msgs/msg/image.hpp"
 #include "std_msgs/msg/header.hpp"
+#include "std_msgs/msg/u_int64.hpp"
+#include "vision/frame_size.hpp"
+#include "vision/pixel_classifier.hpp"
+#include "vision/preview_stream.hpp"
+#include "vision/v4l2_capture.hpp"
+
+// How long the capture thread waits for a frame before checking whether it should stop.
+#define CAPTURE_TIMEOUT_MS 100
+// Wait before trying to open a V4L2 device again that could not be opened or went away, doubling
+// after every failed attempt up to the maximum.
+#define REOPEN_MIN_BACKOFF_MS 100
+#define REOPEN_MAX_BACKOFF_MS 5000
+// Capture and open errors are logged at most once per this period.
+#define ERROR_LOG_PERIOD_MS 5000
+
+namespace vision
+{
 
 class CameraDriver : public rclcpp::Node
 {
     private:
+        // What the per-stage latencies are recorded under, see instrumentation/latency_reporter.hpp.
+        // capture is how long a frame sat in the kernel before it was dequeued.
+        enum LatencyStage {
+            CAPTURE_LATENCY = 0,
+            CONVERT_LATENCY,
+            PUBLISH_LATENCY
+        };
+        // What the node's health is recorded under, see instrumentation/node_health.hpp. frame is
+        // everything done with a frame once the device has delivered it; dropped are the frames the
+        // driver lost.
+        enum HealthCallback {
+            FRAME_CALLBACK = 0
+        };
+
+        std::string capture_mode, device, pixel_format;
+        int width, height, fps, roi_top;
+        bool publish_native, have_sequence;
+        uint32_t last_sequence;
+        uint64_t dropped_frames;
         cv::VideoCapture capture;
-        rclcpp::TimerBase::SharedPtr timer;
+        V4l2Capture v4l2_capture;
+        cv::Mat converted;
+        std::atomic<bool> running;
+        std::thread capture_thread;
         rclcpp::Publisher<sensor_msgs::msg::Image>::SharedPtr image_publisher;
+        rclcpp::Publisher<sensor_msgs::msg::CompressedImage>::SharedPtr jpeg_publisher;
+        std::unique_ptr<PreviewStream> preview;
+        rclcpp::Publisher<std_msgs::msg::UInt64>::SharedPtr dropped_frames_publisher;
+        std::unique_ptr<instrumentation::LatencyReporter> latency;
+        std::unique_ptr<instrumentation::NodeHealth> health;
 
     public:
-        CameraDriver() : Node("camera_driver")
+        explicit CameraDriver(const rclcpp::NodeOptions &options = rclcpp::NodeOptions())
+        : Node("camera_driver", options), have_sequence(false), last_sequence(0), dropped_frames(0), running(false)
         {
+            // "v4l2" streams mmap'd kernel buffers and stamps frames with the capture time.
+            // "opencv" goes through cv::VideoCapture for cameras the V4L2 path cannot drive.
+            capture_mode = declare_parameter("capture_mode", std::string("v4l2"));
+            device = declare_parameter("device", std::string("/dev/video0"));
+            width = declare_parameter("width", WIDTH);
+            height = declare_parameter("height", HEIGHT);
+            fps = declare_parameter("fps", 30);
+            // MJPG, YUYV or NV12.
+            pixel_format = declare_parameter("pixel_format", std::string("MJPG"));
+            // Publish YUYV/NV12 frames as they come from the sensor instead of converting to BGR.
+            // image_processing classifies these natively. The device has to capture at width x height
+            // then, since nothing resizes them.
+            publish_native = declare_parameter("publish_native", false);
+            // Rows to drop from the top of every frame, since no detector looks at them. image_processing
+            // treats shorter frames as the bottom part of a WIDTH x HEIGHT frame. The crop is done on the
+            // sensor when the driver supports V4L2 selection, otherwise before colour conversion.
+            roi_top = declare_parameter("roi_top", 0);
+            // Kept even so YUYV/NV12 chroma rows stay aligned.
+            roi_top = std::max(0, std::min(roi_top, height - 2)) & ~1;
+
+            // Best effort with a queue of one, so a slow subscriber only ever gets the newest frame.
+            // image_processing's freshest_only must match.
+            bool freshest_only = declare_parameter("freshest_only", true);
             image_publisher = create_publisher<sensor_msgs::msg::Image>(
                 "image_raw",
-                10
+                freshest_only ? rclcpp::QoS(1).best_effort() : rclcpp::QoS(10)
+            );
+            dropped_frames_publisher = create_publisher<std_msgs::msg::UInt64>("dropped_frames", 10);
+            // For watching remotely without pulling image_raw over the network. image_preview carries
+            // every preview_decimation-th pixel of each side, at most preview_rate times a second, on
+            // all the transports image_transport has, see vision/preview_stream.hpp. With MJPG capture
+            // image_raw/compressed carries the JPEG the camera encoded, as it came from the sensor. Both
+            // only cost anything while someone subscribes.
+            preview = std::make_unique<PreviewStream>(
+                this,
+                "image_preview",
+                declare_parameter("preview_decimation", 2),
+                declare_parameter("preview_rate", 10.0)
+            );
+            jpeg_publisher = create_publisher<sensor_msgs::msg::CompressedImage>(
+                "image_raw/compressed",
+                rclcpp::QoS(1).best_effort()
+            );
+            latency = std::make_unique<instrumentation::LatencyReporter>(
+                this,
+                std::vector<std::string>{"capture", "convert", "publish"}
             );
+            health = std::make_unique<instrumentation::NodeHealth>(this, std::vector<std::string>{"frame"});
 
-            using namespace std::chrono_literals;
-            capture = cv::VideoCapture(0, cv::CAP_V4L);
+            if (capture_mode == "v4l2")
+                open_v4l2();
+            else
+                open_opencv();
 
-            timer = create_wall_timer(
-                0.1ms,
-                std::bind(&CameraDriver::read_image, this)
-            );
+            // Capture blocks on the device, so it gets its own thread and publishes exactly once per
+            // frame the sensor delivers instead of being polled from a timer.
+            running = true;
+            capture_thread = std::thread(&CameraDriver::capture_loop, this);
 
 	    RCLCPP_INFO(get_logger(), "%s node has started", get_name());
         }
 
         ~CameraDriver()
         {
+            running = false;
+            if (capture_thread.joinable())
+                capture_thread.join();
+
+            v4l2_capture.close();
             capture.release();
         }
 
-    private:        
-        void read_image()
+    private:
+        bool open_v4l2()
         {
-            cv_bridge::CvImage image;
-            image.encoding = sensor_msgs::image_encodings::BGR8;
-            image.header = std_msgs::msg::Header();
-            image.header.stamp = now();
+            try
+            {
+                v4l2_capture.open(device, width, height, fps, fourcc_from_string(pixel_format), roi_top);
+            }
+            catch (const std::exception &e)
+            {
+                RCLCPP_ERROR_THROTTLE(
+                    get_logger(), *get_clock(), ERROR_LOG_PERIOD_MS,
+                    "Could not start V4L2 capture on %s: %s", device.c_str(), e.what()
+                );
+                v4l2_capture.close();
+                return false;
+            }
+            // A reopened device counts its frames from 0 again.
+            have_sequence = false;
 
-            if (!capture.read(image.image))
+            if (roi_top > 0)
             {
-                RCLCPP_ERROR(
+                RCLCPP_INFO(
                     get_logger(),
-                    "Could not read image"
+                    "Cropping the top %d rows %s",
+                    roi_top, v4l2_capture.is_cropped() ? "on the sensor" : "before conversion"
                 );
+            }
+
+            int expected_height = v4l2_capture.is_cropped() ? height - roi_top : height;
+            if ((int)v4l2_capture.get_width() != width || (int)v4l2_capture.get_height() != expected_height)
+            {
+                // Native frames go out at the device's size, and image_processing only shifts its
+                // detector regions for the crop; it does not rescale them.
+                if (publish_native && v4l2_capture.get_pixel_format() != V4L2_PIX_FMT_MJPEG)
+                {
+                    RCLCPP_ERROR_THROTTLE(
+                        get_logger(), *get_clock(), ERROR_LOG_PERIOD_MS,
+                        "%s does not support %dx%d in %s, only %ux%u; set publish_native to false to capture "
+                        "at that size and resize",
+                        device.c_str(), width, height, pixel_format.c_str(), v4l2_capture.get_width(), v4l2_capture.get_height()
+                    );
+                    v4l2_capture.close();
+                    return false;
+                }
+
+                RCLCPP_WARN(
+                    get_logger(),
+                    "%s does not support %dx%d, capturing at %ux%u and resizing",
+                    device.c_str(), width, height, v4l2_capture.get_width(), v4l2_capture.get_height()
+                );
+            }
+
+            RCLCPP_INFO(
+                get_logger(),
+                "Streaming %s from %s at %ux%u, %d fps",
+                pixel_format.c_str(), device.c_str(), v4l2_capture.get_width(), v4l2_capture.get_height(), fps
+            );
+            return true;
+        }
+
+        // Closes a device that failed, e.g. because it was unplugged; capture_loop() reopens it.
+        void close_v4l2(const char *what, const std::runtime_error &e)
+        {
+            RCLCPP_ERROR_THROTTLE(
+                get_logger(), *get_clock(), ERROR_LOG_PERIOD_MS,
+                "%s: %s, reopening %s", what, e.what(), device.c_str()
+            );
+            v4l2_capture.close();
+        }
+
+        // Sleeps for timeout_ms, or until the node stops.
+        void wait_while_running(int timeout_ms)
+        {
+            auto until = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+            while (running && std::chrono::steady_clock::now() < until)
+                std::this_thread::sleep_for(std::chrono::milliseconds(std::min(timeout_ms, CAPTURE_TIMEOUT_MS)));
+        }
+
+        void open_opencv()
+        {
+            capture = cv::VideoCapture(device, cv::CAP_V4L);
+            capture.set(cv::CAP_PROP_FOURCC, fourcc_from_string(pixel_format));
+            capture.set(cv::CAP_PROP_FRAME_WIDTH, width);
+            capture.set(cv::CAP_PROP_FRAME_HEIGHT, height);
+            capture.set(cv::CAP_PROP_FPS, fps);
+        }
+
+        void capture_loop()
+        {
+            health->add_current_thread("capture");
+            int backoff_ms = REOPEN_MIN_BACKOFF_MS;
+            while (running && rclcpp::ok())
+            {
+                if (capture_mode == "v4l2")
+                {
+                    // Not there at startup or gone since; keep trying in case it is plugged back in.
+                    if (!v4l2_capture.is_open())
+                    {
+                        wait_while_running(backoff_ms);
+                        backoff_ms = std::min(2 * backoff_ms, REOPEN_MAX_BACKOFF_MS);
+                        if (running && open_v4l2())
+                            backoff_ms = REOPEN_MIN_BACKOFF_MS;
+                        continue;
+                    }
+                    read_v4l2_image();
+                }
+                else
+                {
+                    read_image();
+                }
+            }
+        }
+
+        std::unique_ptr<sensor_msgs::msg::Image> create_message()
+        {
+            // The message owns the pixel buffer and the frame is decoded straight into it, so the
+            // unique_ptr can be handed to intra-process subscribers without any further copies.
+            auto message = std::make_unique<sensor_msgs::msg::Image>();
+            message->encoding = sensor_msgs::image_encodings::BGR8;
+            message->height = height - roi_top;
+            message->width = width;
+            message->step = message->width * 3;
+            message->data.resize(message->step * message->height);
+            return message;
+        }
+
+        // Rows of each device frame still above the region of interest, i.e. not cropped on the sensor.
+        int software_crop_rows()
+        {
+            if (v4l2_capture.is_cropped())
+                return 0;
+
+            return (roi_top * (int)v4l2_capture.get_height() / height) & ~1;
+        }
+
+        // How long ago a CLOCK_MONOTONIC kernel timestamp was.
+        static int64_t monotonic_age_ns(int64_t monotonic_stamp_ns)
+        {
+            timespec monotonic_now;
+            clock_gettime(CLOCK_MONOTONIC, &monotonic_now);
+            return static_cast<int64_t>(monotonic_now.tv_sec) * 1000000000LL + monotonic_now.tv_nsec - monotonic_stamp_ns;
+        }
+
+        // Converts a CLOCK_MONOTONIC kernel timestamp into the node's clock.
+        rclcpp::Time to_node_time(int64_t monotonic_stamp_ns)
+        {
+            return now() - rclcpp::Duration(std::chrono::nanoseconds(monotonic_age_ns(monotonic_stamp_ns)));
+        }
+
+        void read_v4l2_image()
+        {
+            V4l2Frame raw;
+            try
+            {
+                if (!v4l2_capture.dequeue(raw, CAPTURE_TIMEOUT_MS))
+                    return;
+            }
+            catch (const std::runtime_error &e)
+            {
+                close_v4l2("Could not read image", e);
+                return;
+            }
+
+            if (have_sequence && raw.sequence != last_sequence + 1)
+            {
+                dropped_frames += raw.sequence - last_sequence - 1;
+                health->callback(FRAME_CALLBACK).record_dropped(raw.sequence - last_sequence - 1);
+                RCLCPP_WARN(
+                    get_logger(),
+                    "Driver dropped %u frame(s), %llu total",
+                    raw.sequence - last_sequence - 1, static_cast<unsigned long long>(dropped_frames)
+                );
+
+                std_msgs::msg::UInt64 dropped;
+                dropped.data = dropped_frames;
+                dropped_frames_publisher->publish(dropped);
+            }
+            instrumentation::CallbackTimer frame_timer(health->callback(FRAME_CALLBACK));
+            have_sequence = true;
+            last_sequence = raw.sequence;
+            latency->record(CAPTURE_LATENCY, std::chrono::nanoseconds(monotonic_age_ns(raw.monotonic_stamp_ns)));
+            auto convert_start = std::chrono::steady_clock::now();
+
+            if (publish_native && v4l2_capture.get_pixel_format() != V4L2_PIX_FMT_MJPEG)
+            {
+                publish_native_image(raw, convert_start);
                 return;
             }
 
-            auto message = image.toImageMsg();
-            image_publisher->publish(*message);
+            auto message = create_message();
+            message->header.stamp = to_node_time(raw.monotonic_stamp_ns);
+
+            int device_width = v4l2_capture.get_width();
+            int device_height = v4l2_capture.get_height();
+            int crop_rows = software_crop_rows();
+            bool yuyv = v4l2_capture.get_pixel_format() == V4L2_PIX_FMT_YUYV;
+
+            // YUYV rows convert independently, so only the region of interest is converted. NV12 and
+            // MJPEG have to be converted whole and are cropped afterwards.
+            cv::Mat image(message->height, message->width, CV_8UC3, message->data.data());
+            bool direct = device_width == width && device_height - crop_rows == (int)message->height && (yuyv || crop_rows == 0);
+            cv::Mat &target = direct ? image : converted;
+
+            if (yuyv)
+            {
+                cv::Mat yuyv_frame(
+                    device_height,
+                    device_width,
+                    CV_8UC2,
+                    const_cast<uint8_t *>(raw.data),
+                    v4l2_capture.get_bytes_per_line()
+                );
+                cv::cvtColor(yuyv_frame.rowRange(crop_rows, device_height), target, cv::COLOR_YUV2BGR_YUYV);
+            }
+            else if (v4l2_capture.get_pixel_format() == V4L2_PIX_FMT_NV12)
+            {
+                cv::Mat nv12(
+                    device_height * 3 / 2,
+                    device_width,
+                    CV_8UC1,
+                    const_cast<uint8_t *>(raw.data),
+                    v4l2_capture.get_bytes_per_line()
+                );
+                cv::cvtColor(nv12, target, cv::COLOR_YUV2BGR_NV12);
+            }
+            else
+            {
+                cv::Mat jpeg(1, static_cast<int>(raw.bytes_used), CV_8UC1, const_cast<uint8_t *>(raw.data));
+                if (jpeg_publisher->get_subscription_count() > 0)
+                    publish_sensor_jpeg(raw, message->header);
+                cv::imdecode(jpeg, cv::IMREAD_COLOR, &target);
+            }
+
+            // The kernel buffer is not needed past the conversion; give it straight back to the driver.
+            try
+            {
+                v4l2_capture.requeue(raw);
+            }
+            catch (const std::runtime_error &e)
+            {
+                // The ring is a buffer short from now on.
+                close_v4l2("Could not requeue capture buffer", e);
+            }
+
+            if (target.empty())
+            {
+                RCLCPP_ERROR(get_logger(), "Could not decode image");
+                return;
+            }
+
+            if (!direct)
+            {
+                cv::Mat region = converted.rowRange(yuyv ? 0 : crop_rows, converted.rows);
+                cv::resize(region, image, image.size(), 0, 0, cv::INTER_AREA);
+            }
+            latency->record(CONVERT_LATENCY, convert_start);
+
+            publish(std::move(message), image);
         }
-};  
 
-int main(int argc, char **argv)
-{
-    rclcpp::init(argc, argv);
-    rclcpp::spin(std::make_shared<CameraDriver>());
-    rclcpp::shutdown();
-    return 0;
-}
+        // Copies the sensor's YUYV/NV12 buffer out as is. This is the only pass over the pixels on
+        // the capture side; it cannot be skipped since the kernel buffer has to be requeued.
+        void publish_native_image(const V4l2Frame &raw, std::chrono::steady_clock::time_point copy_start)
+        {
+            bool nv12 = v4l2_capture.get_pixel_format() == V4L2_PIX_FMT_NV12;
+
+            auto message = std::make_unique<sensor_msgs::msg::Image>();
+            message->header.stamp = to_node_time(raw.monotonic_stamp_ns);
+            message->encoding = nv12 ? NV12_ENCODING : YUYV_ENCODING;
+            int device_height = v4l2_capture.get_height();
+            int crop_rows = software_crop_rows();
+            message->height = device_height - crop_rows;
+            message->width = v4l2_capture.get_width();
+            message->step = v4l2_capture.get_bytes_per_line();
+
+            std::size_t step = message->step;
+            std::size_t rows = nv12 ? device_height * 3 / 2 : device_height;
+            bool complete = raw.bytes_used >= rows * step;
+            if (complete && nv12)
+            {
+                // Crop both planes: the Y rows and the half-height UV rows below them.
+                const uint8_t *luma = raw.data + crop_rows * step;
+                const uint8_t *chroma = raw.data + (device_height + crop_rows / 2) * step;
+                message->data.reserve(message->height * 3 / 2 * step);
+                message->data.assign(luma, raw.data + device_height * step);
+                message->data.insert(message->data.end(), chroma, raw.data + rows * step);
+            }
+            else if (complete)
+            {
+                message->data.assign(raw.data + crop_rows * step, raw.data + rows * step);
+            }
+
+            try
+            {
+                v4l2_capture.requeue(raw);
+            }
+            catch (const std::runtime_error &e)
+            {
+                // The ring is a buffer short from now on.
+                close_v4l2("Could not requeue capture buffer", e);
+            }
+
+            if (!complete)
+            {
+                RCLCPP_ERROR(get_logger(), "Driver returned a short frame (%zu bytes)", raw.bytes_used);
+                return;
+            }
+            latency->record(CONVERT_LATENCY, copy_start);
+
+            if (preview->wanted())
+            {
+                int image_rows = message->height;
+                cv::Mat frame = nv12
+                    ? cv::Mat(image_rows * 3 / 2, message->width, CV_8UC1, message->data.data(), step)
+                    : cv::Mat(image_rows, message->width, CV_8UC2, message->data.data(), step);
+                preview->submit(message->header, frame, nv12 ? PixelLayout::NV12 : PixelLayout::YUYV);
+            }
+
+            instrumentation::StageTimer timer(*latency, PUBLISH_LATENCY);
+            image_publisher->publish(std::move(message));
+        }
+
+        // Passes the sensor's JPEG on untouched, so remote viewers get full frames without an encode.
+        void publish_sensor_jpeg(const V4l2Frame &raw, const std_msgs::msg::Header &header)
+        {
+            auto jpeg = std::make_unique<sensor_msgs::msg::CompressedImage>();
+            jpeg->header = header;
+            jpeg->format = "jpeg";
+            jpeg->data.assign(raw.data, raw.data + raw.bytes_used);
+            jpeg_publisher->publish(std::move(jpeg));
+        }
+
+        void read_image()
+        {
+            auto message = create_message();
+
+            // Without a crop the frame is read straight into the message.
+            cv::Mat image(message->height, message->width, CV_8UC3, message->data.data());
+            if (!capture.read(roi_top > 0 ? converted : image))
+            {
+                RCLCPP_ERROR_THROTTLE(get_logger(), *get_clock(), ERROR_LOG_PERIOD_MS, "Could not read image");
+                // Do not spin on a camera that has gone away.
+                std::this_thread::sleep_for(std::chrono::milliseconds(CAPTURE_TIMEOUT_MS));
+                return;
+            }
+            message->header.stamp = now();
+            instrumentation::CallbackTimer frame_timer(health->callback(FRAME_CALLBACK));
+
+            if (roi_top > 0)
+            {
+                instrumentation::StageTimer timer(*latency, CONVERT_LATENCY);
+                int crop_rows = roi_top * converted.rows / height;
+                cv::resize(converted.rowRange(crop_rows, converted.rows), image, image.size(), 0, 0, cv::INTER_AREA);
+            }
+
+            publish(std::move(message), image);
+        }
+
+        void publish(std::unique_ptr<sensor_msgs::msg::Image> message, const cv::Mat &image)
+        {
+            // OpenCV reallocates when a frame does not match the buffer it was given; copy it in then.
+            if (image.data != message->data.data())
+            {
+                message->height = image.rows;
+                message->width = image.cols;
+                message->step = static_cast<uint32_t>(image.step);
+                message->data.assign(image.datastart, image.dataend);
+            }
+
+            if (preview->wanted())
+                preview->submit(message->header, image);
+
+            instrumentation::StageTimer timer(*latency, PUBLISH_LATENCY);
+            image_publisher->publish(std::move(message));
+        }
+};
+
+}  // namespace vision
+
+RCLCPP_COMPONENTS_REGISTER_NODE(vision::CameraDriver)
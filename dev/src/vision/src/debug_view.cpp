@@ -0,0 +1,135 @@
+#include "vision/debug_view.hpp"
+
+#include <cv_bridge/cv_bridge.h>
+#include <opencv2/imgproc.hpp>
+
+#include "vision/frame_size.hpp"
+
+namespace vision
+{
+
+static const auto RED = cv::Scalar(0, 0, 255);
+static const auto GREEN = cv::Scalar(0, 255, 0);
+static const auto BLUE = cv::Scalar(255, 0, 0);
+
+DebugView::DebugView(rclcpp::Node *node, const std::string &topic, bool enabled, double max_rate)
+: node(node), enabled(enabled), period_ns(0), running(true)
+{
+    // Viewers should subscribe to the compressed transport; raw debug frames are three times
+    // the camera's size.
+    publisher = image_transport::create_publisher(node, topic);
+    set_max_rate(max_rate);
+    thread = std::thread(&DebugView::render_loop, this);
+}
+
+DebugView::~DebugView()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    wake.notify_one();
+
+    if (thread.joinable())
+        thread.join();
+}
+
+void DebugView::set_max_rate(double rate)
+{
+    period_ns = rate > 0.0 ? static_cast<int64_t>(1e9 / rate) : 0;
+}
+
+bool DebugView::wanted()
+{
+    if (!enabled || publisher.getNumSubscribers() == 0)
+        return false;
+
+    auto now = std::chrono::steady_clock::now();
+    if (now - last_snapshot < std::chrono::nanoseconds(period_ns.load()))
+        return false;
+
+    last_snapshot = now;
+    return true;
+}
+
+void DebugView::submit(std::unique_ptr<DebugSnapshot> snapshot)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending = std::move(snapshot);
+    }
+    wake.notify_one();
+}
+
+void DebugView::render_loop()
+{
+    while (true)
+    {
+        std::unique_ptr<DebugSnapshot> snapshot;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this] { return !running || pending; });
+            if (!running)
+                return;
+            snapshot = std::move(pending);
+        }
+
+        try
+        {
+            render(*snapshot);
+        }
+        catch (const cv::Exception &e)
+        {
+            RCLCPP_WARN(node->get_logger(), "Could not draw debug image: %s", e.what());
+        }
+    }
+}
+
+// Lays out the camera frame with the trapezoid, the white mask with the frame centre, ball
+// column and candidate boxes, and the red mask side by side.
+void DebugView::render(const DebugSnapshot &snapshot)
+{
+    cv::Mat raw, white, red;
+    if (snapshot.layout == PixelLayout::YUYV)
+        cv::cvtColor(snapshot.frame, raw, cv::COLOR_YUV2BGR_YUYV);
+    else if (snapshot.layout == PixelLayout::NV12)
+        cv::cvtColor(snapshot.frame, raw, cv::COLOR_YUV2BGR_NV12);
+    else
+        raw = snapshot.frame.clone();
+
+    // The trapezoid is in full-frame coordinates; cropped frames hold its bottom rows.
+    int offset = HEIGHT - snapshot.white.rows;
+    int line_width = 2;
+    // create a frame of reference... adjust these as needed. They represent the 4 corners of the box.
+    cv::Point2f source[] = {
+        cv::Point2f(30, HEIGHT / 2 - offset),
+        cv::Point2f(WIDTH - 30, HEIGHT / 2 - offset),
+        cv::Point2f(0, HEIGHT - offset),
+        cv::Point2f(WIDTH, HEIGHT - offset)
+    };
+
+    // goes from top left to top right
+    cv::line(raw, source[0], source[1], RED, line_width);
+    // goes from top right to bottom right
+    cv::line(raw, source[1], source[3], RED, line_width);
+    // goes from bottom right to bottom left
+    cv::line(raw, source[3], source[2], RED, line_width);
+    // goes from bottom left to top left
+    cv::line(raw, source[2], source[0], RED, line_width);
+
+    int frame_center = WIDTH / 2;
+    cv::cvtColor(snapshot.white, white, cv::COLOR_GRAY2BGR);
+    cv::line(white, cv::Point2f(frame_center, 0), cv::Point2f(frame_center, white.rows), BLUE, 3);
+    cv::line(white, cv::Point2f(snapshot.ball_column, 0), cv::Point2f(snapshot.ball_column, white.rows), GREEN, 2);
+    for (const auto &ball : snapshot.balls)
+        cv::rectangle(white, ball.box, GREEN, 1);
+
+    cv::cvtColor(snapshot.red, red, cv::COLOR_GRAY2BGR);
+
+    cv::Mat composite;
+    cv::hconcat(std::vector<cv::Mat>{raw, white, red}, composite);
+
+    publisher.publish(cv_bridge::CvImage(snapshot.message->header, "bgr8", composite).toImageMsg());
+}
+
+}  // namespace vision
@@ -0,0 +1,80 @@
+#include "vision/detection_kernels.hpp"
+
+#include <algorithm>
+
+namespace vision
+{
+
+void column_histogram(const cv::Mat &mask, const cv::Rect &region, std::vector<int> &counts)
+{
+    CV_Assert(mask.type() == CV_8UC1);
+
+    int columns = std::max(0, region.width);
+    int rows = std::max(0, region.height);
+    counts.resize(columns);
+    if (columns == 0)
+        return;
+
+    const uint8_t *pixels = mask.ptr<uint8_t>(region.y) + region.x;
+    switch (columns)
+    {
+        case WIDTH:
+            count_columns<WIDTH>(pixels, mask.step, rows, counts.data());
+            break;
+        case EDGE_STRIP_WIDTH:
+            count_columns<EDGE_STRIP_WIDTH>(pixels, mask.step, rows, counts.data());
+            break;
+        default:
+            count_columns(pixels, mask.step, rows, columns, counts.data());
+            break;
+    }
+}
+
+int first_dense_column(const int *counts, int columns, int min_count)
+{
+    for (int i = 0; i < columns; i++)
+    {
+        if (counts[i] > min_count)
+            return i;
+    }
+
+    return -1;
+}
+
+int ball_column(const std::vector<BallCandidate> &candidates)
+{
+    // Candidates are sorted largest first.
+    return candidates.empty() ? 0 : static_cast<int>(candidates.front().centroid_x + 0.5f);
+}
+
+int find_edge(const cv::Mat &red, const DetectorRegions &regions, std::vector<int> &counts)
+{
+    for (const cv::Rect *strip : {&regions.left_edge, &regions.right_edge})
+    {
+        column_histogram(red, *strip, counts);
+        int column = first_dense_column(counts.data(), strip->width, EDGE_MIN_PIXELS);
+        if (column != -1)
+            return edge_offset(strip->x + column);
+    }
+
+    return NO_EDGE_FOUND;
+}
+
+int edge_from_strip_counts(const std::vector<int> &counts, const DetectorRegions &regions)
+{
+    int left_columns = std::max(0, regions.left_edge.width);
+    int right_columns = std::max(0, regions.right_edge.width);
+    CV_Assert(static_cast<int>(counts.size()) == left_columns + right_columns);
+
+    int column = first_dense_column(counts.data(), left_columns, EDGE_MIN_PIXELS);
+    if (column != -1)
+        return edge_offset(regions.left_edge.x + column);
+
+    column = first_dense_column(counts.data() + left_columns, right_columns, EDGE_MIN_PIXELS);
+    if (column != -1)
+        return edge_offset(regions.right_edge.x + column);
+
+    return NO_EDGE_FOUND;
+}
+
+}  // namespace vision
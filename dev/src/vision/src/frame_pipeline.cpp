@@ -0,0 +1,259 @@
+#include "vision/frame_pipeline.hpp"
+
+#include <algorithm>
+#include <utility>
+
+#include "vision/allocation_counter.hpp"
+
+namespace vision
+{
+
+bool view_frame(PixelLayout layout, int width, int height, std::size_t step, const uint8_t *data, std::size_t size, cv::Mat &frame)
+{
+    // NV12 carries the half-height interleaved UV plane below the Y plane.
+    int rows = layout == PixelLayout::NV12 ? height * 3 / 2 : height;
+    int type = CV_8UC3;
+    if (layout == PixelLayout::YUYV)
+        type = CV_8UC2;
+    else if (layout == PixelLayout::NV12)
+        type = CV_8UC1;
+    if (size < static_cast<std::size_t>(rows) * step)
+        return false;
+
+    frame = cv::Mat(rows, width, type, const_cast<uint8_t *>(data), step);
+    return true;
+}
+
+bool mask_backend_from_name(const std::string &name, MaskBackend &backend)
+{
+    if (name == "cpu")
+        backend = MaskBackend::CPU;
+    else if (name == "opencl")
+        backend = MaskBackend::OPENCL;
+    else
+        return false;
+
+    return true;
+}
+
+FramePipeline::FramePipeline(const std::vector<int> &worker_cpus)
+: FramePipeline(std::make_shared<PipelineExecutor>(worker_cpus))
+{
+}
+
+FramePipeline::FramePipeline(std::shared_ptr<PipelineExecutor> workers)
+: lower_threshold(180), lower_red_value(195), min_ball_area(20), frame_height(0), white_threshold(180),
+  red_threshold(195), auto_thresholding(false), ball_stage_column(0),
+  edge_stage_offset(NO_EDGE_FOUND), frame_layout(PixelLayout::BGR),
+  regions(make_detector_regions(WIDTH, HEIGHT, BALL_ROI_TOP, EDGE_ROI_TOP, EDGE_STRIP_WIDTH)), backend(MaskBackend::CPU),
+  keep_red_mask(false), ball_detector(BALL_LABEL_RUNS), tracking(true),
+  durations{}, pipeline(std::move(workers))
+{
+    CV_Assert(pipeline && pipeline->size() > EDGE_STAGE);
+}
+
+bool FramePipeline::set_backend(MaskBackend backend)
+{
+    if (backend == MaskBackend::OPENCL)
+    {
+#ifdef VISION_WITH_OPENCL
+        if (!UMatClassifier::available())
+            return false;
+#else
+        return false;
+#endif
+    }
+
+    this->backend = backend;
+    return true;
+}
+
+void FramePipeline::set_tracking(bool enabled, const BallTrackerConfig &config)
+{
+    tracking = enabled;
+    tracker.set_config(config);
+    tracker.reset();
+}
+
+void FramePipeline::set_thresholds(int lower_threshold, int lower_red_value)
+{
+    this->lower_threshold = lower_threshold;
+    this->lower_red_value = lower_red_value;
+}
+
+void FramePipeline::set_auto_threshold(bool enabled, const AutoThresholdConfig &config)
+{
+    auto_thresholding = enabled;
+    auto_threshold.set_config(config);
+    auto_threshold.reset();
+}
+
+void FramePipeline::set_auto_threshold_margin(int margin)
+{
+    AutoThresholdConfig config = auto_threshold.get_config();
+    config.margin = margin;
+    auto_threshold.set_config(config);
+}
+
+bool FramePipeline::process(
+    const cv::Mat &frame,
+    PixelLayout layout,
+    int height,
+    std::chrono::nanoseconds stamp,
+    FrameDetections &detections)
+{
+    this->frame = frame;
+    frame_layout = layout;
+    frame_height = height;
+
+    // Auto thresholding carries its thresholds over from the last frame.
+    if (!auto_threshold_active())
+    {
+        white_threshold = lower_threshold;
+        red_threshold = lower_red_value;
+    }
+
+    cv::Size frame_size(frame.cols, frame_height);
+    bool sized = arena.prepare(frame_size);
+    frame_regions = regions.for_frame(frame_size);
+
+    ball_search = frame_regions.ball;
+    if (tracking)
+    {
+        tracker.predict(stamp);
+        ball_search = tracker.search_region(frame_regions.ball);
+    }
+
+    if (backend == MaskBackend::CPU)
+        classify_on_cpu();
+    else
+        classify_on_device();
+
+    detections.ball_predicted = false;
+    if (tracking)
+    {
+        // Until a track is confirmed there is no ball, and column 0 reports NO_BALL_FOUND.
+        if (!tracker.update(arena.ball_candidates, ball_stage_column))
+            ball_stage_column = 0;
+        detections.ball_predicted = tracker.coasting();
+    }
+
+    detections.ball_position = ball_offset(ball_stage_column);
+    detections.corner_position = edge_stage_offset;
+    detections.ball_column = ball_stage_column;
+    detections.labelling_truncated = ball_detector.was_truncated();
+    return sized;
+}
+
+void FramePipeline::classify_on_cpu()
+{
+    // A changed threshold is built off this thread and picked up on a later frame.
+    classifier.configure(white_threshold, red_threshold, frame_layout);
+
+    // Each worker classifies half of the rows of interest, producing both masks for its band.
+    int first_row = std::max(0, frame_regions.first_row());
+    int middle_row = (first_row + frame_height) / 2;
+    classify_bands[0].self = classify_bands[1].self = this;
+    classify_bands[0].row_begin = first_row;
+    classify_bands[0].row_end = classify_bands[1].row_begin = middle_row;
+    classify_bands[1].row_end = frame_height;
+    auto threshold_start = std::chrono::steady_clock::now();
+    pipeline->submit(BALL_STAGE, &FramePipeline::run_classify_stage, &classify_bands[0], ball_done);
+    pipeline->submit(EDGE_STAGE, &FramePipeline::run_classify_stage, &classify_bands[1], edge_done);
+    ball_done.wait();
+    edge_done.wait();
+    durations.threshold = std::chrono::steady_clock::now() - threshold_start;
+
+    if (auto_thresholding)
+        update_auto_threshold();
+
+    // Both detectors only read the masks, so they run in parallel on the pipeline workers.
+    pipeline->submit(BALL_STAGE, &FramePipeline::run_ball_stage, this, ball_done);
+    pipeline->submit(EDGE_STAGE, &FramePipeline::run_edge_stage, this, edge_done);
+    ball_done.wait();
+    edge_done.wait();
+}
+
+void FramePipeline::classify_on_device()
+{
+#ifdef VISION_WITH_OPENCL
+    // The device produces the white mask and the strip counts in one go, which leaves the edge stage
+    // nothing but a scan of the counts; it runs here while the ball stage labels on its worker.
+    umat_classifier.configure(white_threshold, red_threshold, frame_layout);
+    auto threshold_start = std::chrono::steady_clock::now();
+    umat_classifier.classify(
+        frame,
+        frame_layout,
+        frame_height,
+        std::max(0, frame_regions.first_row()),
+        frame_regions,
+        arena.white,
+        keep_red_mask ? &arena.red : nullptr,
+        arena.strip_counts
+    );
+    durations.threshold = std::chrono::steady_clock::now() - threshold_start;
+
+    pipeline->submit(BALL_STAGE, &FramePipeline::run_ball_stage, this, ball_done);
+    auto edge_start = std::chrono::steady_clock::now();
+    edge_stage_offset = edge_from_strip_counts(arena.strip_counts, frame_regions);
+    durations.corners = std::chrono::steady_clock::now() - edge_start;
+    ball_done.wait();
+#endif
+}
+
+void FramePipeline::update_auto_threshold()
+{
+    // Summing the bands is O(INTENSITY_BINS), as is the update itself.
+    IntensityHistogram intensity;
+    for (int bin = 0; bin < INTENSITY_BINS; bin++)
+        intensity[bin] = classify_bands[0].intensity[bin] + classify_bands[1].intensity[bin];
+
+    white_threshold = auto_threshold.update(intensity, frame_layout != PixelLayout::BGR, lower_threshold);
+    // The tape darkens and brightens with the rest of the scene, so the red value moves with the
+    // white threshold.
+    red_threshold = std::min(255, std::max(0, lower_red_value + white_threshold - lower_threshold));
+}
+
+void FramePipeline::run_classify_stage(void *context)
+{
+    AllocationScope allocation_scope;
+    auto band = static_cast<ClassifyBand *>(context);
+    auto self = band->self;
+    IntensityHistogram *intensity = nullptr;
+    if (self->auto_thresholding)
+    {
+        band->intensity.fill(0);
+        intensity = &band->intensity;
+    }
+    self->classifier.classify(
+        self->frame,
+        self->frame_layout,
+        self->frame_height,
+        band->row_begin,
+        band->row_end,
+        self->arena.white,
+        self->arena.red,
+        intensity
+    );
+}
+
+void FramePipeline::run_ball_stage(void *context)
+{
+    AllocationScope allocation_scope;
+    auto self = static_cast<FramePipeline *>(context);
+    auto start = std::chrono::steady_clock::now();
+    self->ball_detector.detect(self->arena.white, self->ball_search, self->min_ball_area, self->arena.ball_candidates);
+    self->ball_stage_column = ball_column(self->arena.ball_candidates);
+    self->durations.histogram = std::chrono::steady_clock::now() - start;
+}
+
+void FramePipeline::run_edge_stage(void *context)
+{
+    AllocationScope allocation_scope;
+    auto self = static_cast<FramePipeline *>(context);
+    auto start = std::chrono::steady_clock::now();
+    self->edge_stage_offset = find_edge(self->arena.red, self->frame_regions, self->arena.strip_counts);
+    self->durations.corners = std::chrono::steady_clock::now() - start;
+}
+
+}  // namespace vision
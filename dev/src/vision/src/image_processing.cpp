@@ -1,303 +1,592 @@
-#include <cv_bridge/cv_bridge.h>
+#include <atomic>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
 #include <opencv2/opencv.hpp>
 
 #include "custom_interfaces/msg/image_data.hpp"
 #include "custom_interfaces/msg/threshold_adjustment.hpp"
+#include "instrumentation/latency_reporter.hpp"
+#include "instrumentation/node_health.hpp"
 #include "rclcpp/rclcpp.hpp"
+#include "rclcpp_components/register_node_macro.hpp"
 #include "sensor_msgs/msg/image.hpp"
 #include "std_msgs/msg/int32.hpp"
+#include "std_msgs/msg/u_int64.hpp"
+#include "vision/allocation_counter.hpp"
+#include "vision/debug_view.hpp"
+#include "vision/frame_pipeline.hpp"
+#include "vision/frame_size.hpp"
+#include "vision/preview_stream.hpp"
+#include "vision/stream_scheduler.hpp"
+#include "vision/thread_scheduling.hpp"
 
-#define WHITE 255
-#define WIDTH 360
-#define HEIGHT 240
-#define NO_EDGE_FOUND INT_MAX
-#define NO_BALL_FOUND -180
-#define DEBUG true
-
-const auto RED = cv::Scalar(0, 0, 255);
-const auto GREEN = cv::Scalar(0, 255, 0);
-const auto BLUE = cv::Scalar(255, 0, 0);
+namespace vision
+{
 
 class ImageProcessing : public rclcpp::Node
 {
     private:
-        int middle_pos, lower_threshold, lower_red_value;
-        std::vector<int> histogram_lane;
-        cv::Mat frame, frame_copy, frame_final, frame_red;
-        rclcpp::Publisher<custom_interfaces::msg::ImageData>::SharedPtr image_data_publisher;
-        rclcpp::Subscription<sensor_msgs::msg::Image>::SharedPtr image_subscription;
+        // What the per-stage latencies are recorded under, see instrumentation/latency_reporter.hpp.
+        enum LatencyStage {
+            FRAME_AGE_LATENCY = 0,
+            THRESHOLD_LATENCY,
+            HISTOGRAM_LATENCY,
+            CORNERS_LATENCY,
+            PUBLISH_LATENCY
+        };
+        // What the node's health is recorded under, see instrumentation/node_health.hpp. image is the
+        // frame callback, frame the processing of a frame on the frame thread.
+        enum HealthCallback {
+            IMAGE_CALLBACK = 0,
+            FRAME_CALLBACK
+        };
+
+        // One camera, subscribed on <name>/image_raw. The first publishes on the topics a single
+        // camera always had, the others on the same topics under their name. Each has its own
+        // pipeline, so tracking and auto thresholding follow each camera separately.
+        struct Stream
+        {
+            std::size_t index;
+            std::string name;
+            std::unique_ptr<FramePipeline> pipeline;
+            std::unique_ptr<DebugView> debug_view;
+            std::unique_ptr<PreviewStream> mask_view;
+            rclcpp::Publisher<custom_interfaces::msg::ImageData>::SharedPtr image_data_publisher;
+            rclcpp::Publisher<std_msgs::msg::UInt64>::SharedPtr dropped_frames_publisher;
+            rclcpp::Subscription<sensor_msgs::msg::Image>::SharedPtr image_subscription;
+            // Keep the shared camera message alive while frame points into it.
+            sensor_msgs::msg::Image::ConstSharedPtr frame_message;
+            PixelLayout frame_layout;
+            cv::Mat frame;
+            int frame_height, logged_lower_threshold;
+            // Frames replaced in the scheduler before they were taken, or skipped as stale.
+            std::atomic<uint64_t> dropped_frames;
+            FrameDetections detections;
+        };
+
+        // Adjusted from the control callback group while frames are processed on the frame thread.
+        std::atomic<int> lower_threshold, lower_red_value, auto_threshold_margin;
+        bool auto_thresholding;
+        bool check_allocations, abort_on_allocation;
+        uint64_t frames_with_allocations;
+        rclcpp::Duration max_frame_age;
+        std::vector<std::unique_ptr<Stream>> streams;
+        // The stage workers all streams' pipelines run on. Only the frame thread submits to them.
+        std::shared_ptr<PipelineExecutor> workers;
+        std::unique_ptr<StreamScheduler<sensor_msgs::msg::Image::ConstSharedPtr>> scheduler;
+        // Shared by all streams.
+        std::unique_ptr<instrumentation::LatencyReporter> latency;
+        std::unique_ptr<instrumentation::NodeHealth> health;
+        rclcpp::Node::OnSetParametersCallbackHandle::SharedPtr parameter_callback;
         rclcpp::Subscription<custom_interfaces::msg::ThresholdAdjustment>::SharedPtr threshold_subscription;
-        rclcpp::TimerBase::SharedPtr timer;
+        // The frame callbacks are the only ones in frame_group, which is spun by frame_executor on
+        // receive_thread, so nothing else the process spins can hold them up. They only hand the frame
+        // to the scheduler; frame_thread takes the frames from it and processes them. Everything else
+        // goes to control_group on whichever executor the node is added to.
+        rclcpp::CallbackGroup::SharedPtr frame_group, control_group;
+        rclcpp::executors::StaticSingleThreadedExecutor frame_executor;
+        std::thread receive_thread, frame_thread;
 
     public:
-        ImageProcessing() : Node("image_processing")
+        explicit ImageProcessing(const rclcpp::NodeOptions &options = rclcpp::NodeOptions())
+        : Node("image_processing", options), frames_with_allocations(0), max_frame_age(0, 0)
         {
+            // Minimum gray level for white. Tweak as necessary, min threshold may want to go down if indoors.
+            // 137 looked good indoors at night, 165 looked good indoors during the day.
             lower_threshold = 180;
+            // Minimum HSV value for red. Darker red means a lower value.
             lower_red_value = 195;
 
-            image_data_publisher = create_publisher<custom_interfaces::msg::ImageData>("image_data", 10);
-            image_subscription = create_subscription<sensor_msgs::msg::Image>(
-                "camera/image_raw",
-                10,
-                std::bind(&ImageProcessing::process_image, this, std::placeholders::_1)
+            frame_group = create_callback_group(rclcpp::CallbackGroupType::MutuallyExclusive, false);
+            control_group = create_callback_group(rclcpp::CallbackGroupType::MutuallyExclusive);
+            rclcpp::SubscriptionOptions frame_options, control_options;
+            frame_options.callback_group = frame_group;
+            control_options.callback_group = control_group;
+
+            // CPU the ball and edge stage workers are pinned to. -1 leaves a worker unpinned.
+            auto worker_cpus = declare_parameter("worker_cpus", std::vector<int64_t>{-1, -1});
+            worker_cpus.resize(2, -1);
+            workers = std::make_shared<PipelineExecutor>(std::vector<int>(worker_cpus.begin(), worker_cpus.end()));
+            for (std::size_t worker = 0; worker < workers->size(); worker++)
+            {
+                if (!workers->scheduling_error(worker).empty())
+                    RCLCPP_WARN(get_logger(), "Stage worker %zu %s", worker, workers->scheduling_error(worker).c_str());
+            }
+
+            // Namespace of each camera driver whose frames are processed. The frames of all of them
+            // are processed one at a time on the frame thread, on the same two stage workers.
+            auto cameras = declare_parameter("cameras", std::vector<std::string>{"camera"});
+            if (cameras.empty())
+            {
+                RCLCPP_WARN(get_logger(), "cameras is empty, using camera");
+                cameras.push_back("camera");
+            }
+
+            // How far down from the top the ball histogram and the tape strips start looking. Only the
+            // rows below the higher of the two are ever classified. The camera's roi_top should not be
+            // set below these, since those rows are then never sent.
+            DetectorRegions regions = make_detector_regions(
+                WIDTH,
+                HEIGHT,
+                declare_parameter("ball_roi_top", BALL_ROI_TOP),
+                declare_parameter("edge_roi_top", EDGE_ROI_TOP),
+                declare_parameter("edge_strip_width", EDGE_STRIP_WIDTH)
+            );
+
+            // Smallest blob of white pixels reported as a ball candidate.
+            int min_ball_area = declare_parameter("min_ball_area", 20);
+
+            // The ball column is followed with an alpha-beta filter: a new ball is only reported once it has been
+            // seen track_confirm_frames frames in a row within track_gate columns of the prediction, a lost one
+            // is coasted on the prediction for track_max_coast_frames frames, and while one is held only
+            // track_search_margin columns either side of it are labelled.
+            BallTrackerConfig tracker_config;
+            bool tracking = declare_parameter("tracking", true);
+            tracker_config.alpha = declare_parameter("track_alpha", static_cast<double>(tracker_config.alpha));
+            tracker_config.beta = declare_parameter("track_beta", static_cast<double>(tracker_config.beta));
+            tracker_config.gate = declare_parameter("track_gate", static_cast<double>(tracker_config.gate));
+            tracker_config.confirm_frames = declare_parameter("track_confirm_frames", tracker_config.confirm_frames);
+            tracker_config.max_coast_frames = declare_parameter("track_max_coast_frames", tracker_config.max_coast_frames);
+            tracker_config.search_margin = declare_parameter("track_search_margin", tracker_config.search_margin);
+            // Labels the whole ball region even while a ball is held, so image_data's balls lists every
+            // candidate in view rather than those near the tracked one, e.g. for ball_mapping.
+            if (declare_parameter("all_ball_candidates", false))
+                tracker_config.search_margin = 0;
+
+            // With auto_threshold the white threshold is placed auto_threshold_margin above the
+            // auto_threshold_percentile of the intensities in the rows of interest, within
+            // [auto_threshold_min, auto_threshold_max], and only moved once it is off by
+            // auto_threshold_hysteresis. lower_threshold and lower_red_value then only give the offset
+            // of the red value from it, and L1 + D-pad moves the margin instead. Only the cpu
+            // mask_backend counts the intensities; on any other it is turned off.
+            AutoThresholdConfig auto_config;
+            auto_thresholding = declare_parameter("auto_threshold", true);
+            auto_config.background_percentile = declare_parameter(
+                "auto_threshold_percentile",
+                static_cast<double>(auto_config.background_percentile)
+            );
+            auto_config.margin = declare_parameter("auto_threshold_margin", auto_config.margin);
+            auto_config.min_threshold = declare_parameter("auto_threshold_min", auto_config.min_threshold);
+            auto_config.max_threshold = declare_parameter("auto_threshold_max", auto_config.max_threshold);
+            auto_config.smoothing = declare_parameter("auto_threshold_smoothing", static_cast<double>(auto_config.smoothing));
+            auto_config.hysteresis = declare_parameter("auto_threshold_hysteresis", auto_config.hysteresis);
+            auto_threshold_margin = auto_config.margin;
+
+            // "cpu" or "opencl" (cv::UMat) for the mask stage. Falls back to the CPU if OpenCL was not built
+            // in or has no device. The OpenCL runtime allocates on the host, so allocation_check is only
+            // meaningful on the CPU.
+            auto backend_name = declare_parameter("mask_backend", std::string("cpu"));
+            MaskBackend backend = MaskBackend::CPU;
+            if (!mask_backend_from_name(backend_name, backend))
+                RCLCPP_WARN(get_logger(), "Unknown mask_backend %s, using cpu", backend_name.c_str());
+
+            // "warn" or "abort" when a frame allocates on the heap, once the first frame has sized the
+            // arena. Needs libvision_allocation_counter.so preloaded, see vision/allocation_counter.hpp.
+            auto allocation_check = declare_parameter("allocation_check", std::string("off"));
+            check_allocations = allocation_check != "off";
+            abort_on_allocation = allocation_check == "abort";
+            if (check_allocations && !allocation_counting_active())
+            {
+                RCLCPP_WARN(get_logger(), "allocation_check needs libvision_allocation_counter.so in LD_PRELOAD, not checking");
+                check_allocations = false;
+            }
+
+            // Frames older than this (by header.stamp) are skipped rather than steered on. 0 disables the check.
+            max_frame_age = rclcpp::Duration(
+                std::chrono::milliseconds(declare_parameter("max_frame_age_ms", 100))
             );
+            // Only ever work on the newest frame and only send navigation the newest result: best effort
+            // and a queue of one, so a backlog is dropped instead of worked through. Must match the
+            // camera driver's and navigation's freshest_only.
+            bool freshest_only = declare_parameter("freshest_only", true);
+            auto qos = freshest_only ? rclcpp::QoS(1).best_effort() : rclcpp::QoS(10);
+
+            // Overlays are published on image_processing/debug, only while debug is set and someone
+            // subscribes, at most debug_rate times a second. Both can be changed at runtime.
+            bool debug = declare_parameter("debug", false);
+            double debug_rate = declare_parameter("debug_rate", 5.0);
+            // The white mask, with every mask_decimation-th pixel of each side, is published on
+            // image_processing/mask at most mask_rate times a second, only while someone subscribes.
+            // Unlike the debug view it needs no parameter set first, so it can always be watched remotely.
+            int mask_decimation = declare_parameter("mask_decimation", 2);
+            double mask_rate = declare_parameter("mask_rate", 10.0);
+
+            scheduler = std::make_unique<StreamScheduler<sensor_msgs::msg::Image::ConstSharedPtr>>(cameras.size());
+            for (const auto &camera : cameras)
+            {
+                auto stream = std::make_unique<Stream>();
+                stream->index = streams.size();
+                stream->name = camera;
+                stream->frame_layout = PixelLayout::BGR;
+                stream->frame_height = 0;
+                stream->logged_lower_threshold = -1;
+                stream->dropped_frames = 0;
+
+                stream->pipeline = std::make_unique<FramePipeline>(workers);
+                stream->pipeline->set_regions(regions);
+                stream->pipeline->set_min_ball_area(min_ball_area);
+                stream->pipeline->set_tracking(tracking, tracker_config);
+                stream->pipeline->set_auto_threshold(auto_thresholding, auto_config);
+                if (!stream->pipeline->set_backend(backend) && stream->index == 0)
+                    RCLCPP_WARN(get_logger(), "mask_backend %s is not available, using cpu", backend_name.c_str());
+                // The margin and logging below then go by the manual thresholds as well.
+                if (auto_thresholding && !stream->pipeline->auto_threshold_active())
+                {
+                    RCLCPP_WARN(get_logger(), "auto_threshold needs mask_backend cpu, using lower_threshold and lower_red_value");
+                    auto_thresholding = false;
+                }
+
+                std::string prefix = stream->index == 0 ? "" : camera + "/";
+                stream->image_data_publisher = create_publisher<custom_interfaces::msg::ImageData>(prefix + "image_data", qos);
+                stream->dropped_frames_publisher = create_publisher<std_msgs::msg::UInt64>(
+                    "image_processing/" + prefix + "dropped_frames",
+                    10
+                );
+                stream->debug_view = std::make_unique<DebugView>(this, "image_processing/" + prefix + "debug", debug, debug_rate);
+                stream->mask_view = std::make_unique<PreviewStream>(
+                    this,
+                    "image_processing/" + prefix + "mask",
+                    mask_decimation,
+                    mask_rate
+                );
+                Stream *target = stream.get();
+                stream->image_subscription = create_subscription<sensor_msgs::msg::Image>(
+                    camera + "/image_raw",
+                    qos,
+                    [this, target](const sensor_msgs::msg::Image::ConstSharedPtr message) { receive_image(*target, message); },
+                    frame_options
+                );
+                streams.push_back(std::move(stream));
+            }
+
             threshold_subscription = create_subscription<custom_interfaces::msg::ThresholdAdjustment>(
                 "vision_threshold_adjustment",
                 10,
-                std::bind(&ImageProcessing::adjust_thresholds, this, std::placeholders::_1)
+                std::bind(&ImageProcessing::adjust_thresholds, this, std::placeholders::_1),
+                control_options
             );
 
-            if (DEBUG)
-            {
-                using namespace std::chrono_literals;
-                timer = create_wall_timer(1ms, std::bind(&ImageProcessing::image_show, this));
-            }
+            // frame_age is how old a frame is when processing starts, i.e. capture plus transport.
+            latency = std::make_unique<instrumentation::LatencyReporter>(
+                this,
+                std::vector<std::string>{"frame_age", "threshold", "histogram", "corners", "publish"}
+            );
+            health = std::make_unique<instrumentation::NodeHealth>(this, std::vector<std::string>{"image", "frame"});
+
+            parameter_callback = add_on_set_parameters_callback(
+                std::bind(&ImageProcessing::set_parameters, this, std::placeholders::_1)
+            );
 
-            RCLCPP_INFO(get_logger(), "%s node has started.", get_name());
+            // CPU the frame thread is pinned to (-1 leaves it unpinned) and its SCHED_FIFO priority (0 keeps
+            // the default scheduler). A realtime priority needs CAP_SYS_NICE or an rtprio limit.
+            int frame_cpu = declare_parameter("frame_thread_cpu", -1);
+            int frame_priority = declare_parameter("frame_thread_priority", 0);
+            frame_thread = std::thread([this, frame_cpu, frame_priority]() {
+                std::string error;
+                if (!set_thread_scheduling(frame_cpu, frame_priority, error))
+                    RCLCPP_WARN(get_logger(), "Frame thread %s", error.c_str());
+                health->add_current_thread("frame");
+                process_frames();
+            });
+            frame_executor.add_callback_group(frame_group, get_node_base_interface());
+            receive_thread = std::thread([this]() {
+                health->add_current_thread("receive");
+                frame_executor.spin();
+            });
+
+            RCLCPP_INFO(get_logger(), "%s node has started with %zu camera(s).", get_name(), streams.size());
+        }
+
+        ~ImageProcessing() override
+        {
+            frame_executor.cancel();
+            if (receive_thread.joinable())
+                receive_thread.join();
+            scheduler->stop();
+            if (frame_thread.joinable())
+                frame_thread.join();
         }
 
     private:
-        void process_image(const sensor_msgs::msg::Image::SharedPtr message)
+        // Frame callback, on the receive thread. A frame the frame thread has not got to yet is
+        // replaced, so each stream is only ever a frame behind.
+        void receive_image(Stream &stream, const sensor_msgs::msg::Image::ConstSharedPtr message)
         {
-            frame = cv_bridge::toCvCopy(message, message->encoding)->image;
-            frame_copy = frame.clone();
-            cv::cvtColor(frame, frame_red, cv::COLOR_BGR2HSV);
-            
-            int edge_result = NO_EDGE_FOUND;            
-            auto edge_thread = std::thread(&ImageProcessing::check_corners, this, std::ref(edge_result));
-	        
-            int line_width = 2;
-	        // create a frame of reference... adjust these as needed. They represent the 4 corners of the box.
-            cv::Point2f source[] = {
-                cv::Point2f(30, HEIGHT / 2),
-                cv::Point2f(WIDTH - 30, HEIGHT / 2),
-                cv::Point2f(0, HEIGHT),
-                cv::Point2f(WIDTH, HEIGHT)
-            };
-            
-            // goes from top left to top right
-            line(frame, source[0], source[1], RED, line_width);
-            // goes from top right to bottom right
-            line(frame, source[1], source[3], RED, line_width);
-            // goes from bottom right to bottom left
-            line(frame, source[3], source[2], RED, line_width);
-            // goes from bottom left to top left
-            line(frame, source[2], source[0], RED, line_width);
-            
-            threshold();
-            histogram();
-            find_largest_ball();
-            int ball_result = lane_center();
-
-            // We do not see a golf ball. We need the corner information. Wait for it.
-            if (ball_result == NO_BALL_FOUND)
-                edge_thread.join();
-
-            publish_image_data(ball_result, edge_result);
-            if (edge_thread.joinable())
-                edge_thread.join();
+            instrumentation::CallbackTimer timer(health->callback(IMAGE_CALLBACK));
+            if (scheduler->submit(stream.index, message))
+            {
+                health->callback(FRAME_CALLBACK).record_dropped();
+                publish_dropped_frames(stream, ++stream.dropped_frames);
+            }
         }
 
-        void check_corners(int &edge_result)
+        void process_frames()
         {
-            int box_width = 40, divisions = 255;
-            int pixels_from_top = 160, pixel_from_bottom = 0;
-
-            cv::Mat mask1, mask2, red_frame_copy;
-            // first digit in Scalar is it's Hue... (red goes from 175 to 5 (it wraps around 180 and back to 0))
-            // Second digit is for Saturation... The higher the saturation value, the deeper the red... a low saturation is a lighter red
-            // the third value represents value... a value of 0 is black. Darker read means a lower value 
-            inRange(frame_red, cv::Scalar(0, 120, lower_red_value), cv::Scalar(10, 255, 255), mask1);
-            inRange(frame_red, cv::Scalar(170, 120, lower_red_value), cv::Scalar(180, 255, 255), mask2);
-            add(mask1, mask2, frame_red);
-            
-            try
+            std::size_t index, waiting;
+            sensor_msgs::msg::Image::ConstSharedPtr message;
+            while (scheduler->take(index, message, waiting))
             {
-                cv::cvtColor(frame_red, red_frame_copy, cv::COLOR_GRAY2BGR);
-                int res = histogram(red_frame_copy, 0, box_width, pixels_from_top, pixel_from_bottom, divisions);
-                if (res != -1)
-                {
-                    RCLCPP_DEBUG(get_logger(), "Should turn right");
-                    edge_result = WIDTH - res - (WIDTH / 2);
-                    return;
-                }
+                instrumentation::CallbackStats &frame_health = health->callback(FRAME_CALLBACK);
+                instrumentation::CallbackTimer timer(frame_health);
+                frame_health.record_queue_depth(waiting);
+                process_image(*streams[index], message);
+            }
+        }
 
-                cv::cvtColor(frame_red, red_frame_copy, cv::COLOR_GRAY2BGR);
-                res = histogram(red_frame_copy, WIDTH - box_width, WIDTH, pixels_from_top, pixel_from_bottom, divisions);
-                if (res != -1)
-                {
-                    RCLCPP_DEBUG(get_logger(), "Should turn left");
-                    edge_result = WIDTH - res - (WIDTH / 2);
-                }
+        void process_image(Stream &stream, const sensor_msgs::msg::Image::ConstSharedPtr &message)
+        {
+            if (is_stale(message->header.stamp))
+            {
+                health->callback(FRAME_CALLBACK).record_dropped();
+                publish_dropped_frames(stream, ++stream.dropped_frames);
+                return;
             }
-            catch (const cv::Exception &e)
+
+            AllocationScope allocation_scope;
+            std::size_t allocations = counted_allocations();
+            record_frame_age(message->header.stamp);
+
+            // With intra-process comms the message is the camera driver's buffer. frame is a read-only
+            // view of it, and nothing is ever drawn onto it.
+            if (!view_message(stream, message))
+                return;
+
+            FramePipeline &pipeline = *stream.pipeline;
+            pipeline.set_thresholds(
+                lower_threshold.load(std::memory_order_relaxed),
+                lower_red_value.load(std::memory_order_relaxed)
+            );
+            if (auto_thresholding)
+                pipeline.set_auto_threshold_margin(auto_threshold_margin.load(std::memory_order_relaxed));
+            // Decided before processing, since a device backend only brings the red mask back for it.
+            bool debug = stream.debug_view->wanted();
+            pipeline.set_keep_red_mask(debug);
+            rclcpp::Time capture_time(message->header.stamp, get_clock()->get_clock_type());
+            bool sized = pipeline.process(
+                stream.frame,
+                stream.frame_layout,
+                stream.frame_height,
+                std::chrono::nanoseconds(capture_time.nanoseconds()),
+                stream.detections
+            );
+            record_stage_durations(pipeline.stage_durations());
+            if (auto_thresholding && pipeline.applied_lower_threshold() != stream.logged_lower_threshold)
             {
-                RCLCPP_WARN(get_logger(), "Could not convert image from gray to BGR format. Exception: %s", e.what());
+                stream.logged_lower_threshold = pipeline.applied_lower_threshold();
+                RCLCPP_INFO(
+                    get_logger(),
+                    "Auto threshold of %s: lower threshold %d, red value %d",
+                    stream.name.c_str(),
+                    stream.logged_lower_threshold,
+                    pipeline.applied_lower_red_value()
+                );
             }
+            if (stream.detections.labelling_truncated)
+                RCLCPP_WARN_THROTTLE(get_logger(), *get_clock(), 1000, "White mask has too many runs, only part of it was labelled");
+
+            // Publishing allocates the message, so it is left out of the check.
+            if (check_allocations && !sized)
+                report_allocations(counted_allocations() - allocations);
+
+            {
+                instrumentation::StageTimer timer(*latency, PUBLISH_LATENCY);
+                publish_image_data(stream);
+            }
+
+            if (debug)
+                submit_debug_snapshot(stream);
+            if (stream.mask_view->wanted())
+                stream.mask_view->submit(stream.frame_message->header, pipeline.buffers().white);
         }
 
-        void threshold()
+        void record_frame_age(const builtin_interfaces::msg::Time &stamp)
         {
-            cv::Mat frame_thresh, frame_gray;
-            cvtColor(frame_copy, frame_gray, cv::COLOR_BGR2GRAY);
-            // frame input name, min threshold for white, max threshold for white, frame output name. Tweak these as necessary, but min threshold may want to go down if indoors.
-            // find the white in the image.
-            inRange(frame_gray, lower_threshold, WHITE, frame_thresh); // 137 looked good indoors at night, 165 looked good indoors during the day
-            
-            frame_final = frame_thresh.clone();
-            cvtColor(frame_final, frame_final, cv::COLOR_GRAY2RGB);
+            rclcpp::Time capture_time(stamp, get_clock()->get_clock_type());
+            if (capture_time.nanoseconds() != 0)
+                latency->record(FRAME_AGE_LATENCY, std::chrono::nanoseconds((now() - capture_time).nanoseconds()));
         }
 
-        void histogram()
+        void record_stage_durations(const StageDurations &durations)
         {
-            // resize to the size of the lane.
-            histogram_lane.resize(frame.size().width);
-            histogram_lane.clear();
-            
-            // How far down from the top red line are we looking.
-            int pixels_from_top = (HEIGHT / 2) + 10;
-            cv::Mat roi_lane, frame_final_bgr;
-            cvtColor(frame_final, frame_final_bgr, cv::COLOR_RGB2BGR);
-            for (int i = 0; i < frame.size().width; i++)
-            {
-                // reason of interest strip
-                roi_lane = frame_final_bgr(cv::Rect(i, pixels_from_top, 1, HEIGHT - pixels_from_top));
-                divide(255, roi_lane, roi_lane);
-                histogram_lane.push_back((int)(sum(roi_lane)[0]));
-            }
+            latency->record(THRESHOLD_LATENCY, durations.threshold);
+            latency->record(HISTOGRAM_LATENCY, durations.histogram);
+            latency->record(CORNERS_LATENCY, durations.corners);
         }
 
-        // Assumes frame is in RGB format
-        int histogram(
-            cv::Mat &localframe,
-            int start,
-            int end,
-            int pixels_from_top,
-            int pixels_from_bottom = 0,
-            int divisions = 255)
+        bool is_stale(const builtin_interfaces::msg::Time &stamp)
         {
-            cv::Mat roi_lane;
-            for (int i = start; i < end; i++)
-            {
-                // reason of interest strip
-                roi_lane = localframe(cv::Rect(i, pixels_from_top, 1, HEIGHT - pixels_from_top - pixels_from_bottom));
-                divide(divisions, roi_lane, roi_lane);
-                if ((int)(sum(roi_lane)[0]) > 5)
-                    return i;
-            }
+            rclcpp::Time capture_time(stamp, get_clock()->get_clock_type());
+            if (max_frame_age.nanoseconds() <= 0 || capture_time.nanoseconds() == 0)
+                return false;
 
-            return -1;
+            return now() - capture_time > max_frame_age;
+        }
+
+        void publish_dropped_frames(Stream &stream, uint64_t count)
+        {
+            std_msgs::msg::UInt64 message;
+            message.data = count;
+            stream.dropped_frames_publisher->publish(message);
         }
 
-        int lane_center()
+        void submit_debug_snapshot(Stream &stream)
         {
-            int frame_center = WIDTH / 2;
-            
-            line(frame_final, cv::Point2f(frame_center, 0), cv::Point2f(frame_center, HEIGHT), BLUE, 3);
-            
-            // difference between true center and center ball...
-            return middle_pos - frame_center;
+            const FrameArena &buffers = stream.pipeline->buffers();
+            auto snapshot = std::make_unique<DebugSnapshot>();
+            snapshot->message = stream.frame_message;
+            snapshot->frame = stream.frame;
+            snapshot->layout = stream.frame_layout;
+            snapshot->white = buffers.white.clone();
+            snapshot->red = buffers.red.clone();
+            snapshot->ball_column = stream.detections.ball_column;
+            snapshot->balls = buffers.ball_candidates;
+            stream.debug_view->submit(std::move(snapshot));
         }
 
-        void find_middle_ball()
+        // Points the stream's frame at the message's pixels without copying them.
+        bool view_message(Stream &stream, const sensor_msgs::msg::Image::ConstSharedPtr &message)
         {
-            // iterator to point to max intensity spot
-            std::vector<int>::iterator left_ptr;
-            // scans from left-most pixel to left-middle pixel
-            left_ptr = max_element(histogram_lane.begin(), histogram_lane.begin() + 120);
-            auto left_lane_pos = distance(histogram_lane.begin(), left_ptr);
-            
-            // iterator to point to max intensity spot
-            std::vector<int>::iterator right_ptr;
-            // scans from right-middle pixel to right-most pixel
-            right_ptr = max_element(histogram_lane.end() - 119, histogram_lane.end());
-            auto right_lane_pos = distance(histogram_lane.begin(), right_ptr);
-            
-            // scans from left-middle pixel to right-middle pixel
-            std::vector<int>::iterator middle_ptr;
-            middle_ptr = max_element(histogram_lane.begin() + 121, histogram_lane.end() - 120);
-            middle_pos = distance(histogram_lane.begin(), middle_ptr);
-            
-            // middle is at pixel column 180
-            int mid_dist = abs(180 - middle_pos);
-            int left_dist = abs(180 - left_lane_pos);
-            int right_dist = abs(180 - right_lane_pos);
-            
-            if (mid_dist <= left_dist && mid_dist <= right_dist) {
-                middle_pos = middle_pos;
-            } else if (left_dist <= mid_dist && left_dist <= right_dist) {
-                middle_pos = left_lane_pos;
-            } else {
-                middle_pos = right_lane_pos;
+            if (!pixel_layout_from_encoding(message->encoding, stream.frame_layout))
+            {
+                RCLCPP_WARN(get_logger(), "Unsupported image encoding %s", message->encoding.c_str());
+                return false;
+            }
+
+            stream.frame_message = message;
+            stream.frame_height = message->height;
+
+            // The view is built directly rather than through cv_bridge, which allocates a CvImage for
+            // every frame.
+            if (!view_frame(
+                    stream.frame_layout,
+                    message->width,
+                    stream.frame_height,
+                    message->step,
+                    message->data.data(),
+                    message->data.size(),
+                    stream.frame
+                ))
+            {
+                RCLCPP_WARN(get_logger(), "Image data is smaller than its %s header describes", message->encoding.c_str());
+                return false;
             }
-            
-            line(frame_final, cv::Point2f(middle_pos, 0), cv::Point2f(middle_pos, HEIGHT), GREEN, 2);
+
+            return true;
         }
 
-        void find_largest_ball()
+        void report_allocations(std::size_t allocations)
         {
-            // iterator to point to max intensity spot
-            std::vector<int>::iterator whitest_ptr;
-            // scans from left-most pixel to left-middle pixel
-            whitest_ptr = max_element(histogram_lane.begin(), histogram_lane.end());
-            middle_pos = distance(histogram_lane.begin(), whitest_ptr);
-            
-            line(frame_final, cv::Point2f(middle_pos, 0), cv::Point2f(middle_pos, HEIGHT), GREEN, 2);
+            if (allocations == 0)
+                return;
+
+            frames_with_allocations++;
+            if (abort_on_allocation)
+            {
+                RCLCPP_FATAL(get_logger(), "Frame path made %zu heap allocation(s)", allocations);
+                std::abort();
+            }
+
+            RCLCPP_WARN_THROTTLE(
+                get_logger(),
+                *get_clock(),
+                1000,
+                "Frame path made %zu heap allocation(s), %llu frame(s) so far",
+                allocations, static_cast<unsigned long long>(frames_with_allocations)
+            );
         }
 
-        void publish_image_data(int ball_result, int &corner_result)
+        void publish_image_data(Stream &stream)
         {
-            // Publish result
-            auto message = custom_interfaces::msg::ImageData();
-            message.ball_position = ball_result;
-            message.corner_position = corner_result;
-            image_data_publisher->publish(message);
+            const FrameDetections &detections = stream.detections;
+            // Publish result. As a unique_ptr, so that navigation in the same container takes
+            // ownership of it instead of receiving a copy.
+            auto message = std::make_unique<custom_interfaces::msg::ImageData>();
+            // Carries the camera's capture stamp, so downstream can tell how old the result is.
+            message->header = stream.frame_message->header;
+            message->ball_position = detections.ball_position;
+            message->ball_predicted = detections.ball_predicted;
+            message->corner_position = detections.corner_position;
+
+            // Candidates are reported in full-frame coordinates, so undo the capture crop.
+            int row_offset = HEIGHT - stream.frame_height;
+            for (const auto &ball : stream.pipeline->buffers().ball_candidates)
+            {
+                custom_interfaces::msg::BallCandidate candidate;
+                candidate.centroid_x = ball.centroid_x;
+                candidate.centroid_y = ball.centroid_y + row_offset;
+                candidate.area = ball.area;
+                candidate.x = ball.box.x;
+                candidate.y = ball.box.y + row_offset;
+                candidate.width = ball.box.width;
+                candidate.height = ball.box.height;
+                message->balls.push_back(candidate);
+            }
+            stream.image_data_publisher->publish(std::move(message));
         }
 
         void adjust_thresholds(const custom_interfaces::msg::ThresholdAdjustment::SharedPtr threshold_adjustment)
         {
+            // control_group is mutually exclusive, so this is the only writer and a plain load and
+            // store is enough; the frame thread picks the new value up on its next frame of any stream.
             int lower_adj = threshold_adjustment->lower_adjustment;
             int red_adj = threshold_adjustment->red_adjustment;
+            int lower = lower_threshold.load(std::memory_order_relaxed);
+            int red = lower_red_value.load(std::memory_order_relaxed);
 
-            if (lower_adj != 0 && lower_threshold + lower_adj >= 0 && lower_threshold + lower_adj <= 255)
+            if (auto_thresholding && lower_adj != 0)
+            {
+                int margin = auto_threshold_margin.load(std::memory_order_relaxed) + lower_adj;
+                auto_threshold_margin.store(margin, std::memory_order_relaxed);
+                RCLCPP_INFO(get_logger(), "Auto Threshold Margin: %d", margin);
+            }
+            else if (lower_adj != 0 && lower + lower_adj >= 0 && lower + lower_adj <= 255)
             {
-                lower_threshold += lower_adj;
-                RCLCPP_INFO(get_logger(), "Lower Threshold: %d", lower_threshold);
+                lower_threshold.store(lower + lower_adj, std::memory_order_relaxed);
+                RCLCPP_INFO(get_logger(), "Lower Threshold: %d", lower + lower_adj);
             }
-            if (red_adj != 0 && lower_red_value + red_adj >= 0 && lower_red_value + red_adj <= 255)
+            if (red_adj != 0 && red + red_adj >= 0 && red + red_adj <= 255)
             {
-                lower_red_value += red_adj;
-                RCLCPP_INFO(get_logger(), "Red Value: %d", lower_red_value);
+                lower_red_value.store(red + red_adj, std::memory_order_relaxed);
+                RCLCPP_INFO(get_logger(), "Red Value: %d", red + red_adj);
             }
         }
 
-        void image_show()
+        rcl_interfaces::msg::SetParametersResult set_parameters(const std::vector<rclcpp::Parameter> &parameters)
         {
-            if (!frame.empty())
-            {
-                cv::imshow("raw_image", frame);
-                cv::waitKey(1);
-            }
+            rcl_interfaces::msg::SetParametersResult result;
+            result.successful = true;
 
-            if (!frame_final.empty())
+            for (const auto &parameter : parameters)
             {
-                cv::imshow("final_image", frame_final);
-                cv::waitKey(1);
+                if (parameter.get_name() == "debug" && parameter.get_type() == rclcpp::ParameterType::PARAMETER_BOOL)
+                {
+                    for (auto &stream : streams)
+                        stream->debug_view->set_enabled(parameter.as_bool());
+                }
+                else if (parameter.get_name() == "debug_rate" && parameter.get_type() == rclcpp::ParameterType::PARAMETER_DOUBLE)
+                {
+                    for (auto &stream : streams)
+                        stream->debug_view->set_max_rate(parameter.as_double());
+                }
+                else if (parameter.get_name() == "mask_rate" && parameter.get_type() == rclcpp::ParameterType::PARAMETER_DOUBLE)
+                {
+                    for (auto &stream : streams)
+                        stream->mask_view->set_max_rate(parameter.as_double());
+                }
+                else if (parameter.get_name() == "debug" || parameter.get_name() == "debug_rate" || parameter.get_name() == "mask_rate")
+                {
+                    result.successful = false;
+                    result.reason = parameter.get_name() + " has the wrong type";
+                }
             }
 
-            if (!frame_red.empty())
-            {
-                cv::imshow("frame_red", frame_red);
-                cv::waitKey(1);
-            }
-            
+            return result;
         }
 };
 
-int main(int argc, char **argv)
-{
-    rclcpp::init(argc, argv);
-    rclcpp::spin(std::make_shared<ImageProcessing>());
-    rclcpp::shutdown();
-    return 0;
-}
+}  // namespace vision
+
+RCLCPP_COMPONENTS_REGISTER_NODE(vision::ImageProcessing)
@@ -0,0 +1,142 @@
+#include "vision/pipeline_executor.hpp"
+
+#include "vision/thread_scheduling.hpp"
+
+namespace vision
+{
+
+// How many times an idle worker polls its queue before going to sleep. At 30 fps a frame
+// arrives every ~33 ms, so this only keeps the worker hot across the stages of one frame.
+static constexpr int SPIN_ITERATIONS = 2000;
+// How many times a waiter polls for its stage to finish before going to sleep, well under a
+// millisecond of yields.
+static constexpr int COMPLETION_SPIN_ITERATIONS = 1000;
+
+void StageCompletion::signal()
+{
+    done.store(true, std::memory_order_release);
+
+    // Pairs with the fence in wait(): either the waiter sees the stage done before sleeping, or
+    // we see it asleep and wake it up.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleeping.load(std::memory_order_relaxed))
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        wake.notify_one();
+    }
+}
+
+void StageCompletion::wait()
+{
+    for (int spins = 0; spins < COMPLETION_SPIN_ITERATIONS; spins++)
+    {
+        if (ready())
+            return;
+        std::this_thread::yield();
+    }
+
+    sleeping.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [this]() { return ready(); });
+    }
+    sleeping.store(false, std::memory_order_relaxed);
+}
+
+PipelineExecutor::PipelineExecutor(const std::vector<int> &cpus) : running(true)
+{
+    for (std::size_t i = 0; i < cpus.size(); i++)
+        workers.emplace_back(new Worker());
+
+    for (std::size_t i = 0; i < cpus.size(); i++)
+    {
+        workers[i]->started.reset();
+        workers[i]->thread = std::thread(&PipelineExecutor::worker_loop, this, std::ref(*workers[i]), cpus[i]);
+    }
+
+    // So that scheduling_error() can be read as soon as the executor is constructed.
+    for (auto &worker : workers)
+        worker->started.wait();
+}
+
+PipelineExecutor::~PipelineExecutor()
+{
+    running.store(false);
+    for (auto &worker : workers)
+    {
+        {
+            std::lock_guard<std::mutex> lock(worker->mutex);
+        }
+        worker->wake.notify_one();
+    }
+
+    for (auto &worker : workers)
+    {
+        if (worker->thread.joinable())
+            worker->thread.join();
+    }
+}
+
+bool PipelineExecutor::submit(std::size_t index, void (*run)(void *), void *context, StageCompletion &completion)
+{
+    Worker &worker = *workers.at(index);
+
+    completion.reset();
+    if (!worker.queue.push(Task{run, context, &completion}))
+    {
+        completion.signal();
+        return false;
+    }
+
+    // Pairs with the fence in worker_loop: either the worker sees the task before sleeping,
+    // or we see it asleep and wake it up.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (worker.sleeping.load(std::memory_order_relaxed))
+    {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.wake.notify_one();
+    }
+
+    return true;
+}
+
+void PipelineExecutor::worker_loop(Worker &worker, int cpu)
+{
+    // A worker that cannot be pinned still runs, just wherever the scheduler puts it.
+    set_thread_scheduling(cpu, 0, worker.scheduling_error);
+    worker.started.signal();
+
+    Task task;
+    while (running.load(std::memory_order_relaxed))
+    {
+        int spins = 0;
+        while (!worker.queue.pop(task))
+        {
+            if (!running.load(std::memory_order_relaxed))
+                return;
+
+            if (++spins < SPIN_ITERATIONS)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+
+            worker.sleeping.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            {
+                std::unique_lock<std::mutex> lock(worker.mutex);
+                worker.wake.wait(lock, [&]() {
+                    return !worker.queue.empty() || !running.load(std::memory_order_relaxed);
+                });
+            }
+            worker.sleeping.store(false, std::memory_order_relaxed);
+            spins = 0;
+        }
+
+        task.run(task.context);
+        task.completion->signal();
+    }
+}
+
+}  // namespace vision
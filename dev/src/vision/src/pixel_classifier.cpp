@@ -0,0 +1,416 @@
+#include "vision/pixel_classifier.hpp"
+
+#include <algorithm>
+#include <utility>
+
+namespace vision
+{
+
+static int clamp_byte(double value)
+{
+    return std::min(255, std::max(0, static_cast<int>(value + 0.5)));
+}
+
+// Same fixed-point weights cv::COLOR_BGR2GRAY uses.
+int bgr_gray(int b, int g, int r)
+{
+    return (b * 1868 + g * 9617 + r * 4899 + (1 << 13)) >> 14;
+}
+
+bool is_red_bgr(int b, int g, int r, int lower_red_value)
+{
+    int value = std::max(r, std::max(g, b));
+    int difference = value - std::min(r, std::min(g, b));
+    if (value < lower_red_value || value == 0 || difference == 0)
+        return false;
+
+    int saturation = (255 * difference + value / 2) / value;
+    if (saturation < RED_MIN_SATURATION)
+        return false;
+
+    double hue;
+    if (value == r)
+        hue = 60.0 * (g - b) / difference;
+    else if (value == g)
+        hue = 120.0 + 60.0 * (b - r) / difference;
+    else
+        hue = 240.0 + 60.0 * (r - g) / difference;
+    if (hue < 0)
+        hue += 360.0;
+
+    int hue_8bit = static_cast<int>(hue / 2 + 0.5);
+    return hue_8bit <= RED_LOW_HUE_MAX || hue_8bit >= RED_HIGH_HUE_MIN;
+}
+
+// Whether any colour of the cube from (b, g, r) to (b + last, g + last, r + last) can pass the red
+// test. A false answer is exact, from bounds on the cube: its value stays below lower_red_value,
+// red is never the largest channel, which puts the hue between 60 and 300 degrees, or its
+// saturation stays below RED_MIN_SATURATION.
+static bool may_be_red(int b, int g, int r, int last, int lower_red_value)
+{
+    int highest = std::max(r, std::max(g, b)) + last;
+    int lowest = std::min(r, std::min(g, b));
+    if (highest < lower_red_value || r + last < std::max(g, b))
+        return false;
+
+    // The rounded saturation is at most 255 * (highest - lowest) / highest + 1/2.
+    return 2 * 255 * (highest - lowest) + highest >= 2 * RED_MIN_SATURATION * highest;
+}
+
+// Whether every colour of the cube passes the red test. The red region is not monotonic, so the
+// cube is only sampled at its corners and centre first, and the whole cube checked if they agree.
+static bool is_all_red(int b, int g, int r, int last, int lower_red_value)
+{
+    for (int corner = 0; corner < 8; corner++)
+    {
+        if (!is_red_bgr(b + ((corner & 1) ? last : 0), g + ((corner & 2) ? last : 0), r + ((corner & 4) ? last : 0), lower_red_value))
+            return false;
+    }
+    if (!is_red_bgr(b + last / 2, g + last / 2, r + last / 2, lower_red_value))
+        return false;
+
+    for (int db = 0; db <= last; db++)
+    {
+        for (int dg = 0; dg <= last; dg++)
+        {
+            for (int dr = 0; dr <= last; dr++)
+            {
+                if (!is_red_bgr(b + db, g + dg, r + dr, lower_red_value))
+                    return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+// Mirrors cv::COLOR_YUV2BGR_*, so the native path keeps the thresholds tuned on BGR frames.
+static bool is_red_yuv(int y, int u, int v, int lower_red_value)
+{
+    double luma = 1.164 * (y - 16);
+    int r = clamp_byte(luma + 1.596 * (v - 128));
+    int g = clamp_byte(luma - 0.813 * (v - 128) - 0.391 * (u - 128));
+    int b = clamp_byte(luma + 2.018 * (u - 128));
+    return is_red_bgr(b, g, r, lower_red_value);
+}
+
+bool pixel_layout_from_encoding(const std::string &encoding, PixelLayout &layout)
+{
+    if (encoding == "bgr8")
+        layout = PixelLayout::BGR;
+    else if (encoding == YUYV_ENCODING)
+        layout = PixelLayout::YUYV;
+    else if (encoding == NV12_ENCODING)
+        layout = PixelLayout::NV12;
+    else
+        return false;
+
+    return true;
+}
+
+int luma_threshold_from_gray(int gray_threshold)
+{
+    return clamp_byte(16 + gray_threshold / 1.164);
+}
+
+PixelClassifier::Tables::Tables()
+    : bgr_lower_threshold(-1), bgr_lower_red_value(-1), yuv_lower_threshold(-1), yuv_lower_red_value(-1), luma_threshold(0)
+{
+    bgr_cells.fill(0);
+}
+
+bool PixelClassifier::Tables::built_for(bool bgr, int lower_threshold, int lower_red_value) const
+{
+    if (bgr)
+        return bgr_lower_threshold == lower_threshold && bgr_lower_red_value == lower_red_value;
+    return yuv_lower_threshold == lower_threshold && yuv_lower_red_value == lower_red_value;
+}
+
+bool PixelClassifier::uses(int lower_threshold, int lower_red_value, PixelLayout layout) const
+{
+    return front->built_for(layout == PixelLayout::BGR, lower_threshold, lower_red_value);
+}
+
+bool PixelClassifier::Tables::built(bool bgr) const
+{
+    return bgr ? bgr_lower_threshold >= 0 : yuv_lower_threshold >= 0;
+}
+
+void PixelClassifier::Tables::build(bool bgr, int lower_threshold, int lower_red_value)
+{
+    // The red half of the tables is the expensive one, so only rebuild what changed.
+    if (bgr) {
+        bool white_changed = lower_threshold != bgr_lower_threshold;
+        bool red_changed = lower_red_value != bgr_lower_red_value;
+        bgr_lower_threshold = lower_threshold;
+        bgr_lower_red_value = lower_red_value;
+        build_bgr_table(white_changed, red_changed);
+    } else {
+        bool red_changed = lower_red_value != yuv_lower_red_value;
+        yuv_lower_threshold = lower_threshold;
+        yuv_lower_red_value = lower_red_value;
+        luma_threshold = luma_threshold_from_gray(lower_threshold);
+        if (red_changed)
+            build_chroma_table();
+    }
+}
+
+PixelClassifier::PixelClassifier()
+    : front(&tables[0]), back(&tables[1]), back_state(BackState::IDLE), has_request(false), running(true)
+{
+    builder = std::thread(&PixelClassifier::run_builder, this);
+}
+
+PixelClassifier::~PixelClassifier()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    wake.notify_one();
+    builder.join();
+}
+
+void PixelClassifier::configure(int lower_threshold, int lower_red_value, PixelLayout layout)
+{
+    bool bgr = layout == PixelLayout::BGR;
+    std::unique_lock<std::mutex> lock(mutex);
+    if (back_state == BackState::READY) {
+        std::swap(front, back);
+        back_state = BackState::IDLE;
+    }
+
+    if (front->built_for(bgr, lower_threshold, lower_red_value)) {
+        has_request = false;
+        return;
+    }
+
+    if (!front->built(bgr)) {
+        // Nothing to classify this layout with yet. The builder only ever touches back.
+        lock.unlock();
+        front->build(bgr, lower_threshold, lower_red_value);
+        return;
+    }
+
+    Request request{bgr, lower_threshold, lower_red_value};
+    bool in_progress = back_state == BackState::BUILDING && building.bgr == bgr &&
+        building.lower_threshold == lower_threshold && building.lower_red_value == lower_red_value;
+    has_request = !in_progress;
+    if (has_request) {
+        requested = request;
+        wake.notify_one();
+    }
+}
+
+void PixelClassifier::run_builder()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        wake.wait(lock, [this] { return !running || has_request; });
+        if (!running)
+            return;
+
+        building = requested;
+        has_request = false;
+        back_state = BackState::BUILDING;
+        lock.unlock();
+        back->build(building.bgr, building.lower_threshold, building.lower_red_value);
+        lock.lock();
+        back_state = BackState::READY;
+    }
+}
+
+void PixelClassifier::Tables::build_bgr_table(bool white, bool red)
+{
+    const int last = (1 << BGR_SHIFT) - 1;
+    for (int b_cell = 0; b_cell < BGR_CELLS; b_cell++)
+    {
+        for (int g_cell = 0; g_cell < BGR_CELLS; g_cell++)
+        {
+            for (int r_cell = 0; r_cell < BGR_CELLS; r_cell++)
+            {
+                int b = b_cell << BGR_SHIFT, g = g_cell << BGR_SHIFT, r = r_cell << BGR_SHIFT;
+                uint8_t &cell = bgr_cells[(b_cell * BGR_CELLS + g_cell) * BGR_CELLS + r_cell];
+
+                if (white)
+                {
+                    cell &= ~(CELL_WHITE | CELL_CHECK_WHITE);
+                    // Gray is monotonic in every channel, so the cube's corners bound it.
+                    if (bgr_gray(b, g, r) >= bgr_lower_threshold)
+                        cell |= CELL_WHITE;
+                    else if (bgr_gray(b + last, g + last, r + last) >= bgr_lower_threshold)
+                        cell |= CELL_CHECK_WHITE;
+                }
+
+                if (red)
+                {
+                    cell &= ~(CELL_RED | CELL_CHECK_RED);
+                    if (may_be_red(b, g, r, last, bgr_lower_red_value))
+                        cell |= is_all_red(b, g, r, last, bgr_lower_red_value) ? CELL_RED : CELL_CHECK_RED;
+                }
+            }
+        }
+    }
+}
+
+void PixelClassifier::Tables::build_chroma_table()
+{
+    int half_cell = (1 << CHROMA_SHIFT) / 2;
+    for (int u_cell = 0; u_cell < CHROMA_CELLS; u_cell++)
+    {
+        for (int v_cell = 0; v_cell < CHROMA_CELLS; v_cell++)
+        {
+            int u = (u_cell << CHROMA_SHIFT) + half_cell;
+            int v = (v_cell << CHROMA_SHIFT) + half_cell;
+
+            // An empty interval (low > high) never matches.
+            int low = 255, high = 0;
+            for (int y = 0; y < 256; y++)
+            {
+                if (is_red_yuv(y, u, v, yuv_lower_red_value))
+                {
+                    low = std::min(low, y);
+                    high = std::max(high, y);
+                }
+            }
+
+            lowest_red_luma[u_cell * CHROMA_CELLS + v_cell] = static_cast<uint8_t>(low);
+            highest_red_luma[u_cell * CHROMA_CELLS + v_cell] = static_cast<uint8_t>(high);
+        }
+    }
+}
+
+void PixelClassifier::classify(
+    const cv::Mat &frame,
+    PixelLayout layout,
+    int height,
+    int row_begin,
+    int row_end,
+    cv::Mat &white,
+    cv::Mat &red,
+    IntensityHistogram *histogram) const
+{
+    CV_Assert(white.type() == CV_8UC1 && red.type() == CV_8UC1);
+    CV_Assert(row_begin >= 0 && row_end <= height && row_end <= white.rows && row_end <= red.rows);
+
+    switch (layout)
+    {
+        case PixelLayout::BGR:
+            classify_bgr(frame, row_begin, row_end, white, red, histogram);
+            break;
+        case PixelLayout::YUYV:
+            classify_yuyv(frame, row_begin, row_end, white, red, histogram);
+            break;
+        case PixelLayout::NV12:
+            classify_nv12(frame, height, row_begin, row_end, white, red, histogram);
+            break;
+    }
+}
+
+void PixelClassifier::classify_bgr(
+    const cv::Mat &bgr,
+    int row_begin,
+    int row_end,
+    cv::Mat &white,
+    cv::Mat &red,
+    IntensityHistogram *histogram) const
+{
+    const Tables &current = *front;
+    CV_Assert(bgr.type() == CV_8UC3);
+    uint32_t *counts = histogram ? histogram->data() : nullptr;
+
+    for (int row = row_begin; row < row_end; row++)
+    {
+        const uint8_t *source = bgr.ptr<uint8_t>(row);
+        uint8_t *white_row = white.ptr<uint8_t>(row);
+        uint8_t *red_row = red.ptr<uint8_t>(row);
+        for (int col = 0; col < bgr.cols; col++, source += 3)
+        {
+            int b = source[0], g = source[1], r = source[2];
+            uint8_t cell = current.bgr_cells[((b >> BGR_SHIFT) * BGR_CELLS + (g >> BGR_SHIFT)) * BGR_CELLS + (r >> BGR_SHIFT)];
+
+            bool is_white = (cell & CELL_WHITE) || ((cell & CELL_CHECK_WHITE) && bgr_gray(b, g, r) >= current.bgr_lower_threshold);
+            bool is_red = (cell & CELL_RED) || ((cell & CELL_CHECK_RED) && is_red_bgr(b, g, r, current.bgr_lower_red_value));
+            white_row[col] = is_white ? 255 : 0;
+            red_row[col] = is_red ? 255 : 0;
+            if (counts)
+                counts[bgr_gray(b, g, r)]++;
+        }
+    }
+}
+
+void PixelClassifier::classify_yuyv(
+    const cv::Mat &yuyv,
+    int row_begin,
+    int row_end,
+    cv::Mat &white,
+    cv::Mat &red,
+    IntensityHistogram *histogram) const
+{
+    const Tables &current = *front;
+    CV_Assert(yuyv.type() == CV_8UC2 && yuyv.cols % 2 == 0);
+    uint32_t *counts = histogram ? histogram->data() : nullptr;
+
+    for (int row = row_begin; row < row_end; row++)
+    {
+        const uint8_t *source = yuyv.ptr<uint8_t>(row);
+        uint8_t *white_row = white.ptr<uint8_t>(row);
+        uint8_t *red_row = red.ptr<uint8_t>(row);
+        // Each Y0 U Y1 V macropixel shares one chroma pair between two pixels.
+        for (int col = 0; col < yuyv.cols; col += 2, source += 4)
+        {
+            int index = (source[1] >> CHROMA_SHIFT) * CHROMA_CELLS + (source[3] >> CHROMA_SHIFT);
+            uint8_t low = current.lowest_red_luma[index], high = current.highest_red_luma[index];
+
+            white_row[col] = source[0] >= current.luma_threshold ? 255 : 0;
+            white_row[col + 1] = source[2] >= current.luma_threshold ? 255 : 0;
+            red_row[col] = (source[0] >= low && source[0] <= high) ? 255 : 0;
+            red_row[col + 1] = (source[2] >= low && source[2] <= high) ? 255 : 0;
+            if (counts)
+            {
+                counts[source[0]]++;
+                counts[source[2]]++;
+            }
+        }
+    }
+}
+
+void PixelClassifier::classify_nv12(
+    const cv::Mat &nv12,
+    int height,
+    int row_begin,
+    int row_end,
+    cv::Mat &white,
+    cv::Mat &red,
+    IntensityHistogram *histogram) const
+{
+    const Tables &current = *front;
+    CV_Assert(nv12.type() == CV_8UC1 && nv12.rows >= height + height / 2 && nv12.cols % 2 == 0);
+    uint32_t *counts = histogram ? histogram->data() : nullptr;
+
+    for (int row = row_begin; row < row_end; row++)
+    {
+        const uint8_t *luma = nv12.ptr<uint8_t>(row);
+        // The UV plane follows the Y plane and is subsampled 2x2.
+        const uint8_t *chroma = nv12.ptr<uint8_t>(height + row / 2);
+        uint8_t *white_row = white.ptr<uint8_t>(row);
+        uint8_t *red_row = red.ptr<uint8_t>(row);
+        for (int col = 0; col < nv12.cols; col += 2)
+        {
+            int index = (chroma[col] >> CHROMA_SHIFT) * CHROMA_CELLS + (chroma[col + 1] >> CHROMA_SHIFT);
+            uint8_t low = current.lowest_red_luma[index], high = current.highest_red_luma[index];
+
+            white_row[col] = luma[col] >= current.luma_threshold ? 255 : 0;
+            white_row[col + 1] = luma[col + 1] >= current.luma_threshold ? 255 : 0;
+            red_row[col] = (luma[col] >= low && luma[col] <= high) ? 255 : 0;
+            red_row[col + 1] = (luma[col + 1] >= low && luma[col + 1] <= high) ? 255 : 0;
+            if (counts)
+            {
+                counts[luma[col]]++;
+                counts[luma[col + 1]]++;
+            }
+        }
+    }
+}
+
+}  // namespace vision
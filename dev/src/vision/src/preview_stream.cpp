@@ -0,0 +1,128 @@
+#include "vision/preview_stream.hpp"
+
+#include <algorithm>
+
+#include <cv_bridge/cv_bridge.h>
+#include <opencv2/imgproc.hpp>
+
+namespace vision
+{
+
+PreviewStream::PreviewStream(rclcpp::Node *node, const std::string &topic, int decimation, double max_rate)
+: node(node), decimation(std::max(1, decimation)), period_ns(0), running(true)
+{
+    publisher = image_transport::create_publisher(node, topic);
+    set_max_rate(max_rate);
+    thread = std::thread(&PreviewStream::publish_loop, this);
+}
+
+PreviewStream::~PreviewStream()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    wake.notify_one();
+
+    if (thread.joinable())
+        thread.join();
+}
+
+void PreviewStream::set_max_rate(double rate)
+{
+    period_ns = rate > 0.0 ? static_cast<int64_t>(1e9 / rate) : 0;
+}
+
+bool PreviewStream::wanted()
+{
+    if (publisher.getNumSubscribers() == 0)
+        return false;
+
+    auto now = std::chrono::steady_clock::now();
+    if (now - last_frame < std::chrono::nanoseconds(period_ns.load()))
+        return false;
+
+    last_frame = now;
+    return true;
+}
+
+void PreviewStream::submit(const std_msgs::msg::Header &header, const cv::Mat &frame, PixelLayout layout)
+{
+    std::unique_ptr<Frame> next;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        next = std::move(spare);
+    }
+    if (!next)
+        next = std::make_unique<Frame>();
+
+    next->header = header;
+    next->layout = layout;
+    frame.copyTo(next->image);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        // A frame the thread has not got to yet becomes the spare.
+        spare = std::move(pending);
+        pending = std::move(next);
+    }
+    wake.notify_one();
+}
+
+void PreviewStream::publish_loop()
+{
+    while (true)
+    {
+        std::unique_ptr<Frame> frame;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this] { return !running || pending; });
+            if (!running)
+                return;
+            frame = std::move(pending);
+        }
+
+        try
+        {
+            publish(*frame);
+        }
+        catch (const cv::Exception &e)
+        {
+            RCLCPP_WARN(node->get_logger(), "Could not publish preview image: %s", e.what());
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!spare)
+            spare = std::move(frame);
+    }
+}
+
+void PreviewStream::publish(Frame &frame)
+{
+    cv::Mat bgr;
+    if (frame.layout == PixelLayout::YUYV)
+        cv::cvtColor(frame.image, bgr, cv::COLOR_YUV2BGR_YUYV);
+    else if (frame.layout == PixelLayout::NV12)
+        cv::cvtColor(frame.image, bgr, cv::COLOR_YUV2BGR_NV12);
+    else
+        bgr = frame.image;
+
+    // Masks are scaled by sampling so they stay black and white.
+    bool mono = bgr.channels() == 1;
+    cv::Mat scaled = bgr;
+    if (decimation > 1)
+    {
+        cv::resize(
+            bgr,
+            scaled,
+            cv::Size(std::max(1, bgr.cols / decimation), std::max(1, bgr.rows / decimation)),
+            0,
+            0,
+            mono ? cv::INTER_NEAREST : cv::INTER_AREA
+        );
+    }
+
+    publisher.publish(cv_bridge::CvImage(frame.header, mono ? "mono8" : "bgr8", scaled).toImageMsg());
+}
+
+}  // namespace vision
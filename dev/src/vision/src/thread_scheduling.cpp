@@ -0,0 +1,46 @@
+#include "vision/thread_scheduling.hpp"
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <cstring>
+
+namespace vision
+{
+
+bool set_thread_scheduling(int cpu, int realtime_priority, std::string &error)
+{
+    bool ok = true;
+    error.clear();
+
+    if (cpu >= 0)
+    {
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        CPU_SET(cpu, &cpu_set);
+        int result = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+        if (result != 0)
+        {
+            error = "cannot pin to CPU " + std::to_string(cpu) + ": " + std::strerror(result);
+            ok = false;
+        }
+    }
+
+    if (realtime_priority > 0)
+    {
+        sched_param param{};
+        param.sched_priority = realtime_priority;
+        int result = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (result != 0)
+        {
+            if (!error.empty())
+                error += ", ";
+            error += "cannot set SCHED_FIFO priority " + std::to_string(realtime_priority) + ": " + std::strerror(result);
+            ok = false;
+        }
+    }
+
+    return ok;
+}
+
+}  // namespace vision
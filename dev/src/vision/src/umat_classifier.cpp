@@ -0,0 +1,113 @@
+#include "vision/umat_classifier.hpp"
+
+#include <algorithm>
+
+#include <opencv2/core/ocl.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "vision/detection_kernels.hpp"
+
+namespace vision
+{
+
+UMatClassifier::UMatClassifier()
+: device_frame(cv::USAGE_ALLOCATE_DEVICE_MEMORY), lower_threshold(180), lower_red_value(195),
+  luma_threshold(luma_threshold_from_gray(180))
+{
+}
+
+bool UMatClassifier::available()
+{
+    if (!cv::ocl::haveOpenCL())
+        return false;
+
+    cv::ocl::setUseOpenCL(true);
+    return cv::ocl::useOpenCL();
+}
+
+void UMatClassifier::configure(int lower_threshold, int lower_red_value)
+{
+    this->lower_threshold = lower_threshold;
+    this->lower_red_value = lower_red_value;
+    luma_threshold = luma_threshold_from_gray(lower_threshold);
+}
+
+void UMatClassifier::classify(
+    const cv::Mat &frame,
+    PixelLayout layout,
+    int height,
+    int row_begin,
+    const DetectorRegions &regions,
+    cv::Mat &white_mask,
+    cv::Mat *red_mask,
+    std::vector<int> &counts)
+{
+    CV_Assert(white_mask.type() == CV_8UC1 && row_begin >= 0 && row_begin <= height);
+
+    // Everything on the device is in the coordinates of the uploaded rows.
+    cv::Rect rows(0, row_begin, frame.cols, height - row_begin);
+    cv::Point offset(0, row_begin);
+
+    // The one upload. NV12 goes up whole, since its UV plane cannot be converted apart from the
+    // Y plane; the masks still only cover the rows of interest.
+    cv::UMat colour;
+    if (layout == PixelLayout::NV12)
+    {
+        frame.copyTo(device_frame);
+        cv::cvtColor(device_frame, bgr, cv::COLOR_YUV2BGR_NV12);
+        colour = bgr(rows);
+        cv::compare(device_frame(rows), luma_threshold, white, cv::CMP_GE);
+    }
+    else
+    {
+        frame.rowRange(row_begin, height).copyTo(device_frame);
+        if (layout == PixelLayout::YUYV)
+        {
+            cv::cvtColor(device_frame, bgr, cv::COLOR_YUV2BGR_YUYV);
+            colour = bgr;
+            cv::extractChannel(device_frame, luma, 0);
+            cv::compare(luma, luma_threshold, white, cv::CMP_GE);
+        }
+        else
+        {
+            colour = device_frame;
+            cv::cvtColor(colour, luma, cv::COLOR_BGR2GRAY);
+            cv::compare(luma, lower_threshold, white, cv::CMP_GE);
+        }
+    }
+
+    // Red wraps around hue 180, so it is the union of both ends of the hue range.
+    cv::cvtColor(colour, hsv, cv::COLOR_BGR2HSV);
+    cv::inRange(hsv, cv::Scalar(0, RED_MIN_SATURATION, lower_red_value), cv::Scalar(RED_LOW_HUE_MAX, 255, 255), red);
+    cv::inRange(hsv, cv::Scalar(RED_HIGH_HUE_MIN, RED_MIN_SATURATION, lower_red_value), cv::Scalar(180, 255, 255), red_high);
+    cv::bitwise_or(red, red_high, red);
+
+    // Column sums of both strips side by side in one row, so they come back in one download.
+    cv::Rect left = regions.left_edge - offset, right = regions.right_edge - offset;
+    int columns = std::max(0, left.width) + std::max(0, right.width);
+    counts.resize(columns);
+    if (columns > 0)
+    {
+        strip_counts.create(1, columns, CV_32SC1);
+        if (left.width > 0)
+            cv::reduce(red(left), strip_counts(cv::Rect(0, 0, left.width, 1)), 0, cv::REDUCE_SUM, CV_32S);
+        if (right.width > 0)
+            cv::reduce(red(right), strip_counts(cv::Rect(columns - right.width, 0, right.width, 1)), 0, cv::REDUCE_SUM, CV_32S);
+
+        cv::Mat host_counts(1, columns, CV_32SC1, counts.data());
+        strip_counts.copyTo(host_counts);
+        // Sums of WHITE-valued pixels, back to pixel counts.
+        for (int &count : counts)
+            count /= WHITE;
+    }
+
+    cv::Mat white_rows = white_mask.rowRange(row_begin, height);
+    white.copyTo(white_rows);
+    if (red_mask != nullptr)
+    {
+        cv::Mat red_rows = red_mask->rowRange(row_begin, height);
+        red.copyTo(red_rows);
+    }
+}
+
+}  // namespace vision
@@ -0,0 +1,257 @@
+#include "vision/v4l2_capture.hpp"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+
+namespace vision
+{
+
+static std::runtime_error v4l2_error(const std::string &what)
+{
+    return std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+V4l2Capture::V4l2Capture()
+: fd(-1), streaming(false), cropped(false), width(0), height(0), pixel_format(0), bytes_per_line(0)
+{
+}
+
+V4l2Capture::~V4l2Capture()
+{
+    close();
+}
+
+int V4l2Capture::xioctl(unsigned long request, void *argument)
+{
+    int result;
+    do
+    {
+        result = ioctl(fd, request, argument);
+    } while (result == -1 && errno == EINTR);
+
+    return result;
+}
+
+void V4l2Capture::open(
+    const std::string &device,
+    uint32_t requested_width,
+    uint32_t requested_height,
+    uint32_t fps,
+    uint32_t requested_pixel_format,
+    uint32_t crop_rows,
+    uint32_t buffer_count)
+{
+    close();
+
+    fd = ::open(device.c_str(), O_RDWR | O_NONBLOCK);
+    if (fd == -1)
+        throw v4l2_error("Could not open " + device);
+
+    v4l2_capability capability;
+    std::memset(&capability, 0, sizeof(capability));
+    if (xioctl(VIDIOC_QUERYCAP, &capability) == -1)
+        throw v4l2_error("VIDIOC_QUERYCAP failed on " + device);
+    if (!(capability.capabilities & V4L2_CAP_VIDEO_CAPTURE) || !(capability.capabilities & V4L2_CAP_STREAMING))
+        throw std::runtime_error(device + " does not support streaming video capture");
+
+    if (!set_format(requested_width, requested_height, requested_pixel_format))
+        throw v4l2_error("VIDIOC_S_FMT failed");
+    if (pixel_format != requested_pixel_format)
+        throw std::runtime_error("Device does not support the requested pixel format");
+
+    // Has to happen before the buffers are allocated, since it changes their size.
+    if (crop_rows > 0 && crop_rows < height)
+        cropped = crop_top_rows(crop_rows);
+
+    v4l2_streamparm stream_parameters;
+    std::memset(&stream_parameters, 0, sizeof(stream_parameters));
+    stream_parameters.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    stream_parameters.parm.capture.timeperframe.numerator = 1;
+    stream_parameters.parm.capture.timeperframe.denominator = fps;
+    // Not every driver lets the frame rate be set; it then keeps streaming at its default.
+    xioctl(VIDIOC_S_PARM, &stream_parameters);
+
+    v4l2_requestbuffers request;
+    std::memset(&request, 0, sizeof(request));
+    request.count = buffer_count;
+    request.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    request.memory = V4L2_MEMORY_MMAP;
+    if (xioctl(VIDIOC_REQBUFS, &request) == -1)
+        throw v4l2_error("VIDIOC_REQBUFS failed");
+    if (request.count < 2)
+        throw std::runtime_error("Not enough capture buffers available");
+
+    buffers.resize(request.count);
+    for (uint32_t i = 0; i < request.count; i++)
+    {
+        v4l2_buffer buffer;
+        std::memset(&buffer, 0, sizeof(buffer));
+        buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buffer.memory = V4L2_MEMORY_MMAP;
+        buffer.index = i;
+        if (xioctl(VIDIOC_QUERYBUF, &buffer) == -1)
+            throw v4l2_error("VIDIOC_QUERYBUF failed");
+
+        buffers[i].length = buffer.length;
+        buffers[i].start = mmap(nullptr, buffer.length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, buffer.m.offset);
+        if (buffers[i].start == MAP_FAILED)
+        {
+            buffers[i].start = nullptr;
+            throw v4l2_error("Could not mmap capture buffer");
+        }
+
+        if (xioctl(VIDIOC_QBUF, &buffer) == -1)
+            throw v4l2_error("VIDIOC_QBUF failed");
+    }
+
+    v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (xioctl(VIDIOC_STREAMON, &type) == -1)
+        throw v4l2_error("VIDIOC_STREAMON failed");
+    streaming = true;
+}
+
+bool V4l2Capture::set_format(uint32_t requested_width, uint32_t requested_height, uint32_t requested_pixel_format)
+{
+    v4l2_format format;
+    std::memset(&format, 0, sizeof(format));
+    format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    format.fmt.pix.width = requested_width;
+    format.fmt.pix.height = requested_height;
+    format.fmt.pix.pixelformat = requested_pixel_format;
+    format.fmt.pix.field = V4L2_FIELD_NONE;
+    if (xioctl(VIDIOC_S_FMT, &format) == -1)
+        return false;
+
+    width = format.fmt.pix.width;
+    height = format.fmt.pix.height;
+    pixel_format = format.fmt.pix.pixelformat;
+    bytes_per_line = format.fmt.pix.bytesperline;
+    return true;
+}
+
+bool V4l2Capture::crop_top_rows(uint32_t rows)
+{
+    v4l2_selection bounds;
+    std::memset(&bounds, 0, sizeof(bounds));
+    bounds.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    bounds.target = V4L2_SEL_TGT_CROP_BOUNDS;
+    if (xioctl(VIDIOC_G_SELECTION, &bounds) == -1)
+        return false;
+
+    // Selection rectangles are in sensor pixels, which need not match the output size.
+    uint32_t full_width = width, full_height = height;
+    uint32_t sensor_rows = rows * bounds.r.height / full_height;
+
+    v4l2_selection crop = bounds;
+    crop.target = V4L2_SEL_TGT_CROP;
+    crop.r.top += sensor_rows;
+    crop.r.height -= sensor_rows;
+    if (xioctl(VIDIOC_S_SELECTION, &crop) == -1)
+        return false;
+
+    // Some drivers scale the cropped area back up to the old format; only accept a real crop.
+    if (set_format(full_width, full_height - rows, pixel_format) && width == full_width && height == full_height - rows)
+        return true;
+
+    bounds.target = V4L2_SEL_TGT_CROP;
+    xioctl(VIDIOC_S_SELECTION, &bounds);
+    set_format(full_width, full_height, pixel_format);
+    return false;
+}
+
+void V4l2Capture::close()
+{
+    if (fd == -1)
+        return;
+
+    if (streaming)
+    {
+        v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        xioctl(VIDIOC_STREAMOFF, &type);
+        streaming = false;
+    }
+
+    for (auto &buffer : buffers)
+    {
+        if (buffer.start != nullptr)
+            munmap(buffer.start, buffer.length);
+    }
+    buffers.clear();
+
+    ::close(fd);
+    fd = -1;
+    cropped = false;
+}
+
+bool V4l2Capture::dequeue(V4l2Frame &frame, int timeout_ms)
+{
+    pollfd poll_fd;
+    poll_fd.fd = fd;
+    poll_fd.events = POLLIN;
+    poll_fd.revents = 0;
+
+    int ready = poll(&poll_fd, 1, timeout_ms);
+    if (ready == -1 && errno != EINTR)
+        throw v4l2_error("poll on capture device failed");
+    if (ready <= 0)
+        return false;
+
+    v4l2_buffer buffer;
+    std::memset(&buffer, 0, sizeof(buffer));
+    buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buffer.memory = V4L2_MEMORY_MMAP;
+    if (xioctl(VIDIOC_DQBUF, &buffer) == -1)
+    {
+        if (errno == EAGAIN)
+            return false;
+        throw v4l2_error("VIDIOC_DQBUF failed");
+    }
+
+    frame.data = static_cast<const uint8_t *>(buffers[buffer.index].start);
+    frame.bytes_used = buffer.bytesused;
+    frame.sequence = buffer.sequence;
+    if ((buffer.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC)
+    {
+        frame.monotonic_stamp_ns =
+            static_cast<int64_t>(buffer.timestamp.tv_sec) * 1000000000LL +
+            static_cast<int64_t>(buffer.timestamp.tv_usec) * 1000LL;
+    }
+    else
+    {
+        // Drivers that do not report a monotonic capture time get the dequeue time instead.
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        frame.monotonic_stamp_ns = static_cast<int64_t>(now.tv_sec) * 1000000000LL + now.tv_nsec;
+    }
+    frame.index = buffer.index;
+    return true;
+}
+
+void V4l2Capture::requeue(const V4l2Frame &frame)
+{
+    v4l2_buffer buffer;
+    std::memset(&buffer, 0, sizeof(buffer));
+    buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buffer.memory = V4L2_MEMORY_MMAP;
+    buffer.index = frame.index;
+    if (xioctl(VIDIOC_QBUF, &buffer) == -1)
+        throw v4l2_error("VIDIOC_QBUF failed");
+}
+
+uint32_t fourcc_from_string(const std::string &name)
+{
+    if (name.size() != 4)
+        throw std::invalid_argument("Pixel format must be a four character code, got \"" + name + "\"");
+
+    return v4l2_fourcc(name[0], name[1], name[2], name[3]);
+}
+
+}  // namespace vision
@@ -0,0 +1,315 @@
+// Replays recorded frames through FramePipeline as fast as it will go and reports throughput,
+// per-stage latency and what was detected, so performance and accuracy can be compared from
+// commit to commit without driving the robot around.
+//
+//     vision_benchmark <image directory | rosbag2 directory> [options]
+//
+//     --topic <name>            image topic to read from a bag (default /camera/image_raw)
+//     --repeat <n>              passes over the frames (default 10)
+//     --lower-threshold <v>     (default 180)
+//     --lower-red-value <v>     (default 195)
+//     --min-ball-area <v>       (default 20)
+//     --workers <cpu>,<cpu>     CPUs to pin the two stage workers to (default unpinned)
+//     --backend <cpu|opencl>    where the mask stage runs (default cpu)
+//     --no-tracking             report every frame's largest candidate instead of the tracked ball
+//     --auto-threshold          place the white threshold from each frame's intensities
+//     --detections <file.csv>   write the detections of every frame
+//
+// Frames are decoded into memory before timing starts, so only the pipeline is measured.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "instrumentation/latency_histogram.hpp"
+#include "vision/frame_pipeline.hpp"
+#include "vision/frame_size.hpp"
+
+#ifdef VISION_WITH_ROSBAG2
+#include "rclcpp/serialization.hpp"
+#include "rosbag2_cpp/converter_options.hpp"
+#include "rosbag2_cpp/readers/sequential_reader.hpp"
+#include "rosbag2_cpp/storage_options.hpp"
+#include "sensor_msgs/msg/image.hpp"
+#endif
+
+namespace
+{
+
+struct RecordedFrame
+{
+    std::string name;
+    vision::PixelLayout layout;
+    int width, height;
+    std::size_t step;
+    std::vector<uint8_t> data;
+    // Capture time the tracker predicts from.
+    std::chrono::nanoseconds stamp;
+};
+
+struct Options
+{
+    std::string source, topic = "/camera/image_raw", detections_file, backend = "cpu";
+    int repeat = 10, lower_threshold = 180, lower_red_value = 195, min_ball_area = 20;
+    bool tracking = true, auto_threshold = false;
+    std::vector<int> worker_cpus{-1, -1};
+};
+
+void usage(const char *program)
+{
+    std::fprintf(
+        stderr,
+        "usage: %s <image directory | rosbag2 directory> [--topic name] [--repeat n] [--lower-threshold v]\n"
+        "       [--lower-red-value v] [--min-ball-area v] [--workers cpu,cpu] [--backend cpu|opencl]\n"
+        "       [--no-tracking] [--auto-threshold] [--detections file.csv]\n",
+        program
+    );
+    std::exit(2);
+}
+
+Options parse_options(int argc, char **argv)
+{
+    Options options;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        bool has_value = i + 1 < argc;
+        if (argument == "--topic" && has_value)
+            options.topic = argv[++i];
+        else if (argument == "--repeat" && has_value)
+            options.repeat = std::max(1, std::atoi(argv[++i]));
+        else if (argument == "--lower-threshold" && has_value)
+            options.lower_threshold = std::atoi(argv[++i]);
+        else if (argument == "--lower-red-value" && has_value)
+            options.lower_red_value = std::atoi(argv[++i]);
+        else if (argument == "--min-ball-area" && has_value)
+            options.min_ball_area = std::atoi(argv[++i]);
+        else if (argument == "--workers" && has_value)
+        {
+            std::string cpus = argv[++i];
+            std::size_t comma = cpus.find(',');
+            options.worker_cpus[0] = std::atoi(cpus.substr(0, comma).c_str());
+            options.worker_cpus[1] = comma == std::string::npos ? -1 : std::atoi(cpus.substr(comma + 1).c_str());
+        }
+        else if (argument == "--no-tracking")
+            options.tracking = false;
+        else if (argument == "--auto-threshold")
+            options.auto_threshold = true;
+        else if (argument == "--backend" && has_value)
+            options.backend = argv[++i];
+        else if (argument == "--detections" && has_value)
+            options.detections_file = argv[++i];
+        else if (argument[0] != '-' && options.source.empty())
+            options.source = argument;
+        else
+            usage(argv[0]);
+    }
+
+    if (options.source.empty())
+        usage(argv[0]);
+    return options;
+}
+
+// Images are scaled to the resolution the detectors are tuned to, as the camera would deliver them.
+bool load_images(const std::string &directory, std::vector<RecordedFrame> &frames)
+{
+    std::vector<cv::String> paths;
+    for (const char *pattern : {"/*.png", "/*.jpg", "/*.jpeg", "/*.bmp"})
+    {
+        std::vector<cv::String> matches;
+        cv::glob(directory + pattern, matches, false);
+        paths.insert(paths.end(), matches.begin(), matches.end());
+    }
+    std::sort(paths.begin(), paths.end());
+
+    for (const auto &path : paths)
+    {
+        cv::Mat image = cv::imread(path, cv::IMREAD_COLOR);
+        if (image.empty())
+        {
+            std::fprintf(stderr, "Skipping unreadable image %s\n", path.c_str());
+            continue;
+        }
+        if (image.cols != WIDTH || image.rows != HEIGHT)
+            cv::resize(image, image, cv::Size(WIDTH, HEIGHT), 0, 0, cv::INTER_AREA);
+
+        // Images carry no capture time, so they are played back at the camera's 30 fps.
+        auto stamp = std::chrono::nanoseconds(1000000000LL * (frames.size() + 1) / 30);
+        RecordedFrame frame{path, vision::PixelLayout::BGR, image.cols, image.rows, image.step, {}, stamp};
+        frame.data.assign(image.datastart, image.dataend);
+        frames.push_back(std::move(frame));
+    }
+
+    return !frames.empty();
+}
+
+#ifdef VISION_WITH_ROSBAG2
+bool load_bag(const std::string &uri, const std::string &topic, std::vector<RecordedFrame> &frames)
+{
+    rosbag2_cpp::StorageOptions storage_options;
+    storage_options.uri = uri;
+    storage_options.storage_id = "sqlite3";
+    rosbag2_cpp::ConverterOptions converter_options;
+    converter_options.input_serialization_format = "cdr";
+    converter_options.output_serialization_format = "cdr";
+
+    rosbag2_cpp::readers::SequentialReader reader;
+    try
+    {
+        reader.open(storage_options, converter_options);
+    }
+    catch (const std::exception &e)
+    {
+        return false;
+    }
+
+    rclcpp::Serialization<sensor_msgs::msg::Image> serialization;
+    while (reader.has_next())
+    {
+        auto bag_message = reader.read_next();
+        if (bag_message->topic_name != topic)
+            continue;
+
+        sensor_msgs::msg::Image image;
+        rclcpp::SerializedMessage serialized(*bag_message->serialized_data);
+        serialization.deserialize_message(&serialized, &image);
+
+        vision::PixelLayout layout;
+        if (!vision::pixel_layout_from_encoding(image.encoding, layout))
+        {
+            std::fprintf(stderr, "Skipping frame with unsupported encoding %s\n", image.encoding.c_str());
+            continue;
+        }
+
+        std::string name = std::to_string(image.header.stamp.sec) + "." + std::to_string(image.header.stamp.nanosec);
+        auto stamp = std::chrono::seconds(image.header.stamp.sec) + std::chrono::nanoseconds(image.header.stamp.nanosec);
+        RecordedFrame frame{
+            name, layout, static_cast<int>(image.width), static_cast<int>(image.height), image.step, std::move(image.data), stamp
+        };
+        frames.push_back(std::move(frame));
+    }
+
+    return !frames.empty();
+}
+#endif
+
+void print_stage(const char *stage, instrumentation::LatencyHistogram &histogram)
+{
+    instrumentation::LatencySummary summary = histogram.take();
+    std::printf("%-10s %10.3f %10.3f %10.3f\n", stage, summary.p50 / 1000.0, summary.p99 / 1000.0, summary.max / 1000.0);
+}
+
+}  // namespace
+
+int main(int argc, char **argv)
+{
+    Options options = parse_options(argc, argv);
+
+    std::vector<RecordedFrame> frames;
+    bool loaded = load_images(options.source, frames);
+#ifdef VISION_WITH_ROSBAG2
+    if (!loaded)
+        loaded = load_bag(options.source, options.topic, frames);
+#endif
+    if (!loaded)
+    {
+        std::fprintf(stderr, "No frames found in %s\n", options.source.c_str());
+        return 1;
+    }
+
+    vision::FramePipeline pipeline(options.worker_cpus);
+    vision::BallTrackerConfig tracker_config;
+    pipeline.set_thresholds(options.lower_threshold, options.lower_red_value);
+    pipeline.set_min_ball_area(options.min_ball_area);
+    vision::MaskBackend backend;
+    if (!vision::mask_backend_from_name(options.backend, backend) || !pipeline.set_backend(backend))
+    {
+        std::fprintf(stderr, "Mask backend %s is not available\n", options.backend.c_str());
+        return 1;
+    }
+
+    std::vector<cv::Mat> views(frames.size());
+    for (std::size_t i = 0; i < frames.size(); i++)
+    {
+        const RecordedFrame &frame = frames[i];
+        if (!vision::view_frame(frame.layout, frame.width, frame.height, frame.step, frame.data.data(), frame.data.size(), views[i]))
+        {
+            std::fprintf(stderr, "Frame %s is smaller than its size describes\n", frame.name.c_str());
+            return 1;
+        }
+    }
+
+    std::ofstream detections_file;
+    if (!options.detections_file.empty())
+    {
+        detections_file.open(options.detections_file);
+        detections_file << "frame,source,ball_position,ball_predicted,corner_position,ball_column,candidates,largest_area,next_lower_threshold\n";
+    }
+
+    instrumentation::LatencyHistogram threshold, histogram, corners, total;
+    std::size_t frames_with_ball = 0, frames_with_edge = 0;
+    vision::FrameDetections detections;
+
+    // One untimed pass sizes the buffers and builds the lookup tables, as the first frame on the robot would.
+    pipeline.process(views[0], frames[0].layout, frames[0].height, frames[0].stamp, detections);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int pass = 0; pass < options.repeat; pass++)
+    {
+        // Every pass starts without a track and with the lighting unknown, as the first did.
+        pipeline.set_tracking(options.tracking, tracker_config);
+        pipeline.set_auto_threshold(options.auto_threshold, vision::AutoThresholdConfig());
+        for (std::size_t i = 0; i < frames.size(); i++)
+        {
+            auto frame_start = std::chrono::steady_clock::now();
+            pipeline.process(views[i], frames[i].layout, frames[i].height, frames[i].stamp, detections);
+            total.record(std::chrono::steady_clock::now() - frame_start);
+
+            const vision::StageDurations &durations = pipeline.stage_durations();
+            threshold.record(durations.threshold);
+            histogram.record(durations.histogram);
+            corners.record(durations.corners);
+
+            // Detections are the same on every pass, so only the first is reported.
+            if (pass != 0)
+                continue;
+
+            frames_with_ball += detections.ball_position != NO_BALL_FOUND;
+            frames_with_edge += detections.corner_position != NO_EDGE_FOUND;
+            if (detections_file.is_open())
+            {
+                const auto &balls = pipeline.buffers().ball_candidates;
+                detections_file << i << ',' << frames[i].name << ','
+                    << detections.ball_position << ','
+                    << detections.ball_predicted << ','
+                    << (detections.corner_position == NO_EDGE_FOUND ? std::string("none") : std::to_string(detections.corner_position)) << ','
+                    << detections.ball_column << ','
+                    << balls.size() << ','
+                    << (balls.empty() ? 0 : balls.front().area) << ','
+                    << pipeline.applied_lower_threshold() << '\n';
+            }
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::size_t processed = frames.size() * options.repeat;
+
+    std::printf("backend     %s\n", options.backend.c_str());
+    std::printf("frames      %zu (%zu x %d passes)\n", processed, frames.size(), options.repeat);
+    std::printf("fps         %.1f\n", processed / seconds);
+    std::printf("ball        %zu of %zu frames\n", frames_with_ball, frames.size());
+    std::printf("edge        %zu of %zu frames\n", frames_with_edge, frames.size());
+    std::printf("thresholds  %d / %d at the end\n", pipeline.applied_lower_threshold(), pipeline.applied_lower_red_value());
+    std::printf("\n%-10s %10s %10s %10s\n", "stage (ms)", "p50", "p99", "max");
+    print_stage("threshold", threshold);
+    print_stage("histogram", histogram);
+    print_stage("corners", corners);
+    print_stage("total", total);
+    return 0;
+}
@@ -0,0 +1,61 @@
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "vision/allocation_counter.hpp"
+
+namespace vision
+{
+
+// Run with libvision_allocation_counter.so preloaded, as the test target does.
+class AllocationCounterTest : public ::testing::Test
+{
+    protected:
+        void SetUp() override
+        {
+            ASSERT_TRUE(allocation_counting_active()) << "libvision_allocation_counter.so is not preloaded";
+        }
+};
+
+TEST_F(AllocationCounterTest, CountsMatAllocationsInScope)
+{
+    cv::Mat frame(480, 640, CV_8UC3, cv::Scalar::all(0));
+    std::size_t before = counted_allocations();
+    {
+        AllocationScope scope;
+        cv::Mat copy = frame.clone();
+        EXPECT_FALSE(copy.empty());
+    }
+    EXPECT_GT(counted_allocations(), before);
+}
+
+TEST_F(AllocationCounterTest, CountsNewInScope)
+{
+    std::size_t before = counted_allocations();
+    {
+        AllocationScope scope;
+        std::vector<int> values(100);
+        EXPECT_EQ(values.size(), 100u);
+    }
+    EXPECT_GT(counted_allocations(), before);
+}
+
+TEST_F(AllocationCounterTest, IgnoresReuseAndAllocationsOutsideScope)
+{
+    cv::Mat mask;
+    mask.create(480, 640, CV_8UC1);
+    std::size_t before = counted_allocations();
+    {
+        AllocationScope scope;
+        // Same size and type, so the buffer is reused.
+        mask.create(480, 640, CV_8UC1);
+        EXPECT_EQ(mask.cols, 640);
+    }
+    cv::Mat unscoped = mask.clone();
+    EXPECT_EQ(counted_allocations(), before);
+}
+
+}  // namespace vision
@@ -0,0 +1,234 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "vision/ball_detector.hpp"
+#include "vision/frame_pipeline.hpp"
+
+namespace vision
+{
+
+// 8-connected flood fill of every blob of set pixels inside region, in mask coordinates.
+static std::vector<BallCandidate> flood_fill(const cv::Mat &mask, const cv::Rect &region)
+{
+    cv::Mat seen(mask.rows, mask.cols, CV_8UC1);
+    for (int row = 0; row < mask.rows; row++)
+        std::fill(seen.ptr<uint8_t>(row), seen.ptr<uint8_t>(row) + mask.cols, 0);
+
+    std::vector<BallCandidate> blobs;
+    std::vector<std::pair<int, int>> stack;
+    for (int y = region.y; y < region.y + region.height; y++)
+    {
+        for (int x = region.x; x < region.x + region.width; x++)
+        {
+            if (mask.ptr<uint8_t>(y)[x] == 0 || seen.ptr<uint8_t>(y)[x] != 0)
+                continue;
+
+            int64_t sum_x = 0, sum_y = 0;
+            int area = 0, left = x, top = y, right = x, bottom = y;
+            seen.ptr<uint8_t>(y)[x] = 1;
+            stack.assign(1, {x, y});
+            while (!stack.empty())
+            {
+                std::pair<int, int> pixel = stack.back();
+                stack.pop_back();
+                area++;
+                sum_x += pixel.first;
+                sum_y += pixel.second;
+                left = std::min(left, pixel.first);
+                right = std::max(right, pixel.first);
+                top = std::min(top, pixel.second);
+                bottom = std::max(bottom, pixel.second);
+
+                for (int dy = -1; dy <= 1; dy++)
+                {
+                    for (int dx = -1; dx <= 1; dx++)
+                    {
+                        int nx = pixel.first + dx, ny = pixel.second + dy;
+                        if (nx < region.x || nx >= region.x + region.width || ny < region.y || ny >= region.y + region.height)
+                            continue;
+                        if (mask.ptr<uint8_t>(ny)[nx] == 0 || seen.ptr<uint8_t>(ny)[nx] != 0)
+                            continue;
+                        seen.ptr<uint8_t>(ny)[nx] = 1;
+                        stack.push_back({nx, ny});
+                    }
+                }
+            }
+
+            blobs.push_back({
+                static_cast<float>(sum_x) / area,
+                static_cast<float>(sum_y) / area,
+                area,
+                cv::Rect(left, top, right - left + 1, bottom - top + 1)
+            });
+        }
+    }
+    return blobs;
+}
+
+static cv::Mat random_mask(std::mt19937 &random, int rows, int cols, double density)
+{
+    cv::Mat mask(rows, cols, CV_8UC1);
+    std::bernoulli_distribution set(density);
+    for (int row = 0; row < rows; row++)
+    {
+        uint8_t *pixels = mask.ptr<uint8_t>(row);
+        for (int col = 0; col < cols; col++)
+            pixels[col] = set(random) ? 255 : 0;
+    }
+    return mask;
+}
+
+static bool same_blob(const BallCandidate &a, const BallCandidate &b)
+{
+    return a.area == b.area && a.box.x == b.box.x && a.box.y == b.box.y && a.box.width == b.box.width &&
+        a.box.height == b.box.height && std::abs(a.centroid_x - b.centroid_x) < 1e-3f &&
+        std::abs(a.centroid_y - b.centroid_y) < 1e-3f;
+}
+
+// The detector keeps the MAX_BALL_CANDIDATES largest blobs of at least min_area, in order of area.
+// Equal areas may come in any order, so each candidate only has to be one of the expected blobs.
+static void expect_largest(const std::vector<BallCandidate> &candidates, std::vector<BallCandidate> expected, int min_area)
+{
+    expected.erase(
+        std::remove_if(expected.begin(), expected.end(), [min_area](const BallCandidate &blob) { return blob.area < min_area; }),
+        expected.end()
+    );
+    std::stable_sort(
+        expected.begin(),
+        expected.end(),
+        [](const BallCandidate &a, const BallCandidate &b) { return a.area > b.area; }
+    );
+
+    ASSERT_EQ(candidates.size(), std::min<std::size_t>(expected.size(), MAX_BALL_CANDIDATES));
+    for (std::size_t i = 0; i < candidates.size(); i++)
+    {
+        EXPECT_EQ(candidates[i].area, expected[i].area) << "candidate " << i;
+        bool found = std::any_of(
+            expected.begin(),
+            expected.end(),
+            [&](const BallCandidate &blob) { return same_blob(blob, candidates[i]); }
+        );
+        EXPECT_TRUE(found) << "candidate " << i << " of area " << candidates[i].area << " at (" << candidates[i].box.x
+                           << ", " << candidates[i].box.y << ") is not a blob";
+    }
+}
+
+TEST(BallDetectorTest, MatchesFloodFillOnRandomMasks)
+{
+    std::mt19937 random(42);
+    BallDetector detector(BALL_LABEL_RUNS);
+    std::vector<BallCandidate> candidates;
+    const double densities[] = {0.05, 0.3, 0.5, 0.7};
+    for (int trial = 0; trial < 40; trial++)
+    {
+        cv::Mat mask = random_mask(random, 60, 90, densities[trial % 4]);
+        cv::Rect region(trial % 7, trial % 5, 90 - 2 * (trial % 7), 60 - trial % 5);
+        int min_area = trial % 3;
+        detector.detect(mask, region, min_area, candidates);
+        EXPECT_FALSE(detector.was_truncated());
+        expect_largest(candidates, flood_fill(mask, region), min_area);
+    }
+}
+
+TEST(BallDetectorTest, MergesRunsJoinedOnLaterRows)
+{
+    // A U whose arms only meet on its last row, a zigzag whose rows only touch diagonally and which
+    // runs into the top of a box, a stick inside the box touching nothing, and a lone pixel.
+    cv::Mat mask(12, 20, CV_8UC1);
+    const char *rows[] = {
+        "#...#...#.#.#.......",
+        "#...#....#.#........",
+        "#...#...#.#.#.......",
+        "#####....#.#........",
+        "........#...#.......",
+        "..........#####.....",
+        "..........#...#.....",
+        "..........#.#.#.....",
+        "..........#.#.#.....",
+        "..........#.#.#.....",
+        "............#.......",
+        ".#..................",
+    };
+    for (int row = 0; row < mask.rows; row++)
+        for (int col = 0; col < mask.cols; col++)
+            mask.ptr<uint8_t>(row)[col] = rows[row][col] == '#' ? 255 : 0;
+
+    BallDetector detector(64);
+    std::vector<BallCandidate> candidates;
+    cv::Rect region(0, 0, mask.cols, mask.rows);
+    detector.detect(mask, region, 1, candidates);
+    expect_largest(candidates, flood_fill(mask, region), 1);
+    ASSERT_EQ(candidates.size(), 4u);
+    EXPECT_EQ(candidates[0].area, 25);
+}
+
+TEST(BallDetectorTest, LabelsOnlyTheRunsItHasRoomFor)
+{
+    std::mt19937 random(7);
+    std::vector<BallCandidate> candidates;
+    for (std::size_t max_runs : {1u, 10u, 100u, 500u})
+    {
+        cv::Mat mask = random_mask(random, 40, 60, 0.4);
+        cv::Rect region(0, 0, mask.cols, mask.rows);
+
+        // The detector stops at the run that does not fit, so only the runs before it count.
+        cv::Mat labelled = mask.clone();
+        std::size_t runs = 0;
+        for (int row = 0; row < labelled.rows; row++)
+        {
+            uint8_t *pixels = labelled.ptr<uint8_t>(row);
+            for (int col = 0; col < labelled.cols; col++)
+            {
+                if (pixels[col] != 0 && (col == 0 || mask.ptr<uint8_t>(row)[col - 1] == 0))
+                    runs++;
+                if (runs > max_runs)
+                    pixels[col] = 0;
+            }
+        }
+        ASSERT_GT(runs, max_runs);
+
+        BallDetector detector(max_runs);
+        detector.detect(mask, region, 1, candidates);
+        EXPECT_TRUE(detector.was_truncated());
+        expect_largest(candidates, flood_fill(labelled, region), 1);
+    }
+}
+
+TEST(BallDetectorTest, TruncatesFullFrameCheckerboard)
+{
+    // Every other pixel set: WIDTH * HEIGHT / 2 runs, far more than BALL_LABEL_RUNS.
+    cv::Mat mask(HEIGHT, WIDTH, CV_8UC1);
+    for (int row = 0; row < HEIGHT; row++)
+        for (int col = 0; col < WIDTH; col++)
+            mask.ptr<uint8_t>(row)[col] = (row + col) % 2 == 0 ? 255 : 0;
+
+    BallDetector detector(BALL_LABEL_RUNS);
+    std::vector<BallCandidate> candidates;
+    detector.detect(mask, cv::Rect(0, 0, WIDTH, HEIGHT), 1, candidates);
+    EXPECT_TRUE(detector.was_truncated());
+    // The labelled rows form one diagonal mesh, BALL_LABEL_RUNS single pixels.
+    ASSERT_EQ(candidates.size(), 1u);
+    EXPECT_EQ(candidates[0].area, BALL_LABEL_RUNS);
+    EXPECT_EQ(candidates[0].box.x, 0);
+    EXPECT_EQ(candidates[0].box.y, 0);
+
+    // Without truncation the next frame is labelled in full again.
+    cv::Mat sparse(HEIGHT, WIDTH, CV_8UC1);
+    for (int row = 0; row < HEIGHT; row++)
+        std::fill(sparse.ptr<uint8_t>(row), sparse.ptr<uint8_t>(row) + WIDTH, 0);
+    sparse.ptr<uint8_t>(10)[20] = 255;
+    detector.detect(sparse, cv::Rect(0, 0, WIDTH, HEIGHT), 1, candidates);
+    EXPECT_FALSE(detector.was_truncated());
+    ASSERT_EQ(candidates.size(), 1u);
+    EXPECT_EQ(candidates[0].area, 1);
+}
+
+}  // namespace vision
@@ -0,0 +1,167 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "vision/ball_tracker.hpp"
+
+namespace vision
+{
+
+class BallTrackerTest : public ::testing::Test
+{
+    protected:
+        BallTracker tracker;
+        int frame = 0;
+
+        static BallCandidate ball_at(float x, int area = 50)
+        {
+            return {x, 120.0f, area, cv::Rect(static_cast<int>(x) - 4, 116, 9, 9)};
+        }
+
+        // One frame at 30 fps: predict, then update with what the detector found.
+        bool step(const std::vector<BallCandidate> &candidates, int &column)
+        {
+            tracker.predict(std::chrono::seconds(1) + frame++ * std::chrono::nanoseconds(33333333));
+            return tracker.update(candidates, column);
+        }
+
+        // Confirms a track on a ball standing at x.
+        void track_at(float x)
+        {
+            int column;
+            for (int i = 0; i < 5; i++)
+                step({ball_at(x)}, column);
+            ASSERT_TRUE(step({ball_at(x)}, column));
+            ASSERT_EQ(column, static_cast<int>(x));
+        }
+};
+
+TEST_F(BallTrackerTest, ConfirmsBeforeReporting)
+{
+    int column = -1;
+    EXPECT_FALSE(step({ball_at(100.0f)}, column));
+    EXPECT_TRUE(step({ball_at(100.0f)}, column));
+    EXPECT_EQ(column, 100);
+    EXPECT_FALSE(tracker.coasting());
+}
+
+TEST_F(BallTrackerTest, FollowsConstantVelocityBall)
+{
+    // 3 columns a frame, with a smaller decoy on the far side that never enters the gate.
+    int column = -1;
+    for (int i = 0; i < 60; i++)
+    {
+        float x = 40.0f + 3.0f * i;
+        bool tracked = step({ball_at(x, 60), ball_at(x + 150.0f, 20)}, column);
+        if (i >= 1)
+        {
+            EXPECT_TRUE(tracked) << "frame " << i;
+        }
+        // The alpha-beta filter has no steady-state error on a constant velocity.
+        if (i >= 20)
+        {
+            EXPECT_NEAR(column, x, 1.0f) << "frame " << i;
+        }
+        EXPECT_FALSE(tracker.coasting());
+    }
+}
+
+TEST_F(BallTrackerTest, RejectsSingleFrameOutlier)
+{
+    track_at(100.0f);
+
+    // A large blob outside the gate, e.g. a reflection, is not the ball: the track coasts.
+    int column = -1;
+    EXPECT_TRUE(step({ball_at(250.0f, 500)}, column));
+    EXPECT_TRUE(tracker.coasting());
+    EXPECT_EQ(column, 100);
+
+    // With the ball back, the nearest candidate in the gate wins over the largest.
+    EXPECT_TRUE(step({ball_at(250.0f, 500), ball_at(101.0f)}, column));
+    EXPECT_FALSE(tracker.coasting());
+    EXPECT_NEAR(column, 100, 1);
+}
+
+TEST_F(BallTrackerTest, DropsTrackAfterCoastLimit)
+{
+    BallTrackerConfig config;
+    config.max_coast_frames = 4;
+    tracker.set_config(config);
+    track_at(100.0f);
+
+    int column = -1;
+    for (int i = 0; i < config.max_coast_frames; i++)
+    {
+        EXPECT_TRUE(step({}, column)) << "coasted frame " << i;
+        EXPECT_TRUE(tracker.coasting());
+        EXPECT_EQ(column, 100);
+    }
+    EXPECT_FALSE(step({}, column));
+    EXPECT_FALSE(tracker.coasting());
+
+    // A new ball after the drop has to be confirmed again.
+    EXPECT_FALSE(step({ball_at(200.0f)}, column));
+    EXPECT_TRUE(step({ball_at(200.0f)}, column));
+    EXPECT_EQ(column, 200);
+}
+
+TEST_F(BallTrackerTest, DropsTrackAfterFrameGap)
+{
+    track_at(100.0f);
+
+    int column = -1;
+    tracker.predict(std::chrono::seconds(10));
+    EXPECT_FALSE(tracker.update({ball_at(100.0f)}, column));
+}
+
+TEST_F(BallTrackerTest, SearchRegionFollowsAndClipsToRegion)
+{
+    const cv::Rect region(0, 80, 360, 160);
+    BallTrackerConfig config;
+    tracker.set_config(config);
+
+    // No track: the whole region is labelled.
+    tracker.predict(std::chrono::seconds(1));
+    cv::Rect searched = tracker.search_region(region);
+    EXPECT_EQ(searched.x, region.x);
+    EXPECT_EQ(searched.width, region.width);
+
+    track_at(180.0f);
+    tracker.predict(std::chrono::seconds(1) + frame * std::chrono::nanoseconds(33333333));
+    searched = tracker.search_region(region);
+    EXPECT_EQ(searched.x, 180 - config.search_margin);
+    EXPECT_EQ(searched.width, 2 * config.search_margin + 1);
+    EXPECT_EQ(searched.y, region.y);
+    EXPECT_EQ(searched.height, region.height);
+
+    // Near either edge the window is cut to the region.
+    tracker.reset();
+    frame = 0;
+    track_at(20.0f);
+    tracker.predict(std::chrono::seconds(1) + frame * std::chrono::nanoseconds(33333333));
+    searched = tracker.search_region(region);
+    EXPECT_EQ(searched.x, 0);
+    EXPECT_EQ(searched.x + searched.width, 20 + config.search_margin + 1);
+
+    tracker.reset();
+    frame = 0;
+    track_at(350.0f);
+    tracker.predict(std::chrono::seconds(1) + frame * std::chrono::nanoseconds(33333333));
+    searched = tracker.search_region(region);
+    EXPECT_EQ(searched.x, 350 - config.search_margin);
+    EXPECT_EQ(searched.x + searched.width, region.x + region.width);
+
+    // A missed frame widens the search back to the whole region.
+    int column;
+    tracker.update({}, column);
+    tracker.predict(std::chrono::seconds(1) + (frame + 1) * std::chrono::nanoseconds(33333333));
+    searched = tracker.search_region(region);
+    EXPECT_EQ(searched.x, region.x);
+    EXPECT_EQ(searched.width, region.width);
+}
+
+}  // namespace vision
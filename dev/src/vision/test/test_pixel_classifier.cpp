@@ -0,0 +1,128 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <thread>
+
+#include <opencv2/core.hpp>
+
+#include "vision/pixel_classifier.hpp"
+
+namespace vision
+{
+
+// Every BGR colour once: row b * 256 + g holds r = 0..255.
+class PixelClassifierTest : public ::testing::Test
+{
+    protected:
+        static constexpr int ROWS = 256 * 256;
+
+        cv::Mat cube, white, red;
+
+        void SetUp() override
+        {
+            cube.create(ROWS, 256, CV_8UC3);
+            white.create(ROWS, 256, CV_8UC1);
+            red.create(ROWS, 256, CV_8UC1);
+            for (int row = 0; row < ROWS; row++)
+            {
+                uint8_t *pixel = cube.ptr<uint8_t>(row);
+                for (int r = 0; r < 256; r++, pixel += 3)
+                {
+                    pixel[0] = static_cast<uint8_t>(row >> 8);
+                    pixel[1] = static_cast<uint8_t>(row & 255);
+                    pixel[2] = static_cast<uint8_t>(r);
+                }
+            }
+        }
+
+        // Classifies the cube in two bands, as the pipeline does, and checks every pixel against
+        // the exact tests.
+        void expect_exact(const PixelClassifier &classifier, int lower_threshold, int lower_red_value)
+        {
+            classifier.classify(cube, PixelLayout::BGR, ROWS, 0, ROWS / 2, white, red);
+            classifier.classify(cube, PixelLayout::BGR, ROWS, ROWS / 2, ROWS, white, red);
+
+            int white_mismatches = 0, red_mismatches = 0;
+            for (int row = 0; row < ROWS; row++)
+            {
+                int b = row >> 8, g = row & 255;
+                const uint8_t *white_row = white.ptr<uint8_t>(row);
+                const uint8_t *red_row = red.ptr<uint8_t>(row);
+                for (int r = 0; r < 256; r++)
+                {
+                    bool is_white = bgr_gray(b, g, r) >= lower_threshold;
+                    bool is_red = is_red_bgr(b, g, r, lower_red_value);
+                    if ((white_row[r] == 255) != is_white && white_mismatches++ == 0)
+                        ADD_FAILURE() << "white differs at b=" << b << " g=" << g << " r=" << r;
+                    if ((red_row[r] == 255) != is_red && red_mismatches++ == 0)
+                        ADD_FAILURE() << "red differs at b=" << b << " g=" << g << " r=" << r;
+                    if (white_row[r] != 0 && white_row[r] != 255)
+                        ADD_FAILURE() << "white mask value " << int(white_row[r]);
+                }
+            }
+            EXPECT_EQ(white_mismatches, 0) << "lower_threshold " << lower_threshold;
+            EXPECT_EQ(red_mismatches, 0) << "lower_red_value " << lower_red_value;
+        }
+
+        // Configures as each frame would until the builder's tables are swapped in.
+        static void wait_until_used(PixelClassifier &classifier, int lower_threshold, int lower_red_value)
+        {
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+            while (!classifier.uses(lower_threshold, lower_red_value, PixelLayout::BGR) &&
+                std::chrono::steady_clock::now() < deadline)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                classifier.configure(lower_threshold, lower_red_value, PixelLayout::BGR);
+            }
+            ASSERT_TRUE(classifier.uses(lower_threshold, lower_red_value, PixelLayout::BGR));
+        }
+};
+
+TEST_F(PixelClassifierTest, FirstConfigureIsExactAcrossBgrCube)
+{
+    const int thresholds[][2] = {{0, 0}, {150, 100}, {180, 150}, {255, 255}};
+    for (const auto &threshold : thresholds)
+    {
+        PixelClassifier classifier;
+        classifier.configure(threshold[0], threshold[1], PixelLayout::BGR);
+        ASSERT_TRUE(classifier.uses(threshold[0], threshold[1], PixelLayout::BGR));
+        expect_exact(classifier, threshold[0], threshold[1]);
+    }
+}
+
+TEST_F(PixelClassifierTest, KeepsPreviousTablesUntilRebuilt)
+{
+    PixelClassifier classifier;
+    classifier.configure(150, 100, PixelLayout::BGR);
+    classifier.configure(200, 60, PixelLayout::BGR);
+    if (!classifier.uses(200, 60, PixelLayout::BGR))
+        expect_exact(classifier, 150, 100);
+}
+
+TEST_F(PixelClassifierTest, RebuiltTablesAreExactAcrossBgrCube)
+{
+    PixelClassifier classifier;
+    classifier.configure(150, 100, PixelLayout::BGR);
+
+    // White alone, red alone, then both, so each half is rebuilt on its own.
+    const int thresholds[][2] = {{165, 100}, {165, 130}, {200, 60}};
+    for (const auto &threshold : thresholds)
+    {
+        wait_until_used(classifier, threshold[0], threshold[1]);
+        expect_exact(classifier, threshold[0], threshold[1]);
+    }
+}
+
+TEST_F(PixelClassifierTest, CoalescesRapidAdjustments)
+{
+    PixelClassifier classifier;
+    classifier.configure(150, 100, PixelLayout::BGR);
+    // A held D-pad: one step per frame, faster than the tables rebuild.
+    for (int step = 1; step <= 10; step++)
+        classifier.configure(150 + step, 100 + step, PixelLayout::BGR);
+
+    wait_until_used(classifier, 160, 110);
+    expect_exact(classifier, 160, 110);
+}
+
+}  // namespace vision